@@ -1,181 +1,240 @@
 // ==================================================> INCLUDES <==================================================
 
-#include <stdio.h>
-#include <stdlib.h>
-#include <ncurses.h>
-#include <time.h>
-#include <math.h>
+#include "BlockGame Final project.h"
 
-#include <string.h>
-#include <unistd.h> // For sleep()
-
-#define VERTICIES 3000
-#define POLYGONS 3000
-#define WORLD_SIZE 16
-#define NUM_BLOCKS 17
-
-// ==================================================> STRUCTS <==================================================
-
-/* 
-	Potential Improvement for readability.
-	Would require rewrite
-	
-typedef struct point {
-	int x, y, z;
-}Point;
-
-typedef struct polygon {
-	int p1, p2, p3;
-}Polygon;
-*/
-
-// ==================================================> PROTOTYPES <==================================================
-
-void convertScreen(int gameCoords[VERTICIES][3], double screenCoords[VERTICIES][3], double playerPos[3], double playerRot[3]);
-
-void fillPolygon(double polygon[3][3], int color, char draw);
-
-int isInside(double poly[3][2], int pointX, int pointY);
-
-void getGameInputs(double playerMove[], double playerRot[], int* menu, int* grounded, int* destroy, int* blockType);
-
-int getMenuInputs(int* menuX, int* menuY, int* menu);
-
-void drawAll(int allPolygons[POLYGONS][4], double screenCoords[VERTICIES][3], int drawOrder[POLYGONS], int gameCoords[VERTICIES][3]);
-
-void generateTerrain(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int seed);
-
-void loadTerrain(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], FILE* level);
-
-void saveWorld(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], FILE* level);
-
-void generatePolygons(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int polygons[POLYGONS][4], int gameCoords[VERTICIES][3], int blockColors[][3]);
-
-int addVertex(int x, int y, int z, int vertexList[VERTICIES][3]);
-
-void addPoly(int vert1, int vert2, int vert3, int color, int polyList[POLYGONS][4]);
-
-void cullBack(int polygons[POLYGONS][4], double screenCoords[VERTICIES][3], int drawOrder[POLYGONS]);
-
-void orderPoly(int polygons[POLYGONS][4], double screenCoords[VERTICIES][3], int drawOrder[POLYGONS]);
-
-int checkCollisions(double playerPos[3], double playerMove[3], int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE]);
-
-void drawPaused(int menuX, int menuY);
-
-void playerTouching(double playerPos[], double playerRot[], int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int blocksTouching[2][3]);
+// ==================================================> GLOBAL <==================================================
 
-void editBlock(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int blocksTouching[2][3], int blockType, int destroy);
+double deltaTime;
 
-void drawInventory(int blockColors[][3], int blockType);
+Profiler profiler = {.terminalFd = -1, .outputSocket = -1};
 
+Arena frameArena;
 
+const char* stageNames[NUM_STAGES] = {"input", "physics", "blocks", "entities", "picking", "meshing", "transform", "cull", "sort", "raster", "present"};
 
-void setColor(const char *color);
+const char* counterNames[NUM_COUNTERS] = {"triangles", "occluded", "cells", "bytes", "latency_us", "updates", "light", "writes", "entities", "arena_kb"};
 
-void resetColor();
+Journal journal;
 
-void welcomeScreen();
+EventLoop events = {.epoll = -1, .frameTimer = -1, .autosaveTimer = -1};
 
-void displayMenu();
+volatile sig_atomic_t serverStopping = 0;
 
-int getValidatedChoice();
+Viewport viewport;
 
-int playMenu();
+Raymarcher raymarcher;
 
-void loadMenu(FILE** level);
+BrickMap brickmap;
 
-void quitMenu();
+HeightMap heightmap;
 
-void drawGraphicalMenu(void);
+volatile sig_atomic_t terminalResized = 0;
 
-// ==================================================> GLOBAL <==================================================
+// fillPolygon's inner loops by [depth test][light buffer]
+int (*const fillVariants[2][2])(FillJob* job) = {{fillFlat, fillFlatLit}, {fillDepth, fillDepthLit}};
 
-double deltaTime;
+// Colors of the top, sides and bottom of each block type. negative colors are drawn with characters
+int blockColors[][3] = {{2,-3,-3},{-3,-3,-3},{-4,-4,-4},{5,-3,5},{-2,-2,-2},{7,7,7},{-8,-8,-8},{8,8,8},{2,2,2},{1,1,1},{9,9,9},{14,14,14},{-10,-10,-10},{15,15,15},{-6,-6,-6},{-14,-14,-14},{3,3,3},{-13,-16,-16}};
 
 // ==================================================> MAIN <==================================================
 
-int main() {
-	//Main menu section
-	int choice;
+// built with -DBLOCKGAME_LIBRARY the file is only the engine and main is left out
+#ifndef BLOCKGAME_LIBRARY
+int main(int argc, char* argv[]) {
+	// the locale lets ncurses draw the half block characters
+	setlocale(LC_ALL, "");
 	int seed = -1;
 	FILE* level = NULL;
- 
-    // Welcome Screen
-    welcomeScreen();
-      
-       // Graphical Menu
-    drawGraphicalMenu();
-      
-      // Pause after the graphical menu
-    printf("\nPress Enter to continue...");
-    getchar(); // Wait for the user to press Enter
- 
-    while (1) {
-        // Display the menu
-        displayMenu();
- 
-        // Get the validated choice
-        choice = getValidatedChoice();
- 
-        // Handle menu options
-        switch (choice) {
-            case 1:
-                seed = playMenu();
-                break;
-            case 2:
-                loadMenu(&level);
-                break;
-            case 3:
-                quitMenu();
-                exit(0);
-            default:
-                printf("Invalid choice. Please try again.\n");
+	char levelName[100] = "";
+	int headless = 0;
+	const char* recordFile = NULL;
+	const char* replayFile = NULL;
+	const char* timingsFile = NULL;
+	const char* serverAddress = NULL;
+	const char* connectAddress = NULL;
+	int connection = -1;
+	// the connection to the server and the keys waiting to be sent on it
+	NetPlayer server = {.socket = -1};
+	int playerId = -1;
+	double fps = 0;
+	double autosave = 0;
+	int renderScale = 1;
+	int halfBlocks = 0;
+	int output = OUTPUT_CURSES;
+	int frameLimit = 0;
+	int rayThreads = 0;
+	// startup is timed from here, or from leaving the menus when they are used
+	double launchTime = getTime();
+	
+	// Command line options
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+			recordFile = argv[++i];
+		} else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+			replayFile = argv[++i];
+		} else if (strcmp(argv[i], "--timings") == 0 && i + 1 < argc) {
+			timingsFile = argv[++i];
+		} else if (strcmp(argv[i], "--headless") == 0) {
+			headless = 1;
+		} else if (strcmp(argv[i], "--server") == 0 && i + 1 < argc) {
+			serverAddress = argv[++i];
+		} else if (strcmp(argv[i], "--connect") == 0 && i + 1 < argc) {
+			connectAddress = argv[++i];
+		} else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+			fps = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--autosave") == 0 && i + 1 < argc) {
+			autosave = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc) {
+			renderScale = atoi(argv[++i]);
+			if (renderScale < 1) renderScale = 1;
+		} else if (strcmp(argv[i], "--half-blocks") == 0) {
+			halfBlocks = 1;
+		} else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+			seed = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--load") == 0 && i + 1 < argc) {
+			strncpy(levelName, argv[++i], 99);
+			level = fopen(levelName, "r");
+			if (level == NULL) {
+				printf("Could not open world: %s\n", levelName);
+				return 1;
+			}
+		} else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			frameLimit = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--raymarch") == 0) {
+			raymarcher.enabled = 1;
+		} else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			rayThreads = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--color") == 0 && i + 1 < argc) {
+			i++;
+			if (strcmp(argv[i], "256") == 0) output = OUTPUT_256;
+			else if (strcmp(argv[i], "truecolor") == 0) output = OUTPUT_TRUECOLOR;
+		} else {
+			printf("Usage: %s [--seed number | --load world.txt] [--headless [--frames count]] [--record journal] [--replay journal] [--timings file.csv] [--server socket | --connect socket] [--fps limit] [--autosave seconds] [--scale 1|2|4] [--half-blocks] [--color 256|truecolor] [--raymarch] [--threads count]\n", argv[0]);
+			printf("Sockets are a unix socket path or a TCP port on this machine\n");
+			return 1;
+		}
+	}
+	
+	// Clients get the world from the server instead of the menus
+	static int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE];
+	static NetPlayer others[MAX_CLIENTS];
+	unsigned char* netBuffer = NULL;
+	int netLength = 0;
+	if (connectAddress) {
+		netBuffer = malloc(NET_BUFFER);
+		connection = joinServer(connectAddress, blockPositions, &playerId, netBuffer, &netLength);
+		if (connection == -1) {
+			printf("Could not join server: %s\n", connectAddress);
+			free(netBuffer);
+			return 1;
+		}
+		server.active = 1;
+		server.socket = connection;
+		server.out = malloc(NET_BUFFER);
+		replayFile = NULL;
+		recordFile = NULL;
+	}
+	
+	// Replays use the world from the journal instead of the menus
+	if (connection != -1) {
+		headless = 0;
+	} else if (replayFile) {
+		if (!startReplay(replayFile, &seed, levelName)) {
+			printf("Could not read journal: %s\n", replayFile);
+			return 1;
+		}
+		if (seed == -1) level = fopen(levelName, "r");
+		if (seed == -1 && level == NULL) {
+			printf("Could not open world from journal: %s\n", levelName);
+			return 1;
+		}
+	} else if (seed == -1 && level == NULL) {
+		headless = 0;
+		mainMenu(&seed, &level, levelName);
+		launchTime = getTime();
+	}
+	// headless runs with nothing to replay stop on their own
+	if (headless && !replayFile && frameLimit == 0) frameLimit = 60;
+	
+	// The server owns the world and runs without a screen until it is stopped with ctrl+c
+	if (serverAddress) {
+		if (seed != -1) generateTerrain(blockPositions, seed);
+		else loadTerrain(blockPositions, level);
+		int listener = openServerSocket(serverAddress);
+		if (listener == -1) {
+			printf("Could not open server socket: %s\n", serverAddress);
+			return 1;
+		}
+		printf("Server running on %s\n", serverAddress);
+		signal(SIGINT, stopServer);
+		runServer(listener, blockPositions, 0, NULL);
+		close(listener);
+		if (serverAddress[strspn(serverAddress, "0123456789")] != '\0') unlink(serverAddress);
+		return 0;
+	}
+	if (recordFile) startRecording(recordFile, seed, levelName);
+	if (timingsFile) {
+		profiler.timings = fopen(timingsFile, "w");
+		if (profiler.timings == NULL) {
+			printf("Could not open %s\n", timingsFile);
+			return 1;
 		}
-		if (seed != -1) break;
-		if (level != NULL) break;
+		fprintf(profiler.timings, "frame");
+		for (int i = 0; i < NUM_STAGES; i++) fprintf(profiler.timings, ",%s_ms", stageNames[i]);
+		for (int i = 0; i < NUM_COUNTERS; i++) fprintf(profiler.timings, ",%s", counterNames[i]);
+		fprintf(profiler.timings, "\n");
 	}
-	// ^^Main Menu^^
 	
 	
 	// window / keyboard setup
 	// LINES and COLS are values for the screen size
-	initscr();
+	if (headless) {
+		openHeadlessScreen(50, 200);
+	} else {
+		profiler.terminalFd = STDOUT_FILENO;
+		initscr();
+		signal(SIGWINCH, resizeSignal);
+	}
 	keypad(stdscr, TRUE);
 	nodelay(stdscr, TRUE);
-	start_color();
-	init_pair(1, COLOR_BLACK, COLOR_CYAN);
-	bkgd(COLOR_PAIR(1));
-	init_pair(2, COLOR_BLACK, COLOR_GREEN);
-	init_pair(3, COLOR_YELLOW, COLOR_BLACK);
-	init_pair(4, COLOR_WHITE, COLOR_BLACK);
-	init_pair(5, COLOR_BLACK, COLOR_YELLOW);
-	init_pair(6, COLOR_MAGENTA, COLOR_BLACK);
-	init_pair(7, COLOR_BLACK, COLOR_RED);
-	init_pair(8, COLOR_RED, COLOR_YELLOW);
-	init_pair(9, COLOR_BLACK, COLOR_BLUE);
-	init_pair(10, COLOR_RED, COLOR_WHITE);
-	init_pair(13, COLOR_WHITE, COLOR_MAGENTA);
-	init_pair(14, COLOR_BLACK, COLOR_MAGENTA);
-	init_pair(15, COLOR_BLACK, COLOR_WHITE);
-	init_pair(16, COLOR_WHITE, COLOR_BLACK);
+	initColors();
+	setViewport(LINES, COLS, renderScale, halfBlocks);
 	refresh();
+	startAnsiOutput(profiler.terminalFd, output);
+	if (raymarcher.enabled || rayThreads > 0) startRaymarch(rayThreads);
+	
+	// stdin, the frame and autosave timers and the server socket are all waited on together
+	openEventLoop(headless ? -1 : STDIN_FILENO, connection, fps, connection == -1 ? autosave : 0);
+	
+	// Terrain mesh for each chunk
+	static ChunkMesh mesh[NUM_CHUNKS];
 	
-	// 3D vertex coordinates
-	int gameCoords[VERTICIES][3];
-	for (int i = 0; i < VERTICIES; i++) gameCoords[i][1] = -1;
+	// Screen vertex coordinates, the triangles to draw this frame stored as chunk * CHUNK_TRIANGLES + triangle
+	// and what to draw for each. they are rebuilt every frame in frameArena
+	float (*screenCoords)[CHUNK_VERTICIES][3] = NULL;
+	int* drawOrder = NULL;
+#ifdef FIXED_RASTER
+	FixedCommand* commands = NULL;
+#else
+	DrawCommand* commands = NULL;
+#endif
+	int numDraw = 0;
 	
-	// Screen vertex coordinates
-	double screenCoords[VERTICIES][3];
+	// Sand, gravel and water waiting to move and the light in every cell
+	static UpdateQueue updates;
+	static LightMap light;
 	
-	// Polygon list
-	int polygons[POLYGONS][4];
-	for (int i = 0; i < POLYGONS; i++) polygons[i][1] = -1;
-	int drawOrder[POLYGONS];
+	// Mobs and dropped items. they only exist when playing offline
+	static EntityStore entities;
 	
-	// Stores the type of block at position [x][y][z]
-	int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE];
-	int blockColors[][3] = {{2,-3,-3},{-3,-3,-3},{-4,-4,-4},{5,-3,5},{-2,-2,-2},{7,7,7},{-8,-8,-8},{8,8,8},{2,2,2},{1,1,1},{9,9,9},{14,14,14},{-10,-10,-10},{15,15,15},{-6,-6,-6},{-14,-14,-14},{3,3,3},{-13,-16,-16}};
+	// Undo history and unsaved changes of every block edited offline
+	static EditLog edits;
+	
+	// Occlusion culling: which chunk faces are connected by air and which chunks the player can see
+	int chunkConnections[CHUNKS][CHUNKS][CHUNKS][6];
+	int chunkVisible[CHUNKS][CHUNKS][CHUNKS];
+	int occlusionOn = 1;
+	int occluded = 0;
 	
 	// Player position
 	double playerPos[3] = {16,32,16};
@@ -185,12 +244,15 @@ int main() {
 	int blocksTouching[2][3] = {0};
 	int destroy = 0;
 	int blockType = 0;
+	int toggle = 0;
+	int edited = 0;
 	
 	// Frame system
 	struct timespec currentFrameTime, lastFrameTime;
 	clock_gettime(CLOCK_REALTIME, &lastFrameTime);
-	int frameLength[60];
-	double frameAverage;
+	int frameLength[60] = {0};
+	int frameIndex = 0;
+	double frameTotal = 0;
 	
 	// Menu variables
 	int menuX = 0;
@@ -199,216 +261,531 @@ int main() {
 	int isClicked = 0;
 	int running = 1;
 	
-	// Load world or generate new one from seed
-	if (seed != -1) {
-		generateTerrain(blockPositions, seed);
-	} else {
-		loadTerrain(blockPositions, level);
+	// Load world or generate new one from seed. it is built on its own thread while loading frames are drawn,
+	// except for replays, which have to start on the same frame every time, and clients, whose world came from the server
+	WorldLoad load = {.seed = seed, .level = level, .levelName = levelName, .online = connection != -1, .blockPositions = blockPositions, .mesh = mesh, .light = &light, .updates = &updates, .entities = &entities, .edits = &edits, .chunkConnections = chunkConnections};
+	pthread_t loader;
+	int worldReady = 0;
+	int worldFrames = 0;
+	double firstFrameTime = 0;
+	double firstWorldFrameTime = 0;
+	if (replayFile || connection != -1 || pthread_create(&loader, NULL, loadWorldThread, &load) != 0) {
+		loadWorld(&load);
+		worldReady = 1;
 	}
-	generatePolygons(blockPositions, polygons, gameCoords, blockColors);
 	
 	// GAME LOOP
 	while (running) {
 		
 		clock_gettime(CLOCK_REALTIME, &currentFrameTime);
-		for (int i = 1; i < 60; i++) {
-			frameLength[i-1] = frameLength[i];
-		}
-		frameLength[59] = currentFrameTime.tv_nsec - lastFrameTime.tv_nsec + (currentFrameTime.tv_sec - lastFrameTime.tv_sec)*1000000000;
+		// ring buffer of the last 60 frame lengths with a running total
+		frameTotal -= frameLength[frameIndex];
+		frameLength[frameIndex] = currentFrameTime.tv_nsec - lastFrameTime.tv_nsec + (currentFrameTime.tv_sec - lastFrameTime.tv_sec)*1000000000;
+		frameTotal += frameLength[frameIndex];
+		frameIndex = (frameIndex + 1) % 60;
 		deltaTime = ((double)(currentFrameTime.tv_nsec - lastFrameTime.tv_nsec + (currentFrameTime.tv_sec - lastFrameTime.tv_sec)*1000000000)) / 1000000000 * 60;
 		clock_gettime(CLOCK_REALTIME, &lastFrameTime);
 		
+		// replays step a fixed 1/60th of a second each frame so they always play out the same way
+		if (journal.mode == JOURNAL_REPLAY) {
+			deltaTime = 1;
+			if (!journalFrame()) break;
+		}
+		waitForFrame();
+		if (terminalResized) handleResize();
+		profileFrameStart();
+		arenaReset(&frameArena);
+		
+		// nothing touches the world until the loader is finished with it. keys pressed meanwhile wait in the action queue
+		if (!worldReady) {
+			if (__atomic_load_n(&load.done, __ATOMIC_ACQUIRE)) {
+				pthread_join(loader, NULL);
+				worldReady = 1;
+			} else {
+				drawLoading(frameIndex, getTime() - launchTime);
+				presentScreen();
+				if (firstFrameTime == 0) firstFrameTime = getTime();
+				profileFrameEnd();
+				if (events.frameTimer == -1) usleep(10000);
+				continue;
+			}
+		}
+		
 		if (menu == 0) {
-			getGameInputs(playerMove, playerRot, &menu, &grounded, &destroy, &blockType);
-			grounded = checkCollisions(playerPos, playerMove, blockPositions);
-			if (destroy != 0) {
-				editBlock(blockPositions, blocksTouching, blockType, destroy);
-				for (int i = 0; i < POLYGONS; i++) {
-					polygons[i][1] = -1;
+			PROFILE_BEGIN(STAGE_INPUT);
+			if (connection != -1) {
+				// online the keys go to the server, which moves the player and edits the world
+				if (clientInputs(&server, &menu, &toggle, &blockType) == -1) running = 0;
+			} else {
+				getGameInputs(playerMove, playerRot, &menu, &grounded, &destroy, &blockType, &toggle);
+			}
+			PROFILE_END(STAGE_INPUT);
+			
+			PROFILE_BEGIN(STAGE_PHYSICS);
+			if (connection != -1) {
+				if (events.socketReady && clientReceive(connection, netBuffer, &netLength, blockPositions, &updates, playerId, playerPos, playerRot, others, &edited) == -1) running = 0;
+				events.socketReady = 0;
+			} else {
+				grounded = checkCollisions(playerPos, playerMove, blockPositions);
+			}
+			PROFILE_END(STAGE_PHYSICS);
+			
+			// online the server runs the block updates and sends what they changed
+			PROFILE_BEGIN(STAGE_BLOCKS);
+			long lightWork = light.totalWork;
+			if (destroy != 0 && blocksTouching[1][0] != -1) {
+				int* cell = blocksTouching[destroy == 1 ? 1 : 0];
+				if (destroy == 1 && connection == -1) dropItem(&entities, blockPositions[cell[0]][cell[1]][cell[2]], cell[0], cell[1], cell[2]);
+				beginEdit(&edits);
+				setBlock(&edits, &updates, blockPositions, cell[0], cell[1], cell[2], destroy == 1 ? -1 : blockType);
+				endEdit(&edits);
+			}
+			if (connection == -1 && toggle != 0) editCommand(&edits, &updates, blockPositions, toggle, blocksTouching, blockType);
+			if (connection == -1) PROFILE_COUNT(COUNTER_UPDATES, advanceBlockUpdates(&updates, blockPositions, deltaTime));
+			PROFILE_COUNT(COUNTER_LIGHT, light.totalWork - lightWork);
+			PROFILE_END(STAGE_BLOCKS);
+			
+			PROFILE_BEGIN(STAGE_ENTITIES);
+			if (connection == -1) updateEntities(&entities, blockPositions, playerPos, deltaTime);
+			PROFILE_COUNT(COUNTER_ENTITIES, entities.count);
+			PROFILE_END(STAGE_ENTITIES);
+			
+			// only the chunks that changed are meshed again, unless the server sent a new world
+			PROFILE_BEGIN(STAGE_MESHING);
+			// the raymarcher reads the brickmap, so while it is on nothing is meshed and the mesh is rebuilt when it is turned off
+			if (edited) {
+				computeLight(&light, blockPositions);
+				if (!raymarcher.enabled) {
+					generatePolygons(blockPositions, mesh, blockColors, &light);
+					computeChunkConnections(blockPositions, chunkConnections);
+				} else {
+					buildBrickMap(blockPositions);
 				}
-				generatePolygons(blockPositions, polygons, gameCoords, blockColors);
+				edited = 0;
+			} else if (raymarcher.enabled) {
+				memset(updates.dirty, 0, sizeof(updates.dirty));
+				updates.numChanged = 0;
+			} else if (remeshDirty(&updates, blockPositions, mesh) > 0) {
+				computeChunkConnections(blockPositions, chunkConnections);
 			}
+			PROFILE_END(STAGE_MESHING);
 			
+			PROFILE_BEGIN(STAGE_PICKING);
 			playerTouching(playerPos, playerRot, blockPositions, blocksTouching);
+			PROFILE_END(STAGE_PICKING);
+			
+			// toggles for debugging features
+			switch (toggle) {
+				case 'o':
+				occlusionOn = !occlusionOn;
+				break;
+				
+				case 'p':
+				profiler.overlay = !profiler.overlay;
+				break;
+				
+				case 't':
+				if (profiler.trace) stopTrace();
+				else startTrace("trace.json");
+				break;
+				
+				case 'r':
+				cycleRenderScale();
+				break;
+				
+				case 'g':
+				raymarcher.enabled = !raymarcher.enabled;
+				if (!raymarcher.enabled) edited = 1;
+				break;
+			}
+			profiler.enabled = profiler.overlay || profiler.trace != NULL || profiler.timings != NULL;
+			
+			PROFILE_BEGIN(STAGE_CULL);
+			if (occlusionOn) {
+				cullOcclusion(playerPos, chunkConnections, chunkVisible);
+			} else {
+				for (int x = 0; x < CHUNKS; x++) for (int y = 0; y < CHUNKS; y++) for (int z = 0; z < CHUNKS; z++) chunkVisible[x][y][z] = 1;
+			}
+			PROFILE_END(STAGE_CULL);
+		}
 		
-			convertScreen(gameCoords, screenCoords, playerPos, playerRot);
-		
-			cullBack(polygons, screenCoords, drawOrder);
-			orderPoly(polygons, screenCoords, drawOrder);
+		// the draw list lives in the frame arena, so it is built again while paused too. the raymarcher doesn't need one
+		numDraw = 0;
+		if (!raymarcher.enabled) {
+			PROFILE_BEGIN(STAGE_TRANSFORM);
+			screenCoords = arenaAlloc(&frameArena, NUM_CHUNKS * sizeof(*screenCoords));
+			convertScreen(mesh, screenCoords, playerPos, playerRot, chunkVisible);
+			PROFILE_END(STAGE_TRANSFORM);
+			
+			PROFILE_BEGIN(STAGE_CULL);
+			drawOrder = arenaAlloc(&frameArena, countTriangles(mesh, chunkVisible) * sizeof(int));
+			numDraw = cullBack(mesh, screenCoords, drawOrder, chunkVisible, &occluded);
+			PROFILE_END(STAGE_CULL);
+			
+			PROFILE_BEGIN(STAGE_SORT);
+			commands = arenaAlloc(&frameArena, numDraw * sizeof(*commands));
+#ifdef FIXED_RASTER
+			orderPolyFixed(mesh, screenCoords, drawOrder, numDraw);
+			buildFixedCommands(mesh, screenCoords, drawOrder, numDraw, commands);
+#else
+			orderPoly(mesh, screenCoords, drawOrder, numDraw);
+			buildDrawCommands(mesh, screenCoords, drawOrder, numDraw, commands);
+#endif
+			PROFILE_END(STAGE_SORT);
 		}
 		if (menu == 1) {
 			isClicked = getMenuInputs(&menuX, &menuY, &menu);
 			if (isClicked && menuX == 2) running = 0;
-			if (isClicked && menuX == 1) saveWorld(blockPositions, level);
+			if (isClicked && menuX == 1) saveEdits(&edits, blockPositions, 1);
+		}
+		if (events.autosaveDue) {
+			saveEdits(&edits, blockPositions, 0);
+			events.autosaveDue = 0;
 		}
 		
+		PROFILE_BEGIN(STAGE_RASTER);
 		erase();
 		
-		drawAll(polygons, screenCoords, drawOrder, gameCoords);
+		if (raymarcher.enabled) {
+			PROFILE_COUNT(COUNTER_CELLS, drawRaymarch(blockPositions, &light, playerPos, playerRot));
+		} else {
+#ifdef FIXED_RASTER
+			PROFILE_COUNT(COUNTER_CELLS, drawAllFixed(commands, numDraw));
+#else
+			PROFILE_COUNT(COUNTER_CELLS, drawAll(commands, numDraw));
+#endif
+		}
+		if (connection != -1) drawPlayers(others, playerId, playerPos, playerRot);
+		else drawEntities(&entities, playerPos, playerRot, blockColors);
+		PROFILE_COUNT(COUNTER_TRIANGLES, numDraw);
+		PROFILE_COUNT(COUNTER_OCCLUDED, occluded);
 		drawInventory(blockColors, blockType);
 		
 		if (menu == 1) drawPaused(menuX, menuY);
 		
 		mvprintw(0, 0, "X,Y,Z: %.2lf, %.2lf, %.2lf", playerPos[0]/2, (playerPos[1]-5.2)/2+1, playerPos[2]/2);
 		mvprintw(1, 0, "Mouse: %d, %d, %d", blocksTouching[1][0], blocksTouching[1][1], blocksTouching[1][2]);
+		if (raymarcher.enabled) mvprintw(2, 0, "Raymarch: %d thread%s", raymarcher.threads, raymarcher.threads == 1 ? "" : "s");
+		else mvprintw(2, 0, "Triangles: %d Occluded: %d%s", numDraw, occluded, occlusionOn ? "" : " (off)");
+		if (edits.numCorners > 0) mvprintw(3, 0, "Region: %d, %d, %d", edits.corners[0][0], edits.corners[0][1], edits.corners[0][2]);
+		if (edits.numCorners == 2) printw(" to %d, %d, %d", edits.corners[1][0], edits.corners[1][1], edits.corners[1][2]);
 		
-		frameAverage = 0;
-		for (int i = 0; i < 60; i++) {
-			frameAverage += frameLength[i];
-		}
-		frameAverage /= 60;
-		if (frameAverage != 0) mvprintw(0,COLS-8,"%4d FPS",(int)(1000000000/((double)frameAverage)));
+		if (frameTotal != 0) mvprintw(0,COLS-8,"%4d FPS",(int)(1000000000/(frameTotal / 60)));
 		else mvprintw(0,COLS-8,"   0 FPS");
+		if (profiler.overlay) drawProfiler();
+		PROFILE_END(STAGE_RASTER);
 		
-		refresh();
+		PROFILE_BEGIN(STAGE_PRESENT);
+		presentScreen();
+		presentFrame();
+		PROFILE_END(STAGE_PRESENT);
+		profileFrameEnd();
+		
+		if (worldFrames++ == 0) {
+			firstWorldFrameTime = getTime();
+			if (firstFrameTime == 0) firstFrameTime = firstWorldFrameTime;
+		}
+		if (worldFrames == frameLimit) running = 0;
 	}
+	closeEventLoop();
+	stopRaymarch();
 	
+	if (profiler.trace) stopTrace();
 	endwin();
+	if (connection != -1) close(connection);
+	free(server.out);
+	if (replayFile) printf("Replay finished at X,Y,Z: %.3lf, %.3lf, %.3lf\n", playerPos[0]/2, (playerPos[1]-5.2)/2+1, playerPos[2]/2);
+	stopJournal();
+	if (profiler.timings) {
+		fclose(profiler.timings);
+		printProfileSummary();
+	}
+	if (headless || profiler.timings) {
+		printf("Startup: first frame %.1f ms, world ready %.1f ms, first world frame %.1f ms\n", (firstFrameTime - launchTime) * 1000,
+			((load.finishTime != 0 ? load.finishTime : firstWorldFrameTime) - launchTime) * 1000, (firstWorldFrameTime - launchTime) * 1000);
+	}
 	return 0;
 }
+#endif
 
 // ==================================================> FUNCTIONS <==================================================
 
-// Converts game coordinates into screen coordinates
-void convertScreen(int gameCoords[VERTICIES][3], double screenCoords[VERTICIES][3], double playerPos[3], double playerRot[3]) {
+// Converts game coordinates into screen coordinates for the chunks that can be seen
+void convertScreen(ChunkMesh mesh[NUM_CHUNKS], float screenCoords[NUM_CHUNKS][CHUNK_VERTICIES][3], double playerPos[3], double playerRot[3], int chunkVisible[CHUNKS][CHUNKS][CHUNKS]) {
 	
-	double tempScreenCoords[3];
-	double matrixConversions[5][6] = {
+	double point[3];
+	double matrixConversions[5][6];
+	int* visible = &chunkVisible[0][0][0];
+	cameraMatrix(playerPos, playerRot, matrixConversions);
+	
+	for (int c = 0; c < NUM_CHUNKS; c++) {
+		if (!visible[c]) continue;
+		
+		for (int i = 0; i < mesh[c].numVertices; i++) {
+			// vertices are stored in blocks from the chunk corner and blocks are 2 game units wide
+			for (int j = 0; j < 3; j++) {
+				point[j] = (mesh[c].origin[j] + mesh[c].vertices[i][j]) * 2;
+			}
+			transformPoint(matrixConversions, point);
+			screenCoords[c][i][0] = (float)point[0];
+			screenCoords[c][i][1] = (float)point[1];
+			screenCoords[c][i][2] = (float)point[2];
+		}
+	}
+		
+		return;
+}
+
+// Builds the matrices that move game coordinates in front of the player's camera
+void cameraMatrix(double playerPos[3], double playerRot[3], double matrixConversions[5][6]) {
+	double matrix[5][6] = {
 		{-playerPos[0], 0, -playerPos[1], 0,  -playerPos[2], 0},
 		{cos(playerRot[2] / 180.0 * M_PI), -sin(playerRot[2] / 180.0 * M_PI), sin(playerRot[2] / 180.0 * M_PI), cos(playerRot[2] / 180.0 * M_PI), 1, 0},
 		{cos(playerRot[1] / 180.0 * M_PI), sin(playerRot[1] / 180.0 * M_PI), 1, 0, -sin(playerRot[1] / 180.0 * M_PI), cos(playerRot[1] / 180.0 * M_PI)},
 		{1, 0, cos(playerRot[0] / 180.0 * M_PI), -sin(playerRot[0] / 180.0 * M_PI), sin(playerRot[0] / 180.0 * M_PI), cos(playerRot[0] / 180.0 * M_PI)},
 		{atan(M_PI/4), 0, atan(M_PI/1.2), 0, 0, 0}};
+	memcpy(matrixConversions, matrix, sizeof(matrix));
+}
+
+// Converts one point from game coordinates into screen coordinates
+void transformPoint(double matrixConversions[5][6], double point[3]) {
+	double tempScreenCoords[3];
 	
-	for (int i = 0; i < VERTICIES; i++) {
-		if (gameCoords[i][1] == -1) {
-			continue;
-		}
-		
-		for (int j = 0; j < 3; j++) {
-			screenCoords[i][j] = gameCoords[i][j];
-		}
-		
-		//First matrix - Translations
-		screenCoords[i][0] += matrixConversions[0][0];
-		screenCoords[i][1] += matrixConversions[0][2];
-		screenCoords[i][2] += matrixConversions[0][4];
-		
-		//Second matrix - Rotation Z-Axis
-		tempScreenCoords[0] = matrixConversions[1][0] * screenCoords[i][0] + matrixConversions[1][1] * screenCoords[i][1];
-		tempScreenCoords[1] = matrixConversions[1][2] * screenCoords[i][0] + matrixConversions[1][3] * screenCoords[i][1];
-		tempScreenCoords[2] = screenCoords[i][2];
-		
-		//Third matrix - Rotation Y-Axis
-		screenCoords[i][0] = matrixConversions[2][0] * tempScreenCoords[0] + matrixConversions[2][1] * tempScreenCoords[2];
-		screenCoords[i][1] = tempScreenCoords[1];
-		screenCoords[i][2] = matrixConversions[2][4] * tempScreenCoords[0] + matrixConversions[2][5] * tempScreenCoords[2];
-		
-		//Fourth matrix - Rotation X-Axis
-		tempScreenCoords[0] = screenCoords[i][0];
-		tempScreenCoords[1] = matrixConversions[3][2] * screenCoords[i][1] + matrixConversions[3][3] * screenCoords[i][2];
-		tempScreenCoords[2] = matrixConversions[3][4] * screenCoords[i][1] + matrixConversions[3][5] * screenCoords[i][2];
-		
-		//Fifth matrix - Scaling to screen
-		screenCoords[i][0] = matrixConversions[4][0] * tempScreenCoords[0];
-		screenCoords[i][1] = matrixConversions[4][2] * tempScreenCoords[1];
-		screenCoords[i][2] = tempScreenCoords[2];
-		
-		//Sixth matrix - Perspective
-		if (screenCoords[i][2] > 0.01) {
-			screenCoords[i][0] /= screenCoords[i][2];
-			screenCoords[i][1] /= screenCoords[i][2];
-		} else {
-			screenCoords[i][0] *= 100;
-			screenCoords[i][1] *= 100;
-		}
+	//First matrix - Translations
+	point[0] += matrixConversions[0][0];
+	point[1] += matrixConversions[0][2];
+	point[2] += matrixConversions[0][4];
+	
+	//Second matrix - Rotation Z-Axis
+	tempScreenCoords[0] = matrixConversions[1][0] * point[0] + matrixConversions[1][1] * point[1];
+	tempScreenCoords[1] = matrixConversions[1][2] * point[0] + matrixConversions[1][3] * point[1];
+	tempScreenCoords[2] = point[2];
+	
+	//Third matrix - Rotation Y-Axis
+	point[0] = matrixConversions[2][0] * tempScreenCoords[0] + matrixConversions[2][1] * tempScreenCoords[2];
+	point[1] = tempScreenCoords[1];
+	point[2] = matrixConversions[2][4] * tempScreenCoords[0] + matrixConversions[2][5] * tempScreenCoords[2];
+	
+	//Fourth matrix - Rotation X-Axis
+	tempScreenCoords[0] = point[0];
+	tempScreenCoords[1] = matrixConversions[3][2] * point[1] + matrixConversions[3][3] * point[2];
+	tempScreenCoords[2] = matrixConversions[3][4] * point[1] + matrixConversions[3][5] * point[2];
+	
+	//Fifth matrix - Scaling to screen
+	point[0] = matrixConversions[4][0] * tempScreenCoords[0];
+	point[1] = matrixConversions[4][2] * tempScreenCoords[1];
+	point[2] = tempScreenCoords[2];
+	
+	//Sixth matrix - Perspective
+	if (point[2] > 0.01) {
+		point[0] /= point[2];
+		point[1] /= point[2];
+	} else {
+		point[0] *= 100;
+		point[1] *= 100;
 	}
-		
-		return;
 }
 
-// Fills the interior of the polygon
-void fillPolygon(double polygon[3][3], int color, char draw) {
+// The character and color a face is drawn with
+chtype faceCell(int color, char draw, int light) {
+	// light picks a brighter or darker version of the face. filled faces darken with dots and characters dim
+	// escape sequence output shades the colors instead of changing the characters
+	int shade = light >= MAX_LIGHT ? A_BOLD : (light < 10 ? A_DIM : 0);
+	char fill = ' ';
+	if (viewport.output == OUTPUT_CURSES) {
+		fill = light < 5 ? ':' : (light < 10 ? '.' : ' ');
+		if (light < 5) draw = '.';
+	}
+	
+	// polygons with no characters on them are filled with spaces in their background color
+	return color > 0 ? (chtype)fill | COLOR_PAIR(color) : (chtype)draw | COLOR_PAIR(-color) | shade;
+}
+
+// Fills a triangle with the fill variant for it
+int fillPolygon(float polygon[3][3], int color, char draw, int light) {
+	FillJob job;
+	if (!setupFill(polygon, color, draw, light, &job)) return 0;
+	return fillVariants[job.depthTest][job.keepLight](&job);
+}
+
+// Works out which cells a triangle covers and the character and color it fills them with. returns 0 if it is behind the camera
+int setupFill(float polygon[3][3], int color, char draw, int light, FillJob* job) {
 	
 	//is polygon on screen
 	int isVisible = 0;
+	int width = viewport.width;
+	int height = viewport.height;
 	for (int i = 0; i < 3; i++) {
 		if (polygon[i][2] > 0) isVisible = 1;
 	}
 	
-	if (!isVisible) return;
+	if (!isVisible) return 0;
 	
 	//finding min and max x/y coords
-	double minX = polygon[0][0] * (COLS / 2);
-	double maxX = polygon[0][0] * (COLS / 2);
-	double minY = polygon[0][1] * (LINES / 2);
-	double maxY = polygon[0][1] * (LINES / 2);
+	double minX = polygon[0][0] * (width / 2);
+	double maxX = polygon[0][0] * (width / 2);
+	double minY = polygon[0][1] * (height / 2);
+	double maxY = polygon[0][1] * (height / 2);
 	for (int i = 1; i < 3; i++) {
-		if (minX > polygon[i][0] * (COLS / 2)) minX = polygon[i][0] * (COLS / 2);
-		else if (maxX < polygon[i][0] * (COLS / 2)) maxX = polygon[i][0] * (COLS / 2);
-		if (minY > polygon[i][1] * (LINES / 2)) minY = polygon[i][1] * (LINES / 2);
-		else if (maxY < polygon[i][1] * (LINES / 2)) maxY = polygon[i][1] * (LINES / 2);
+		if (minX > polygon[i][0] * (width / 2)) minX = polygon[i][0] * (width / 2);
+		else if (maxX < polygon[i][0] * (width / 2)) maxX = polygon[i][0] * (width / 2);
+		if (minY > polygon[i][1] * (height / 2)) minY = polygon[i][1] * (height / 2);
+		else if (maxY < polygon[i][1] * (height / 2)) maxY = polygon[i][1] * (height / 2);
 	}
-	if (maxY > LINES / 2 - 1) maxY = LINES / 2 - 1;
-	if (minY < -LINES / 2) minY = -LINES / 2;
-	if (maxX > COLS / 2) maxX = COLS / 2;
-	if (minX < -COLS / 2 + 1) minX = -COLS / 2 + 1;
+	if (maxY > height / 2 - 1) maxY = height / 2 - 1;
+	if (minY < -height / 2) minY = -height / 2;
+	if (maxX > width / 2) maxX = width / 2;
+	if (minX < -width / 2 + 1) minX = -width / 2 + 1;
 	
 	//checking positions for being inside the triangle
-	double poly[3][2];
+	double (*poly)[2] = job->poly;
 	for (int i = 0; i < 3; i++) {
-		poly[i][0] = polygon[i][0] * (COLS / 2);
-		poly[i][1] = polygon[i][1] * (LINES / 2);
-	}
-	
-	// if the polygon has no characters on it
-	if (color > 0) {
-		attron(COLOR_PAIR(color));
-		for (int i = (int)minX; i <= (int)maxX; i++) {
-			for (int j = (int)minY; j <= (int)maxY; j++) {
-				if (isInside(poly, i, j) == 1) {
-					move(-j + LINES / 2 - 1, i + COLS / 2 - 1);
-					addch(' ');
+		poly[i][0] = polygon[i][0] * (width / 2);
+		poly[i][1] = polygon[i][1] * (height / 2);
+	}
+	
+	chtype cell = faceCell(color, draw, light);
+	
+	// 1/z changes evenly across the screen so it is blended between the corners for the depth test.
+	// polygons reaching behind the camera are left to the draw order instead
+	double area = (poly[1][0] - poly[0][0]) * (poly[2][1] - poly[0][1]) - (poly[1][1] - poly[0][1]) * (poly[2][0] - poly[0][0]);
+	int depthTest = polygon[0][2] > 0.01 && polygon[1][2] > 0.01 && polygon[2][2] > 0.01 && area != 0;
+	
+	job->polygon = polygon;
+	job->area = area;
+	job->left = (int)minX;
+	job->right = (int)maxX;
+	job->bottom = (int)minY;
+	job->top = (int)maxY;
+	job->cell = cell;
+	job->light = light;
+	job->depthTest = depthTest;
+	// only escape sequence output reads the light of each cell
+	job->keepLight = viewport.output != OUTPUT_CURSES;
+	return 1;
+}
+
+// The inner loop of fillPolygon. it is always inlined, so each fillVariant below gets its own copy with the depth test and
+// the light buffer compiled in or out instead of checked for every cell
+static inline __attribute__((always_inline)) int fillSpan(FillJob* job, int depthTest, int keepLight) {
+	double (*poly)[2] = job->poly;
+	float (*polygon)[3] = job->polygon;
+	double area = job->area;
+	chtype cell = job->cell;
+	int light = job->light;
+	int width = viewport.width;
+	int height = viewport.height;
+	int filled = 0;
+	// under drawAllFixed the fixed point triangles test 1/z keys, so the depths written here are given to them as keys too
+	unsigned int* keys = viewport.keyedDepth ? viewport.depthKey : NULL;
+	// the same sums as isInside, with the parts that only depend on the triangle worked out once
+	double whole = fabs((poly[0][0] * (poly[1][1] - poly[2][1]) + poly[1][0] * (poly[2][1] - poly[0][1]) + poly[2][0] * (poly[0][1] - poly[1][1]))/2.0);
+	
+	for (int j = job->bottom; j <= job->top; j++) {
+		int index = (-j + height / 2 - 1) * width + job->left + width / 2 - 1;
+		for (int i = job->left; i <= job->right; i++, index++) {
+			double a1 = fabs((i * (poly[1][1] - poly[2][1]) + poly[1][0] * (poly[2][1] - j) + poly[2][0] * (j - poly[1][1]))/2.0);
+			double a2 = fabs((poly[0][0] * (j - poly[2][1]) + i * (poly[2][1] - poly[0][1]) + poly[2][0] * (poly[0][1] - j))/2.0);
+			double a3 = fabs((poly[0][0] * (poly[1][1] - j) + poly[1][0] * (j - poly[0][1]) + i * (poly[0][1] - poly[1][1]))/2.0);
+			if (whole - (a1 + a2 + a3) < -INSIDE_EPSILON) continue;
+			if (depthTest) {
+				double w1 = ((i - poly[0][0]) * (poly[2][1] - poly[0][1]) - (j - poly[0][1]) * (poly[2][0] - poly[0][0])) / area;
+				double w2 = ((poly[1][0] - poly[0][0]) * (j - poly[0][1]) - (poly[1][1] - poly[0][1]) * (i - poly[0][0])) / area;
+				double inverse = (1 - w1 - w2) / polygon[0][2] + w1 / polygon[1][2] + w2 / polygon[2][2];
+				if (inverse > 0) {
+					float depth = 1 / inverse;
+					if (depth > viewport.depth[index] * 1.001f) continue;
+					viewport.depth[index] = depth;
+					if (keys) keys[index] = depthToKey(depth);
 				}
 			}
+			viewport.frame[index] = cell;
+			if (keepLight) viewport.light[index] = light;
+			filled++;
 		}
-		attroff(COLOR_PAIR(color));
-		
-	// if the polygon should have characters
-	} else {
-		attron(COLOR_PAIR(-color));
-		for (int i = (int)minX; i <= (int)maxX; i++) {
-			for (int j = (int)minY; j <= (int)maxY; j++) {
-				if (isInside(poly, i, j) == 1) {
-					move(-j + LINES / 2 - 1, i + COLS / 2 - 1);
-					addch(draw);
+	}
+	return filled;
+}
+
+int fillFlat(FillJob* job) {
+	return fillSpan(job, 0, 0);
+}
+
+int fillFlatLit(FillJob* job) {
+	return fillSpan(job, 0, 1);
+}
+
+int fillDepth(FillJob* job) {
+	return fillSpan(job, 1, 0);
+}
+
+int fillDepthLit(FillJob* job) {
+	return fillSpan(job, 1, 1);
+}
+
+// One loop for every kind of triangle that checks the depth test and light buffer per cell, kept to measure the variants against
+__attribute__((noinline)) int fillGeneric(FillJob* job) {
+	double (*poly)[2] = job->poly;
+	float (*polygon)[3] = job->polygon;
+	double area = job->area;
+	int width = viewport.width;
+	int height = viewport.height;
+	int filled = 0;
+	for (int i = job->left; i <= job->right; i++) {
+		for (int j = job->bottom; j <= job->top; j++) {
+			if (isInside(poly, i, j) == 1) {
+				int index = (-j + height / 2 - 1) * width + i + width / 2 - 1;
+				if (job->depthTest) {
+					double w1 = ((i - poly[0][0]) * (poly[2][1] - poly[0][1]) - (j - poly[0][1]) * (poly[2][0] - poly[0][0])) / area;
+					double w2 = ((poly[1][0] - poly[0][0]) * (j - poly[0][1]) - (poly[1][1] - poly[0][1]) * (i - poly[0][0])) / area;
+					double inverse = (1 - w1 - w2) / polygon[0][2] + w1 / polygon[1][2] + w2 / polygon[2][2];
+					if (inverse > 0) {
+						float depth = 1 / inverse;
+						if (depth > viewport.depth[index] * 1.001f) continue;
+						viewport.depth[index] = depth;
+						if (viewport.keyedDepth) viewport.depthKey[index] = depthToKey(depth);
+					}
 				}
+				viewport.frame[index] = job->cell;
+				if (job->keepLight) viewport.light[index] = job->light;
+				filled++;
 			}
 		}
-		attroff(COLOR_PAIR(-color));
 	}
-	return;
+	return filled;
 }
 
 // Returns if point x y is inside the triangle
 int isInside(double poly[3][2], int pointX, int pointY) {
 	// Calculate area of the triangle
-	double area = abs((poly[0][0] * (poly[1][1] - poly[2][1]) + poly[1][0] * (poly[2][1] - poly[0][1]) + poly[2][0] * (poly[0][1] - poly[1][1]))/2.0);
+	double area = fabs((poly[0][0] * (poly[1][1] - poly[2][1]) + poly[1][0] * (poly[2][1] - poly[0][1]) + poly[2][0] * (poly[0][1] - poly[1][1]))/2.0);
 	// Calculate areas of three triangles using the point that we are checking for
-	double a1 = abs((pointX * (poly[1][1] - poly[2][1]) + poly[1][0] * (poly[2][1] - pointY) + poly[2][0] * (pointY - poly[1][1]))/2.0);
-	double a2 = abs((poly[0][0] * (pointY - poly[2][1]) + pointX * (poly[2][1] - poly[0][1]) + poly[2][0] * (poly[0][1] - pointY))/2.0);
-	double a3 = abs((poly[0][0] * (poly[1][1] - pointY) + poly[1][0] * (pointY - poly[0][1]) + pointX * (poly[0][1] - poly[1][1]))/2.0);
+	double a1 = fabs((pointX * (poly[1][1] - poly[2][1]) + poly[1][0] * (poly[2][1] - pointY) + poly[2][0] * (pointY - poly[1][1]))/2.0);
+	double a2 = fabs((poly[0][0] * (pointY - poly[2][1]) + pointX * (poly[2][1] - poly[0][1]) + poly[2][0] * (poly[0][1] - pointY))/2.0);
+	double a3 = fabs((poly[0][0] * (poly[1][1] - pointY) + poly[1][0] * (pointY - poly[0][1]) + pointX * (poly[0][1] - poly[1][1]))/2.0);
 	
 	// compare the area of the whole triangle to the area of the three triangle parts
-	if (area - (a1 + a2 + a3) >= 0) return 1;
+	if (area - (a1 + a2 + a3) >= -INSIDE_EPSILON) return 1;
 	
 	return 0;
 }
 
 // Gets input from player while in the game
-void getGameInputs(double playerMove[], double playerRot[], int* menu, int* grounded, int* destroy, int* blockType) {
-	int ch = getch();
+void getGameInputs(double playerMove[], double playerRot[], int* menu, int* grounded, int* destroy, int* blockType, int* toggle) {
+	int ch;
+	*destroy = 0;
+	*toggle = 0;
+	
+	// every queued key is used this frame, but keys after an edit, a toggle or the pause menu wait for the next one
+	while (*destroy == 0 && *toggle == 0 && *menu == 0 && (ch = nextAction()) != ERR) {
+		handleGameKey(ch, playerMove, playerRot, menu, grounded, destroy, blockType, toggle);
+	}
+}
+
+// Changes the player's movement, camera or held block for one key press. the server uses this for every connected player
+void handleGameKey(int ch, double playerMove[], double playerRot[], int* menu, int* grounded, int* destroy, int* blockType, int* toggle) {
 	*destroy = 0;
+	*toggle = 0;
 	
 	// Checks which key the player is pressing and then changes some values based on what the key should do
 	switch (ch) {
@@ -460,6 +837,21 @@ void getGameInputs(double playerMove[], double playerRot[], int* menu, int* grou
 		*destroy = 1;
 		break;
 		
+		case 'o':
+		case 'p':
+		case 'r':
+		case 't':
+		case 'c':
+		case 'f':
+		case 'h':
+		case 'y':
+		case 'v':
+		case 'u':
+		case 'i':
+		case 'g':
+		*toggle = ch;
+		break;
+		
 		case 'q':
 		if (*blockType > 0)
 		*blockType -= 1;
@@ -484,7 +876,7 @@ void getGameInputs(double playerMove[], double playerRot[], int* menu, int* grou
 
 // Gets input from player while in the menus
 int getMenuInputs(int* menuX, int* menuY, int* menu) {
-	int ch = getch();
+	int ch = nextAction();
 	
 	// Does the same thing as game inputs just with the menu
 	switch (ch) {
@@ -583,6 +975,7 @@ void generateTerrain(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int
 	}
 	blockPositions[0][0][0] = 3;
 	blockPositions[1][0][0] = 4;
+	buildHeightMap(blockPositions);
 }
 
 // Loads terrain from a file character by character converting them to numbers
@@ -594,6 +987,7 @@ void loadTerrain(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], FILE* l
 			}
 		}
 	}
+	buildHeightMap(blockPositions);
 }
 
 // Saves the current world to a text file block by block converting them to characters
@@ -606,149 +1000,357 @@ void saveWorld(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], FILE* lev
 			}
 		}
 	}
+	fclose(level);
 }
 
-// Assigns the terrain mesh to a group of polygons
-void generatePolygons(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int polygons[POLYGONS][4], int gameCoords[VERTICIES][3], int blockColors[][3]) {
-	for (int x = 0; x < WORLD_SIZE; x++) {
-		for (int y = 0; y < WORLD_SIZE; y++) {
-			for (int z = 0; z < WORLD_SIZE; z++) {
-				if (blockPositions[x][y][z] > -1) {
-					// Generating polygons on the left side of blocks
-					if (x == 0 || blockPositions[x-1][y][z]  == -1) {
-						addPoly(addVertex(2*x, 2*y, 2*z, gameCoords), addVertex(2*x, 2*y+2, 2*z+2, gameCoords), addVertex(2*x, 2*y+2, 2*z, gameCoords), blockColors[blockPositions[x][y][z]][1], polygons);
-						addPoly(addVertex(2*x, 2*y, 2*z, gameCoords), addVertex(2*x, 2*y, 2*z+2, gameCoords), addVertex(2*x, 2*y+2, 2*z+2, gameCoords), blockColors[blockPositions[x][y][z]][1], polygons);
-					}
-					// Generating polygons on the right side of blocks
-					if (x == 15 || blockPositions[x+1][y][z]  == -1) {
-						addPoly(addVertex(2*x+2, 2*y, 2*z, gameCoords), addVertex(2*x+2, 2*y+2, 2*z, gameCoords), addVertex(2*x+2, 2*y+2, 2*z+2, gameCoords), blockColors[blockPositions[x][y][z]][1], polygons);
-						addPoly(addVertex(2*x+2, 2*y, 2*z, gameCoords), addVertex(2*x+2, 2*y+2, 2*z+2, gameCoords), addVertex(2*x+2, 2*y, 2*z+2, gameCoords), blockColors[blockPositions[x][y][z]][1], polygons);
-					}
-					// Generating polygons on the bottom side of blocks
-					if (y == 0 || blockPositions[x][y-1][z]  == -1) {
-						addPoly(addVertex(2*x, 2*y, 2*z, gameCoords), addVertex(2*x+2, 2*y, 2*z+2, gameCoords), addVertex(2*x, 2*y, 2*z+2, gameCoords), blockColors[blockPositions[x][y][z]][2], polygons);
-						addPoly(addVertex(2*x, 2*y, 2*z, gameCoords), addVertex(2*x+2, 2*y, 2*z, gameCoords), addVertex(2*x+2, 2*y, 2*z+2, gameCoords), blockColors[blockPositions[x][y][z]][2], polygons);
-					}
-					// Generating polygons on the top side of blocks
-					if (y == 15 || blockPositions[x][y+1][z]  == -1) {
-						addPoly(addVertex(2*x, 2*y+2, 2*z, gameCoords), addVertex(2*x, 2*y+2, 2*z+2, gameCoords), addVertex(2*x+2, 2*y+2, 2*z+2, gameCoords), blockColors[blockPositions[x][y][z]][0], polygons);
-						addPoly(addVertex(2*x, 2*y+2, 2*z, gameCoords), addVertex(2*x+2, 2*y+2, 2*z+2, gameCoords), addVertex(2*x+2, 2*y+2, 2*z, gameCoords), blockColors[blockPositions[x][y][z]][0], polygons);
-					}
-					// Generating polygons on the front side of blocks
-					if (z == 0 || blockPositions[x][y][z-1]  == -1) {
-						addPoly(addVertex(2*x, 2*y, 2*z, gameCoords), addVertex(2*x, 2*y+2, 2*z, gameCoords), addVertex(2*x+2, 2*y+2, 2*z, gameCoords), blockColors[blockPositions[x][y][z]][1], polygons);
-						addPoly(addVertex(2*x, 2*y, 2*z, gameCoords), addVertex(2*x+2, 2*y+2, 2*z, gameCoords), addVertex(2*x+2, 2*y, 2*z, gameCoords), blockColors[blockPositions[x][y][z]][1], polygons);
-					}
-					// Generating polygons on the back side of blocks
-					if (z == 15 || blockPositions[x][y][z+1]  == -1) {
-						addPoly(addVertex(2*x, 2*y, 2*z+2, gameCoords), addVertex(2*x+2, 2*y+2, 2*z+2, gameCoords), addVertex(2*x, 2*y+2, 2*z+2, gameCoords), blockColors[blockPositions[x][y][z]][1], polygons);
-						addPoly(addVertex(2*x, 2*y, 2*z+2, gameCoords), addVertex(2*x+2, 2*y, 2*z+2, gameCoords), addVertex(2*x+2, 2*y+2, 2*z+2, gameCoords), blockColors[blockPositions[x][y][z]][1], polygons);
-					}
-				}
+// Assigns the terrain mesh of every chunk
+void generatePolygons(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], ChunkMesh mesh[NUM_CHUNKS], int blockColors[][3], LightMap* light) {
+	buildBrickMap(blockPositions);
+	for (int x = 0; x < CHUNKS; x++) {
+		for (int y = 0; y < CHUNKS; y++) {
+			for (int z = 0; z < CHUNKS; z++) {
+				generateChunkMesh(blockPositions, &mesh[(x * CHUNKS + y) * CHUNKS + z], x, y, z, blockColors, light);
 			}
 		}
 	}
 }
 
-// Adds a vertex to the vertex list and returns the position of that vertex in the list
-int addVertex(int x, int y, int z, int vertexList[VERTICIES][3]) {
-	// checks if a vertex is in the list already
-	for (int i = 0; i < VERTICIES; i++) {
-		if (vertexList[i][0] == x && vertexList[i][1] == y && vertexList[i][2] == z) return i;
+// Builds the mesh of one chunk from the faces of its blocks that touch air
+void generateChunkMesh(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], ChunkMesh* chunk, int chunkX, int chunkY, int chunkZ, int blockColors[][3], LightMap* light) {
+	// where each block corner is in the vertex buffer so shared corners are only stored once
+	short vertexLookup[CHUNK_SIZE+1][CHUNK_SIZE+1][CHUNK_SIZE+1];
+	memset(vertexLookup, -1, sizeof(vertexLookup));
+	
+	chunk->origin[0] = chunkX * CHUNK_SIZE;
+	chunk->origin[1] = chunkY * CHUNK_SIZE;
+	chunk->origin[2] = chunkZ * CHUNK_SIZE;
+	chunk->numVertices = 0;
+	chunk->numFaces = 0;
+	
+	// the cells of each side whose neighbour is air: a shift lines every cell up with its neighbour inside the chunk's brick,
+	// and the touching layer of the next brick fills in the side along the border. past the edge of the world is air
+	BrickMap* bricks = brickMapFor(blockPositions);
+	int brick = (chunkX * CHUNKS + chunkY) * CHUNKS + chunkZ;
+	unsigned long long filled = bricks->cells[brick];
+	if (filled == 0) return;
+	unsigned long long exposed[6];
+	unsigned long long next = chunkX > 0 ? bricks->cells[brick - BRICKS * BRICKS] : 0;
+	exposed[0] = filled & ~(filled << 16 | next >> 48);
+	next = chunkX < BRICKS - 1 ? bricks->cells[brick + BRICKS * BRICKS] : 0;
+	exposed[1] = filled & ~(filled >> 16 | next << 48);
+	next = chunkY > 0 ? bricks->cells[brick - BRICKS] : 0;
+	exposed[2] = filled & ~((filled << 4 & ~BRICK_Y0) | (next & BRICK_Y3) >> 12);
+	next = chunkY < BRICKS - 1 ? bricks->cells[brick + BRICKS] : 0;
+	exposed[3] = filled & ~((filled >> 4 & ~BRICK_Y3) | (next & BRICK_Y0) << 12);
+	next = chunkZ > 0 ? bricks->cells[brick - 1] : 0;
+	exposed[4] = filled & ~((filled << 1 & ~BRICK_Z0) | (next & BRICK_Z3) >> 3);
+	next = chunkZ < BRICKS - 1 ? bricks->cells[brick + 1] : 0;
+	exposed[5] = filled & ~((filled >> 1 & ~BRICK_Z3) | (next & BRICK_Z0) << 3);
+	
+	// bits go up in the same x, y, z order the blocks were visited in, so the faces come out in the same order
+	for (unsigned long long left = filled; left; left &= left - 1) {
+		int bit = __builtin_ctzll(left);
+		int x = bit / (CHUNK_SIZE * CHUNK_SIZE);
+		int y = bit / CHUNK_SIZE % CHUNK_SIZE;
+		int z = bit % CHUNK_SIZE;
+		int bx = chunk->origin[0] + x;
+		int by = chunk->origin[1] + y;
+		int bz = chunk->origin[2] + z;
+		int block = blockPositions[bx][by][bz];
+		// Generating polygons on the left side of blocks
+		if (exposed[0] >> bit & 1) addFace(x, y, z, 0, blockColors[block][1], faceLight(light, bx-1, by, bz), chunk, vertexLookup);
+		// Generating polygons on the right side of blocks
+		if (exposed[1] >> bit & 1) addFace(x, y, z, 1, blockColors[block][1], faceLight(light, bx+1, by, bz), chunk, vertexLookup);
+		// Generating polygons on the bottom side of blocks
+		if (exposed[2] >> bit & 1) addFace(x, y, z, 2, blockColors[block][2], faceLight(light, bx, by-1, bz), chunk, vertexLookup);
+		// Generating polygons on the top side of blocks
+		if (exposed[3] >> bit & 1) addFace(x, y, z, 3, blockColors[block][0], faceLight(light, bx, by+1, bz), chunk, vertexLookup);
+		// Generating polygons on the front side of blocks
+		if (exposed[4] >> bit & 1) addFace(x, y, z, 4, blockColors[block][1], faceLight(light, bx, by, bz-1), chunk, vertexLookup);
+		// Generating polygons on the back side of blocks
+		if (exposed[5] >> bit & 1) addFace(x, y, z, 5, blockColors[block][1], faceLight(light, bx, by, bz+1), chunk, vertexLookup);
 	}
+}
+
+// Adds a vertex to the chunk's vertex buffer if it isn't already in it and returns the position of that vertex in the buffer
+int addVertex(int x, int y, int z, ChunkMesh* chunk, short vertexLookup[CHUNK_SIZE+1][CHUNK_SIZE+1][CHUNK_SIZE+1]) {
+	if (vertexLookup[x][y][z] != -1) return vertexLookup[x][y][z];
 	
-	// if not find the first open position in the list and fill it with the coordinates
-	for (int i = 0; i < VERTICIES; i++) {
-		if (vertexList[i][1] == -1) {
-			vertexList[i][0] = x;
-			vertexList[i][1] = y;
-			vertexList[i][2] = z;
-			return i;
-		}
+	// the buffer grows as needed and is kept between meshes so it only reallocates while the world gets more detailed
+	if (chunk->numVertices == chunk->vertexCapacity) {
+		int capacity = chunk->vertexCapacity ? chunk->vertexCapacity * 2 : 16;
+		if (capacity > CHUNK_VERTICIES) capacity = CHUNK_VERTICIES;
+		chunk->vertices = realloc(chunk->vertices, capacity * sizeof(chunk->vertices[0]));
+		chunk->vertexCapacity = capacity;
 	}
-	return -1;
+	
+	chunk->vertices[chunk->numVertices][0] = x;
+	chunk->vertices[chunk->numVertices][1] = y;
+	chunk->vertices[chunk->numVertices][2] = z;
+	vertexLookup[x][y][z] = chunk->numVertices;
+	return chunk->numVertices++;
 }
 
-// Adds a polygon to the list
-void addPoly(int vert1, int vert2, int vert3, int color, int polyList[POLYGONS][4]) {
-	// checks if the polygon already exists in the array
-	for (int i = 0; i < POLYGONS; i++) {
-		if (polyList[i][0] == vert1 && polyList[i][1] == vert2 && polyList[i][2] == vert3) return;
+// Adds the face of block x y z facing the direction (-x, +x, -y, +y, -z, +z) to the chunk as two triangles
+void addFace(int x, int y, int z, int direction, int color, int light, ChunkMesh* chunk, short vertexLookup[CHUNK_SIZE+1][CHUNK_SIZE+1][CHUNK_SIZE+1]) {
+	// corners of each face in the order they are split into triangles, wound so the face points out of the block
+	static const int faceCorners[6][4][3] = {
+		{{0,0,0},{0,0,1},{0,1,1},{0,1,0}},
+		{{1,0,0},{1,1,0},{1,1,1},{1,0,1}},
+		{{0,0,0},{1,0,0},{1,0,1},{0,0,1}},
+		{{0,1,0},{0,1,1},{1,1,1},{1,1,0}},
+		{{0,0,0},{0,1,0},{1,1,0},{1,0,0}},
+		{{0,0,1},{1,0,1},{1,1,1},{0,1,1}}
+	};
+	int corners[4];
+	
+	if (chunk->numFaces == chunk->faceCapacity) {
+		int capacity = chunk->faceCapacity ? chunk->faceCapacity * 2 : 16;
+		if (capacity > CHUNK_FACES) capacity = CHUNK_FACES;
+		chunk->triangles = realloc(chunk->triangles, capacity * 2 * sizeof(chunk->triangles[0]));
+		chunk->faces = realloc(chunk->faces, capacity * sizeof(chunk->faces[0]));
+		chunk->faceCapacity = capacity;
 	}
 	
-	// if not add it in the first open space
-	for (int i = 0; i < POLYGONS; i++) {
-		if (polyList[i][1] == -1) {
-			polyList[i][0] = vert1;
-			polyList[i][1] = vert2;
-			polyList[i][2] = vert3;
-			polyList[i][3] = color;
-			return;
-		}
+	for (int i = 0; i < 4; i++) {
+		corners[i] = addVertex(x + faceCorners[direction][i][0], y + faceCorners[direction][i][1], z + faceCorners[direction][i][2], chunk, vertexLookup);
 	}
+	
+	int face = chunk->numFaces++;
+	chunk->triangles[face*2][0] = corners[0];
+	chunk->triangles[face*2][1] = corners[1];
+	chunk->triangles[face*2][2] = corners[2];
+	chunk->triangles[face*2+1][0] = corners[0];
+	chunk->triangles[face*2+1][1] = corners[2];
+	chunk->triangles[face*2+1][2] = corners[3];
+	
+	// faces along the x axis are drawn with @, along y with # and along z with $. positive colors are filled with spaces
+	chunk->faces[face].color = color;
+	chunk->faces[face].direction = direction;
+	chunk->faces[face].glyph = color > 0 ? ' ' : "@@##$$"[direction];
+	chunk->faces[face].light = light;
 }
 
-// Draws all of the polygons to the screen
-void drawAll(int allPolygons[POLYGONS][4], double screenCoords[VERTICIES][3], int drawOrder[POLYGONS], int gameCoords[VERTICIES][3]) {
-	double polygon[3][3];
-	int num = 0;
-	for (int i = 0; i < POLYGONS; i++) {
-		if (drawOrder[i] == -1) break;
-		if (allPolygons[drawOrder[i]][1] != -1) {
-			// use polygon
-			for (int j = 0; j < 3; j++) {
-				for (int k = 0; k < 3; k++) {
-					polygon[j][k] = screenCoords[allPolygons[drawOrder[i]][j]][k];
-				}
-			}
-			// detect polygon facing and change the text type
-			if (gameCoords[allPolygons[drawOrder[i]][0]][0] == gameCoords[allPolygons[drawOrder[i]][1]][0] && gameCoords[allPolygons[drawOrder[i]][1]][0] == gameCoords[allPolygons[drawOrder[i]][2]][0]) {
-				fillPolygon(polygon, allPolygons[drawOrder[i]][3], '@');
-				num++;
-			} else if (gameCoords[allPolygons[drawOrder[i]][0]][1] == gameCoords[allPolygons[drawOrder[i]][1]][1] && gameCoords[allPolygons[drawOrder[i]][1]][1] == gameCoords[allPolygons[drawOrder[i]][2]][1]) {
-				fillPolygon(polygon, allPolygons[drawOrder[i]][3], '#');
-				num++;
-			} else {
-				fillPolygon(polygon, allPolygons[drawOrder[i]][3], '$');
-				num++;
-			}
-		}
+// Returns how many bytes the mesh buffers are using
+long meshBytes(ChunkMesh mesh[NUM_CHUNKS]) {
+	long bytes = NUM_CHUNKS * sizeof(ChunkMesh);
+	for (int c = 0; c < NUM_CHUNKS; c++) {
+		bytes += mesh[c].vertexCapacity * sizeof(mesh[c].vertices[0]);
+		bytes += mesh[c].faceCapacity * (2 * sizeof(mesh[c].triangles[0]) + sizeof(mesh[c].faces[0]));
 	}
+	return bytes;
+}
+
+// Draws all of the polygons to the screen. returns the number of characters drawn
+int drawAll(DrawCommand commands[MAX_TRIANGLES], int numDraw) {
+	int filled = 0;
+	clearViewport();
+	for (int i = 0; i < numDraw; i++) {
+		filled += fillPolygon(commands[i].points, commands[i].color, commands[i].glyph, commands[i].light);
+	}
+	presentViewport();
 	attron(COLOR_PAIR(15));
 	move(LINES / 2, COLS / 2);
 	addch('+');
 	attroff(COLOR_PAIR(15));
+	return filled;
 }
 
-// Removes polygons that are facing away from the screen
-void cullBack(int polygons[POLYGONS][4], double screenCoords[VERTICIES][3], int drawOrder[POLYGONS]) {
-	for (int i = 0; i < POLYGONS; i++) {
-		drawOrder[i] = -1;
+// Copies the screen coordinates and style of each triangle into a flat list in the order they will be drawn
+void buildDrawCommands(ChunkMesh mesh[NUM_CHUNKS], float screenCoords[NUM_CHUNKS][CHUNK_VERTICIES][3], int drawOrder[MAX_TRIANGLES], int numDraw, DrawCommand commands[MAX_TRIANGLES]) {
+	for (int i = 0; i < numDraw; i++) {
+		int c = drawOrder[i] / CHUNK_TRIANGLES;
+		int t = drawOrder[i] % CHUNK_TRIANGLES;
+		FaceStyle* face = &mesh[c].faces[t / 2];
+		for (int j = 0; j < 3; j++) {
+			memcpy(commands[i].points[j], screenCoords[c][mesh[c].triangles[t][j]], sizeof(commands[i].points[j]));
+		}
+		commands[i].color = face->color;
+		commands[i].glyph = face->glyph;
+		commands[i].light = face->light;
 	}
+}
+
+// Removes polygons that are facing away from the screen or are in a chunk that can't be seen. returns the number of polygons left to draw
+int cullBack(ChunkMesh mesh[NUM_CHUNKS], float screenCoords[NUM_CHUNKS][CHUNK_VERTICIES][3], int drawOrder[MAX_TRIANGLES], int chunkVisible[CHUNKS][CHUNKS][CHUNKS], int* occluded) {
 	int numFacing = 0;
-	for (int i = 0; i < POLYGONS; i++) {
-		// if polygon is facing towards the screen then add it to the list to be drawn
-		if (polygons[i][1] != -1)
-		if (((screenCoords[polygons[i][1]][0] - screenCoords[polygons[i][0]][0]) * (screenCoords[polygons[i][2]][1] - screenCoords[polygons[i][0]][1])) - ((screenCoords[polygons[i][1]][1] - screenCoords[polygons[i][0]][1]) * (screenCoords[polygons[i][2]][0] - screenCoords[polygons[i][0]][0])) < 0) {
-			drawOrder[numFacing] = i;
-			numFacing++;
+	int* visible = &chunkVisible[0][0][0];
+	*occluded = 0;
+	for (int c = 0; c < NUM_CHUNKS; c++) {
+		// skips chunks hidden behind other blocks before doing any more work on them
+		if (!visible[c]) {
+			*occluded += mesh[c].numFaces * 2;
+			continue;
+		}
+		
+		float (*points)[3] = screenCoords[c];
+		for (int i = 0; i < mesh[c].numFaces * 2; i++) {
+			unsigned char* triangle = mesh[c].triangles[i];
+			// if polygon is facing towards the screen then add it to the list to be drawn
+			if (((points[triangle[1]][0] - points[triangle[0]][0]) * (points[triangle[2]][1] - points[triangle[0]][1])) - ((points[triangle[1]][1] - points[triangle[0]][1]) * (points[triangle[2]][0] - points[triangle[0]][0])) < 0) {
+				drawOrder[numFacing] = c * CHUNK_TRIANGLES + i;
+				numFacing++;
+			}
 		}
 	}
+	return numFacing;
 }
 
-// Orders the polygons so they are drawn back to front
-void orderPoly(int polygons[POLYGONS][4], double screenCoords[VERTICIES][3], int drawOrder[POLYGONS]) {
-	double zDistance[POLYGONS];
-	for (int i = 0; i < POLYGONS; i++) {
-		if (drawOrder[i] == -1) break;
-		zDistance[i] = (screenCoords[polygons[drawOrder[i]][0]][2] + screenCoords[polygons[drawOrder[i]][1]][2] + screenCoords[polygons[drawOrder[i]][2]][2]) / 3;
+// Finds which faces of each chunk are connected to each other through air inside the chunk.
+// chunkConnections[x][y][z][face] is a bitmask of the faces reachable from that face (faces are -x, +x, -y, +y, -z, +z)
+void computeChunkConnections(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int chunkConnections[CHUNKS][CHUNKS][CHUNKS][6]) {
+	int visited[CHUNK_SIZE][CHUNK_SIZE][CHUNK_SIZE];
+	int queue[CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE][3];
+	int offsets[6][3] = {{-1,0,0},{1,0,0},{0,-1,0},{0,1,0},{0,0,-1},{0,0,1}};
+	
+	for (int cx = 0; cx < CHUNKS; cx++) {
+		for (int cy = 0; cy < CHUNKS; cy++) {
+			for (int cz = 0; cz < CHUNKS; cz++) {
+				for (int f = 0; f < 6; f++) chunkConnections[cx][cy][cz][f] = 0;
+				memset(visited, 0, sizeof(visited));
+				
+				// flood fills every group of connected air blocks in the chunk
+				for (int x = 0; x < CHUNK_SIZE; x++) {
+					for (int y = 0; y < CHUNK_SIZE; y++) {
+						for (int z = 0; z < CHUNK_SIZE; z++) {
+							if (visited[x][y][z] || blockPositions[cx*CHUNK_SIZE+x][cy*CHUNK_SIZE+y][cz*CHUNK_SIZE+z] != -1) continue;
+							
+							int faces = 0;
+							int head = 0;
+							int tail = 0;
+							visited[x][y][z] = 1;
+							queue[tail][0] = x;
+							queue[tail][1] = y;
+							queue[tail][2] = z;
+							tail++;
+							while (head < tail) {
+								int* cell = queue[head++];
+								// records which chunk faces this group of air touches
+								for (int axis = 0; axis < 3; axis++) {
+									if (cell[axis] == 0) faces |= 1 << (axis * 2);
+									if (cell[axis] == CHUNK_SIZE - 1) faces |= 1 << (axis * 2 + 1);
+								}
+								for (int f = 0; f < 6; f++) {
+									int nx = cell[0] + offsets[f][0];
+									int ny = cell[1] + offsets[f][1];
+									int nz = cell[2] + offsets[f][2];
+									if (nx < 0 || ny < 0 || nz < 0 || nx >= CHUNK_SIZE || ny >= CHUNK_SIZE || nz >= CHUNK_SIZE) continue;
+									if (visited[nx][ny][nz] || blockPositions[cx*CHUNK_SIZE+nx][cy*CHUNK_SIZE+ny][cz*CHUNK_SIZE+nz] != -1) continue;
+									visited[nx][ny][nz] = 1;
+									queue[tail][0] = nx;
+									queue[tail][1] = ny;
+									queue[tail][2] = nz;
+									tail++;
+								}
+							}
+							
+							// every face this group touches can be seen through from every other face it touches
+							for (int f = 0; f < 6; f++) {
+								if (faces & (1 << f)) chunkConnections[cx][cy][cz][f] |= faces;
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+// Marks the chunks that can be seen from the player by walking outwards through chunks that are connected by air
+void cullOcclusion(double playerPos[3], int chunkConnections[CHUNKS][CHUNKS][CHUNKS][6], int chunkVisible[CHUNKS][CHUNKS][CHUNKS]) {
+	// each queued chunk stores its position, the face it was entered through and the directions travelled to reach it
+	int queue[CHUNKS * CHUNKS * CHUNKS][5];
+	int head = 0;
+	int tail = 0;
+	int offsets[6][3] = {{-1,0,0},{1,0,0},{0,-1,0},{0,1,0},{0,0,-1},{0,0,1}};
+	int camera[3];
+	int inside = 1;
+	
+	for (int x = 0; x < CHUNKS; x++) {
+		for (int y = 0; y < CHUNKS; y++) {
+			for (int z = 0; z < CHUNKS; z++) {
+				chunkVisible[x][y][z] = 0;
+			}
+		}
+	}
+	
+	// player position is in game units which are 2 per block
+	for (int i = 0; i < 3; i++) {
+		camera[i] = (int)floor(playerPos[i] / 2 / CHUNK_SIZE);
+		if (camera[i] < 0 || camera[i] >= CHUNKS) inside = 0;
+	}
+	
+	if (inside) {
+		chunkVisible[camera[0]][camera[1]][camera[2]] = 1;
+		queue[tail][0] = camera[0];
+		queue[tail][1] = camera[1];
+		queue[tail][2] = camera[2];
+		queue[tail][3] = -1;
+		queue[tail][4] = 0;
+		tail++;
+	} else {
+		// outside the world every chunk on a side facing the player is seen through open air
+		for (int f = 0; f < 6; f++) {
+			int axis = f / 2;
+			if (f % 2 == 0 && camera[axis] >= 0) continue;
+			if (f % 2 == 1 && camera[axis] < CHUNKS) continue;
+			for (int a = 0; a < CHUNKS; a++) {
+				for (int b = 0; b < CHUNKS; b++) {
+					int c[3];
+					c[axis] = f % 2 == 0 ? 0 : CHUNKS - 1;
+					c[(axis + 1) % 3] = a;
+					c[(axis + 2) % 3] = b;
+					if (chunkVisible[c[0]][c[1]][c[2]]) continue;
+					chunkVisible[c[0]][c[1]][c[2]] = 1;
+					queue[tail][0] = c[0];
+					queue[tail][1] = c[1];
+					queue[tail][2] = c[2];
+					queue[tail][3] = f;
+					queue[tail][4] = 1 << (f ^ 1);
+					tail++;
+				}
+			}
+		}
+	}
+	
+	while (head < tail) {
+		int* chunk = queue[head++];
+		for (int f = 0; f < 6; f++) {
+			// never step back towards the player
+			if (chunk[4] & (1 << (f ^ 1))) continue;
+			// the chunk has to be open from the face we came in through to the face we leave through
+			if (chunk[3] != -1 && !(chunkConnections[chunk[0]][chunk[1]][chunk[2]][chunk[3]] & (1 << f))) continue;
+			
+			int nx = chunk[0] + offsets[f][0];
+			int ny = chunk[1] + offsets[f][1];
+			int nz = chunk[2] + offsets[f][2];
+			if (nx < 0 || ny < 0 || nz < 0 || nx >= CHUNKS || ny >= CHUNKS || nz >= CHUNKS) continue;
+			if (chunkVisible[nx][ny][nz]) continue;
+			
+			chunkVisible[nx][ny][nz] = 1;
+			queue[tail][0] = nx;
+			queue[tail][1] = ny;
+			queue[tail][2] = nz;
+			queue[tail][3] = f ^ 1;
+			queue[tail][4] = chunk[4] | (1 << f);
+			tail++;
+		}
+	}
+}
+
+// Orders the polygons so they are drawn back to front
+void orderPoly(ChunkMesh mesh[NUM_CHUNKS], float screenCoords[NUM_CHUNKS][CHUNK_VERTICIES][3], int drawOrder[MAX_TRIANGLES], int numDraw) {
+	double* zDistance = arenaAlloc(&frameArena, numDraw * sizeof(double));
+	for (int i = 0; i < numDraw; i++) {
+		int c = drawOrder[i] / CHUNK_TRIANGLES;
+		unsigned char* triangle = mesh[c].triangles[drawOrder[i] % CHUNK_TRIANGLES];
+		zDistance[i] = (screenCoords[c][triangle[0]][2] + screenCoords[c][triangle[1]][2] + screenCoords[c][triangle[2]][2]) / 3;
 	}
 	
 	// bubble sort to order the polygons from back to front
 	int tempPoly;
 	double tempDistance;
-	for (int i = 1; i < POLYGONS; i++) {
-		if (drawOrder[i] == -1) break;
+	for (int i = 1; i < numDraw; i++) {
 		for (int j = i; j > 0; j--) {
 			if (zDistance[j] > zDistance[j-1]) {
 				tempDistance = zDistance[j];
@@ -796,11 +1398,7 @@ int checkCollisions(double playerPos[3], double playerMove[3], int blockPosition
 	// checks player collision in the y direction
 	// if player is moving down
 	if (playerMove[1] < 0) {
-		for (int i = 0; i < 4; i++) {
-			if (blockPositions[(int)(collisionPoints[i][0])][(int)(collisionPoints[i][1]+playerMove[1]/2*deltaTime)][(int)(collisionPoints[i][2])] != -1) {
-				collided = 1;
-			}
-		}
+		collided = pointsCollide(collisionPoints, 4, 1, playerMove[1]/2*deltaTime, blockPositions);
 		if (collided) {
 			playerPos[1] = (int)(collisionPoints[0][1]+playerMove[1]/2*deltaTime)*2+5.2;
 		} else {
@@ -809,44 +1407,28 @@ int checkCollisions(double playerPos[3], double playerMove[3], int blockPosition
 		}
 	// if player is moving up
 	} else if (playerMove[1] > 0) {
-		for (int i = 8; i < 12; i++) {
-			if (blockPositions[(int)(collisionPoints[i][0])][(int)(collisionPoints[i][1]+playerMove[1]/2*deltaTime)][(int)(collisionPoints[i][2])] != -1) {
-				collided = 1;
-			}
-		}
+		collided = pointsCollide(&collisionPoints[8], 4, 1, playerMove[1]/2*deltaTime, blockPositions);
 		if (collided) {
 			playerPos[1] = (int)(collisionPoints[8][1]+playerMove[1]/2*deltaTime)*2-0.4;
 			playerMove[1] = 0;
 		} else playerPos[1] += playerMove[1] * deltaTime;
 		onGround = 0;
 	} else {
-		for (int i = 0; i < 4; i++) {
-			if (blockPositions[(int)(collisionPoints[i][0])][(int)(collisionPoints[i][1]-0.5)][(int)(collisionPoints[i][2])] != -1) {
-				collided = 1;
-			}
-		}
+		collided = pointsCollide(collisionPoints, 4, 1, -0.5, blockPositions);
 		if (!collided) onGround = 0;
 	}
 	
 	collided = 0;
 	// checks player collision in the x direction
 	if (playerMove[0] > 0) {
-		for (int i = 0; i < 12; i++) {
-			if (blockPositions[(int)(collisionPoints[i][0]+playerMove[0]/2*deltaTime)][(int)(collisionPoints[i][1])][(int)(collisionPoints[i][2])] != -1) {
-				collided = 1;
-			}
-		}
+		collided = pointsCollide(collisionPoints, 12, 0, playerMove[0]/2*deltaTime, blockPositions);
 		if (collided) {
 			playerPos[0] = (int)(collisionPoints[0][0]+playerMove[0]/2*deltaTime)*2-0.6;
 		} else {
 			playerPos[0] += playerMove[0] * deltaTime;
 		}
 	} else if (playerMove[0] < 0) {
-		for (int i = 0; i < 12; i++) {
-			if (blockPositions[(int)(collisionPoints[i][0]+playerMove[0]/2*deltaTime)][(int)(collisionPoints[i][1])][(int)(collisionPoints[i][2])] != -1) {
-				collided = 1;
-			}
-		}
+		collided = pointsCollide(collisionPoints, 12, 0, playerMove[0]/2*deltaTime, blockPositions);
 		if (collided) {
 			playerPos[0] = (int)(collisionPoints[0][0]+playerMove[0]/2*deltaTime)*2+0.6;
 		} else {
@@ -857,22 +1439,14 @@ int checkCollisions(double playerPos[3], double playerMove[3], int blockPosition
 	collided = 0;
 	// checks player collision in the z direction
 	if (playerMove[2] > 0) {
-		for (int i = 0; i < 12; i++) {
-			if (blockPositions[(int)(collisionPoints[i][0])][(int)(collisionPoints[i][1])][(int)(collisionPoints[i][2]+playerMove[2]/2*deltaTime)] != -1) {
-				collided = 1;
-			}
-		}
+		collided = pointsCollide(collisionPoints, 12, 2, playerMove[2]/2*deltaTime, blockPositions);
 		if (collided) {
 			playerPos[2] = (int)(collisionPoints[0][2]+playerMove[2]/2*deltaTime)*2-0.6;
 		} else {
 			playerPos[2] += playerMove[2] * deltaTime;
 		}
 	} else if (playerMove[2] < 0) {
-		for (int i = 0; i < 12; i++) {
-			if (blockPositions[(int)(collisionPoints[i][0])][(int)(collisionPoints[i][1])][(int)(collisionPoints[i][2]+playerMove[2]/2*deltaTime)] != -1) {
-				collided = 1;
-			}
-		}
+		collided = pointsCollide(collisionPoints, 12, 2, playerMove[2]/2*deltaTime, blockPositions);
 		if (collided) {
 			playerPos[2] = (int)(collisionPoints[0][2]+playerMove[2]/2*deltaTime)*2+0.6;
 		} else {
@@ -892,46 +1466,48 @@ int checkCollisions(double playerPos[3], double playerMove[3], int blockPosition
 	return onGround;
 }
 
-// Draws the pause menu
 void drawPaused(int menuX, int menuY) {
+	// the menu is 64 by 16 and stays in the middle of the screen whatever size it is
+	int left = COLS / 2 - 32;
+	int top = LINES / 2 - 8;
 	attron(COLOR_PAIR(16));
-	for (int x = 30; x < COLS-30; x++) {
-		for (int y = 10; y < LINES-10; y++) {
+	for (int x = left; x < left + 64; x++) {
+		for (int y = top; y < top + 16; y++) {
 			move(y, x);
 			addch(' ');
 		}
 	}
 	// draws game paused text and game controls
-	move(13, COLS/2-5);
+	move(top + 2, COLS/2-5);
 	printw("GAME PAUSED");
-	mvaddstr(15, COLS/2-18, "MOVE: ARROW KEYS    CAMERA: WASD");
-	mvaddstr(17, COLS/2-18, "PLACE/BREAK: Z/X    CHANGE BLOCK: Q/E");
+	mvaddstr(top + 4, COLS/2-18, "MOVE: ARROW KEYS    CAMERA: WASD");
+	mvaddstr(top + 6, COLS/2-18, "PLACE/BREAK: Z/X    CHANGE BLOCK: Q/E");
 	
 	// draws the menu icons and inverts the colors on the one that is selected
 	if (menuX == 0) attron(COLOR_PAIR(15));
-	move(LINES/2+2, COLS/2-30);
+	move(top + 10, COLS/2-30);
 	printw("+--------------+");
-	move(LINES/2+3, COLS/2-30);
+	move(top + 11, COLS/2-30);
 	printw("|     MENU     |");
-	move(LINES/2+4, COLS/2-30);
+	move(top + 12, COLS/2-30);
 	printw("+--------------+");
 	attron(COLOR_PAIR(16));
 	
 	if (menuX == 1) attron(COLOR_PAIR(15));
-	move(LINES/2+2, COLS/2-8);
+	move(top + 10, COLS/2-8);
 	printw("+--------------+");
-	move(LINES/2+3, COLS/2-8);
+	move(top + 11, COLS/2-8);
 	printw("|     SAVE     |");
-	move(LINES/2+4, COLS/2-8);
+	move(top + 12, COLS/2-8);
 	printw("+--------------+");
 	attron(COLOR_PAIR(16));
 	
 	if (menuX == 2) attron(COLOR_PAIR(15));
-	move(LINES/2+2, COLS/2+14);
+	move(top + 10, COLS/2+14);
 	printw("+--------------+");
-	move(LINES/2+3, COLS/2+14);
+	move(top + 11, COLS/2+14);
 	printw("|     QUIT     |");
-	move(LINES/2+4, COLS/2+14);
+	move(top + 12, COLS/2+14);
 	printw("+--------------+");
 	attron(COLOR_PAIR(16));
 	
@@ -949,22 +1525,41 @@ void playerTouching(double playerPos[], double playerRot[], int blockPositions[W
 		blocksTouching[1][i] = -1;
 	}
 	
-	// increments the ray checking if it hits a block each time
+	// increments the ray checking if it hits a block each time. just past the edge of the world is air
+	BrickMap* bricks = brickMapFor(blockPositions);
+	HeightMap* heights = heightMapFor(blockPositions);
 	for (int i = 0; i < 100; i++) {
 		for (int j = 0; j < 3; j++) {
 			rayPos[j] += rayIncrement[j];
 			if (rayPos[j] < 0 || rayPos[j] > WORLD_SIZE*2+2) return;
 		}
-		if (blockPositions[(int)(rayPos[0]/2)][(int)(rayPos[1]/2)][(int)(rayPos[2]/2)] != -1) {
-			blocksTouching[1][0] = (int)(rayPos[0]/2);
-			blocksTouching[1][1] = (int)(rayPos[1]/2);
-			blocksTouching[1][2] = (int)(rayPos[2]/2);
+		int cell[3] = {(int)(rayPos[0]/2), (int)(rayPos[1]/2), (int)(rayPos[2]/2)};
+		int inWorld = cell[0] < WORLD_SIZE && cell[1] < WORLD_SIZE && cell[2] < WORLD_SIZE;
+		if (inWorld && brickSolid(bricks, cell[0], cell[1], cell[2])) {
+			for (int j = 0; j < 3; j++) blocksTouching[1][j] = cell[j];
 			return;
-		} else {
-			blocksTouching[0][0] = (int)(rayPos[0]/2);
-			blocksTouching[0][1] = (int)(rayPos[1]/2);
-			blocksTouching[0][2] = (int)(rayPos[2]/2);
 		}
+		
+		// a ray above every column that isn't going down can't hit anything, and one in an empty brick can't until it leaves it.
+		// either way it keeps stepping without looking anything up, until the next step would leave the world or the brick
+		int clear = rayIncrement[1] >= 0 && cell[1] > highestBlock(heights);
+		if (clear || (inWorld && !(bricks->occupied >> brickIndex(cell[0], cell[1], cell[2]) & 1))) {
+			while (i < 99) {
+				double ahead[3];
+				int inside = 1;
+				for (int j = 0; j < 3; j++) {
+					double low = clear ? 0 : cell[j] / BRICK_SIZE * BRICK_SIZE * 2;
+					double high = clear ? WORLD_SIZE*2+2 : low + BRICK_SIZE * 2;
+					ahead[j] = rayPos[j] + rayIncrement[j];
+					if (ahead[j] < low || ahead[j] > high || (!clear && ahead[j] == high)) inside = 0;
+				}
+				if (!inside) break;
+				for (int j = 0; j < 3; j++) rayPos[j] = ahead[j];
+				i++;
+			}
+			for (int j = 0; j < 3; j++) cell[j] = (int)(rayPos[j]/2);
+		}
+		for (int j = 0; j < 3; j++) blocksTouching[0][j] = cell[j];
 	}
 }
 
@@ -1015,8 +1610,256 @@ void drawInventory(int blockColors[][3], int blockType) {
 }
 
 
+// Sets up the color pairs used by blocks and menus
+void initColors() {
+	start_color();
+	init_pair(1, COLOR_BLACK, COLOR_CYAN);
+	bkgd(COLOR_PAIR(1));
+	init_pair(2, COLOR_BLACK, COLOR_GREEN);
+	init_pair(3, COLOR_YELLOW, COLOR_BLACK);
+	init_pair(4, COLOR_WHITE, COLOR_BLACK);
+	init_pair(5, COLOR_BLACK, COLOR_YELLOW);
+	init_pair(6, COLOR_MAGENTA, COLOR_BLACK);
+	init_pair(7, COLOR_BLACK, COLOR_RED);
+	init_pair(8, COLOR_RED, COLOR_YELLOW);
+	init_pair(9, COLOR_BLACK, COLOR_BLUE);
+	init_pair(10, COLOR_RED, COLOR_WHITE);
+	init_pair(13, COLOR_WHITE, COLOR_MAGENTA);
+	init_pair(14, COLOR_BLACK, COLOR_MAGENTA);
+	init_pair(15, COLOR_BLACK, COLOR_WHITE);
+	init_pair(16, COLOR_WHITE, COLOR_BLACK);
+	
+	// every foreground and background pair for drawing two pixels per cell with half blocks
+	if (COLOR_PAIRS >= HALF_BLOCK_PAIRS + 64) {
+		for (int top = 0; top < 8; top++) {
+			for (int bottom = 0; bottom < 8; bottom++) init_pair(HALF_BLOCK_PAIRS + top * 8 + bottom, top, bottom);
+		}
+	}
+}
+
+// Returns a steady time in seconds for measuring how long things take
+double getTime() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1000000000.0;
+}
+
+// the profiler is left out completely when built with -DNO_PROFILER
+#ifndef NO_PROFILER
+// Starts timing a stage of the frame
+void profileBegin(int stage) {
+	profiler.stageStart[stage] = getTime();
+}
+
+// Stops timing a stage. stages timed more than once in a frame add up
+void profileEnd(int stage) {
+	double end = getTime();
+	profiler.stageTime[stage] += end - profiler.stageStart[stage];
+	
+	// chrome trace complete event with times in microseconds
+	if (profiler.trace) {
+		fprintf(profiler.trace, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1}", profiler.traceEvents++ ? ",\n" : "", stageNames[stage], (profiler.stageStart[stage] - profiler.traceStart) * 1000000, (end - profiler.stageStart[stage]) * 1000000);
+	}
+}
+
+// Clears the timings from the last frame
+void profileFrameStart() {
+	for (int i = 0; i < NUM_STAGES; i++) {
+		profiler.stageTime[i] = 0;
+	}
+	profiler.frameBytes = profiler.terminalBytes;
+	profiler.frameWrites = profiler.terminalWrites;
+}
+
+// Smooths the frame's timings for the overlay and writes its counters to the trace
+void profileFrameEnd() {
+	profiler.frameBytes = profiler.terminalBytes - profiler.frameBytes;
+	PROFILE_COUNT(COUNTER_BYTES, profiler.frameBytes);
+	PROFILE_COUNT(COUNTER_WRITES, profiler.terminalWrites - profiler.frameWrites);
+	PROFILE_COUNT(COUNTER_ARENA, (long)(frameArena.highWater / 1024));
+	if (!profiler.enabled) return;
+	
+	double frameTime = 0;
+	for (int i = 0; i < NUM_STAGES; i++) {
+		profiler.stageAverage[i] = profiler.stageAverage[i] * 0.9 + profiler.stageTime[i] * 0.1;
+		profiler.stageTotal[i] += profiler.stageTime[i];
+		frameTime += profiler.stageTime[i];
+	}
+	if (frameTime > profiler.frameMax) profiler.frameMax = frameTime;
+	
+	if (profiler.timings) {
+		fprintf(profiler.timings, "%ld", profiler.frames);
+		for (int i = 0; i < NUM_STAGES; i++) fprintf(profiler.timings, ",%.4f", profiler.stageTime[i] * 1000);
+		for (int i = 0; i < NUM_COUNTERS; i++) fprintf(profiler.timings, ",%ld", profiler.counters[i]);
+		fprintf(profiler.timings, "\n");
+	}
+	profiler.frames++;
+	if (profiler.trace) {
+		fprintf(profiler.trace, ",\n{\"name\":\"counters\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"args\":{", (getTime() - profiler.traceStart) * 1000000);
+		for (int i = 0; i < NUM_COUNTERS; i++) {
+			fprintf(profiler.trace, "%s\"%s\":%ld", i ? "," : "", counterNames[i], profiler.counters[i]);
+		}
+		fprintf(profiler.trace, "}}");
+	}
+}
+
+// Draws the time each stage took and the frame counters in the top right corner
+void drawProfiler() {
+	double total = 0;
+	attron(COLOR_PAIR(16));
+	for (int i = 0; i < NUM_STAGES; i++) {
+		mvprintw(i + 1, COLS - 20, "%-10s%6.3f ms", stageNames[i], profiler.stageAverage[i] * 1000);
+		total += profiler.stageAverage[i];
+	}
+	mvprintw(NUM_STAGES + 1, COLS - 20, "%-10s%6.3f ms", "total", total * 1000);
+	for (int i = 0; i < NUM_COUNTERS; i++) {
+		mvprintw(NUM_STAGES + 2 + i, COLS - 20, "%-10s%9ld", counterNames[i], profiler.counters[i]);
+	}
+	mvprintw(NUM_STAGES + 2 + NUM_COUNTERS, COLS - 20, "%-19s", profiler.trace ? "tracing (t)" : "trace off (t)");
+	attroff(COLOR_PAIR(16));
+}
+
+// Starts writing every stage of every frame to a chrome trace file (open it in chrome://tracing or perfetto)
+void startTrace(const char* fileName) {
+	profiler.trace = fopen(fileName, "w");
+	if (!profiler.trace) return;
+	fprintf(profiler.trace, "{\"traceEvents\":[\n");
+	profiler.traceStart = getTime();
+	profiler.traceEvents = 0;
+}
+
+// Finishes the trace file
+void stopTrace() {
+	fprintf(profiler.trace, "\n]}\n");
+	fclose(profiler.trace);
+	profiler.trace = NULL;
+}
+
+// Prints the average time of each stage over every profiled frame
+void printProfileSummary() {
+	double total = 0;
+	if (profiler.frames == 0) return;
+	printf("%ld frames\n", profiler.frames);
+	for (int i = 0; i < NUM_STAGES; i++) {
+		printf("%-10s %8.4f ms\n", stageNames[i], profiler.stageTotal[i] * 1000 / profiler.frames);
+		total += profiler.stageTotal[i];
+	}
+	printf("%-10s %8.4f ms (slowest %.4f ms)\n", "frame", total * 1000 / profiler.frames, profiler.frameMax * 1000);
+}
+
+// Counts what ncurses sends to a headless screen: every packet on the socket is one write() it made. each packet is peeked at
+// and counted before it is taken, so once waitForTerminalOutput sees the socket empty the counters have it all
+void* countTerminalOutput(void* socket) {
+	int fd = (int)(intptr_t)socket;
+	char discard;
+	while (1) {
+		ssize_t size = recv(fd, &discard, 1, MSG_PEEK | MSG_TRUNC);
+		if (size <= 0) break;
+		__atomic_add_fetch(&profiler.terminalBytes, size, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&profiler.terminalWrites, 1, __ATOMIC_RELAXED);
+		if (recv(fd, &discard, 1, MSG_TRUNC) <= 0) break;
+	}
+	close(fd);
+	return NULL;
+}
+
+// Waits for the counting thread to take everything ncurses has sent to a headless screen
+void waitForTerminalOutput() {
+	int pending;
+	while (profiler.outputSocket != -1 && ioctl(profiler.outputSocket, SIOCOUTQ, &pending) == 0 && pending > 0) sched_yield();
+}
+#endif
+
+// Gets the next key press. it comes from the journal when replaying and is written to it when recording
+int readKey() {
+	int ch;
+	if (journal.mode == JOURNAL_REPLAY) {
+		// keys are handed out once the replay has reached the time they were pressed
+		if (journal.nextKey == ERR || journal.nextTime > journal.frame * 1000.0 / 60) return ERR;
+		ch = journal.nextKey;
+		readJournalEvent();
+		return ch;
+	}
+	
+	ch = wgetch(viewport.keys ? viewport.keys : stdscr);
+	if (journal.mode == JOURNAL_RECORD && ch != ERR) {
+		fprintf(journal.file, "key %.3f %d\n", (getTime() - journal.startTime) * 1000, ch);
+	}
+	return ch;
+}
+
+// Starts a journal with the world that is being played, then every key press is added to it
+void startRecording(const char* fileName, int seed, const char* levelName) {
+	journal.file = fopen(fileName, "w");
+	if (!journal.file) return;
+	journal.mode = JOURNAL_RECORD;
+	// line buffered so the journal is still usable if the game is killed
+	setvbuf(journal.file, NULL, _IOLBF, 0);
+	fprintf(journal.file, "blockgame-journal 1\n");
+	if (seed != -1) fprintf(journal.file, "seed %d\n", seed);
+	else fprintf(journal.file, "world %s\n", levelName);
+	journal.startTime = getTime();
+}
+
+// Opens a journal to replay and reads which world it was recorded in. returns 0 if it can't be read
+int startReplay(const char* fileName, int* seed, char levelName[100]) {
+	int version;
+	char line[128];
+	journal.file = fopen(fileName, "r");
+	if (!journal.file) return 0;
+	if (fscanf(journal.file, "blockgame-journal %d\n", &version) != 1 || !fgets(line, sizeof(line), journal.file)) {
+		fclose(journal.file);
+		journal.file = NULL;
+		return 0;
+	}
+	line[strcspn(line, "\n")] = '\0';
+	if (sscanf(line, "seed %d", seed) != 1) {
+		if (strncmp(line, "world ", 6) != 0) {
+			fclose(journal.file);
+			journal.file = NULL;
+			return 0;
+		}
+		strncpy(levelName, line + 6, 99);
+		levelName[99] = '\0';
+	}
+	journal.mode = JOURNAL_REPLAY;
+	journal.frame = 0;
+	journal.endTime = -1;
+	readJournalEvent();
+	return 1;
+}
+
+// Reads the next key press from the journal being replayed
+void readJournalEvent() {
+	char type[8];
+	journal.nextKey = ERR;
+	while (fscanf(journal.file, "%7s", type) == 1) {
+		if (strcmp(type, "key") == 0 && fscanf(journal.file, "%lf %d", &journal.nextTime, &journal.nextKey) == 2) return;
+		if (strcmp(type, "end") == 0 && fscanf(journal.file, "%lf", &journal.endTime) == 1) continue;
+		journal.nextKey = ERR;
+		return;
+	}
+}
+
+// Moves the replay on by a frame. returns 0 once the whole journal has been played
+int journalFrame() {
+	journal.frame++;
+	if (journal.nextKey != ERR) return 1;
+	return journal.frame * 1000.0 / 60 <= journal.endTime;
+}
+
+// Closes the journal. recordings get the time they ended so replays run just as long
+void stopJournal() {
+	if (journal.mode == JOURNAL_RECORD) fprintf(journal.file, "end %.3f\n", (getTime() - journal.startTime) * 1000);
+	if (journal.mode != JOURNAL_OFF) fclose(journal.file);
+	journal.mode = JOURNAL_OFF;
+}
+
+
 //============
 
+// the start menus are only part of the game, the library leaves them out with main
+#ifndef BLOCKGAME_LIBRARY
 
 // Function to set terminal text color
 void setColor(const char *color) {
@@ -1083,6 +1926,46 @@ int getValidatedChoice() {
     }
 }
  
+// Runs the stdio menus until the player picks a seed or a world to load
+void mainMenu(int* seed, FILE** level, char levelName[100]) {
+	int choice;
+ 
+    // Welcome Screen
+    welcomeScreen();
+      
+       // Graphical Menu
+    drawGraphicalMenu();
+      
+      // Pause after the graphical menu
+    printf("\nPress Enter to continue...");
+    getchar(); // Wait for the user to press Enter
+ 
+    while (1) {
+        // Display the menu
+        displayMenu();
+ 
+        // Get the validated choice
+        choice = getValidatedChoice();
+ 
+        // Handle menu options
+        switch (choice) {
+            case 1:
+                *seed = playMenu();
+                break;
+            case 2:
+                loadMenu(level, levelName);
+                break;
+            case 3:
+                quitMenu();
+                exit(0);
+            default:
+                printf("Invalid choice. Please try again.\n");
+		}
+		if (*seed != -1) break;
+		if (*level != NULL) break;
+	}
+}
+
 // Function for the Play menu
 int playMenu() {
     int seed;
@@ -1106,13 +1989,12 @@ int playMenu() {
 }
 
 // Function for the Load menu
-void loadMenu(FILE** level) {
-    char fileName[100];
+void loadMenu(FILE** level, char fileName[100]) {
     setColor("\033[1;36m"); // Cyan color for load menu
     printf("\n===== Load Menu =====\n");
     resetColor();
     printf("Enter the file name to load: ");
-    fgets(fileName, sizeof(fileName), stdin);
+    fgets(fileName, 100, stdin);
     fileName[strcspn(fileName, "\n")] = '\0'; // Remove trailing newline
     printf("Loading world from file: %s\n", fileName);
     // Add file validation or loading logic if required
@@ -1194,4 +2076,2621 @@ void drawGraphicalMenu() {
  
     // Prompt for input
     printf("\nEnter your choice: ");
-}
\ No newline at end of file
+}
+#endif
+
+// ==================================================> ARENA <==================================================
+
+// Gives out size bytes of the arena. nothing is freed on its own, the whole arena is emptied by arenaReset
+void* arenaAlloc(Arena* arena, size_t size) {
+	size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	if (arena->used + size <= arena->capacity) {
+		void* memory = arena->memory + arena->used;
+		arena->used += size;
+		return memory;
+	}
+	
+	// the block on the heap starts with the next one in the list
+	char* block = malloc(size + ARENA_ALIGN);
+	*(void**)block = arena->overflow;
+	arena->overflow = block;
+	arena->overflowBytes += size;
+	return block + ARENA_ALIGN;
+}
+
+// Empties the arena for a new frame. if the last frame didn't fit it grows to fit that frame with some room to spare
+void arenaReset(Arena* arena) {
+	size_t needed = arena->used + arena->overflowBytes;
+	if (needed > arena->highWater) arena->highWater = needed;
+	while (arena->overflow) {
+		void* next = *(void**)arena->overflow;
+		free(arena->overflow);
+		arena->overflow = next;
+	}
+	if (arena->overflowBytes > 0) {
+		free(arena->memory);
+		arena->capacity = needed + needed / 2;
+		arena->memory = malloc(arena->capacity);
+		arena->grows++;
+	}
+	arena->overflowBytes = 0;
+	arena->used = 0;
+}
+
+// How many triangles the visible chunks have, which is the most that can be drawn this frame
+int countTriangles(ChunkMesh mesh[NUM_CHUNKS], int chunkVisible[CHUNKS][CHUNKS][CHUNKS]) {
+	int* visible = &chunkVisible[0][0][0];
+	int count = 0;
+	for (int c = 0; c < NUM_CHUNKS; c++) {
+		if (visible[c]) count += mesh[c].numFaces * 2;
+	}
+	return count;
+}
+
+// ==================================================> VIEWPORT <==================================================
+
+// Sizes the framebuffer for a terminal. the buffers only grow, so they are reallocated once when the terminal gets bigger
+void setViewport(int lines, int cols, int scale, int halfBlocks) {
+	// half blocks need a color pair for every top and bottom color
+	if (halfBlocks && COLOR_PAIRS < HALF_BLOCK_PAIRS + 64) halfBlocks = 0;
+	viewport.lines = lines;
+	viewport.cols = cols;
+	viewport.scale = halfBlocks ? 1 : scale;
+	viewport.halfBlocks = halfBlocks;
+	viewport.width = (cols + viewport.scale - 1) / viewport.scale;
+	viewport.height = halfBlocks ? lines * 2 : (lines + viewport.scale - 1) / viewport.scale;
+	
+	int size = viewport.width * viewport.height;
+	if (size > viewport.capacity) {
+		viewport.frame = realloc(viewport.frame, size * sizeof(chtype));
+		viewport.depth = realloc(viewport.depth, size * sizeof(float));
+		viewport.depthKey = realloc(viewport.depthKey, size * sizeof(unsigned int));
+		viewport.light = realloc(viewport.light, size);
+		viewport.capacity = size;
+		viewport.allocations++;
+	}
+	if (cols + 1 > viewport.rowCapacity) {
+		viewport.row = realloc(viewport.row, (cols + 1) * sizeof(chtype));
+		viewport.wideRow = realloc(viewport.wideRow, (cols + 1) * sizeof(cchar_t));
+		viewport.rowCapacity = cols + 1;
+	}
+	
+	// escape sequence output keeps what every terminal cell shows. a new size starts again from nothing
+	if (lines * cols > viewport.shownCapacity) {
+		viewport.shown = realloc(viewport.shown, lines * cols * sizeof(unsigned long long));
+		// two 24 bit colors, a cursor move and a character at most for every cell
+		viewport.ansi = realloc(viewport.ansi, lines * cols * 48 + 16);
+		viewport.shownCapacity = lines * cols;
+	}
+	memset(viewport.shown, 0xff, lines * cols * sizeof(unsigned long long));
+}
+
+// Fills the framebuffer with sky and resets the depth buffer
+void clearViewport() {
+	if (viewport.capacity == 0) setViewport(LINES, COLS, 1, 0);
+	int size = viewport.width * viewport.height;
+	viewport.keyedDepth = 0;
+	for (int i = 0; i < size; i++) {
+		viewport.frame[i] = ' ' | COLOR_PAIR(1);
+		viewport.depth[i] = INFINITY;
+		viewport.light[i] = MAX_LIGHT;
+	}
+}
+
+// Copies the framebuffer to the screen one row at a time, stretching it back up to the terminal size
+void presentViewport() {
+	// escape sequence output reads the framebuffer itself in presentAnsi
+	if (viewport.output != OUTPUT_CURSES) return;
+	if (viewport.halfBlocks) {
+		// each terminal cell shows the top pixel as the foreground of ▀ and the bottom pixel as its background
+		short pairColors[17][2];
+		for (int i = 0; i < 17; i++) {
+			pair_content(i, &pairColors[i][0], &pairColors[i][1]);
+			if (pairColors[i][0] < 0) pairColors[i][0] = COLOR_WHITE;
+			if (pairColors[i][1] < 0) pairColors[i][1] = COLOR_BLACK;
+		}
+		for (int y = 0; y < viewport.lines; y++) {
+			for (int x = 0; x < viewport.cols; x++) {
+				chtype top = viewport.frame[(y * 2) * viewport.width + x];
+				chtype bottom = viewport.frame[(y * 2 + 1) * viewport.width + x];
+				int topPair = PAIR_NUMBER(top) % 17;
+				int bottomPair = PAIR_NUMBER(bottom) % 17;
+				int topColor = pairColors[topPair][(top & A_CHARTEXT) == ' ' ? 1 : 0];
+				int bottomColor = pairColors[bottomPair][(bottom & A_CHARTEXT) == ' ' ? 1 : 0];
+				setcchar(&viewport.wideRow[x], L"▀", 0, HALF_BLOCK_PAIRS + topColor * 8 + bottomColor, NULL);
+			}
+			mvadd_wchnstr(y, 0, viewport.wideRow, viewport.cols);
+		}
+		return;
+	}
+	
+	for (int y = 0; y < viewport.lines; y++) {
+		chtype* source = &viewport.frame[(y / viewport.scale) * viewport.width];
+		for (int x = 0; x < viewport.cols; x++) viewport.row[x] = source[x / viewport.scale];
+		mvaddchnstr(y, 0, viewport.row, viewport.cols);
+	}
+}
+
+// Goes to the next render scale: full, half and quarter resolution, then half blocks
+void cycleRenderScale() {
+	if (viewport.halfBlocks) setViewport(viewport.lines, viewport.cols, 1, 0);
+	else if (viewport.scale == 4) setViewport(viewport.lines, viewport.cols, 1, 1);
+	else setViewport(viewport.lines, viewport.cols, viewport.scale * 2, 0);
+}
+
+// Resizes the screen and the framebuffer after the terminal window changed size
+void handleResize() {
+	struct winsize size;
+	terminalResized = 0;
+	if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == -1 || size.ws_row == 0 || size.ws_col == 0) return;
+	resizeterm(size.ws_row, size.ws_col);
+	setViewport(LINES, COLS, viewport.scale, viewport.halfBlocks);
+	clear();
+}
+
+// SIGWINCH handler. the resize itself happens at the start of the next frame
+void resizeSignal(int signal) {
+	terminalResized = 1;
+}
+
+// Switches to writing the screen as escape sequences. ncurses keeps the keyboard and the text drawn over the world
+void startAnsiOutput(int terminal, int output) {
+	viewport.output = output;
+	viewport.terminal = terminal;
+	if (output == OUTPUT_CURSES) return;
+	
+	// getch() would redraw stdscr over the picture, so keys are read through a window that is never drawn on
+	if (!viewport.keys) {
+		viewport.keys = newwin(1, 1, 0, 0);
+		keypad(viewport.keys, TRUE);
+		nodelay(viewport.keys, TRUE);
+		wrefresh(viewport.keys);
+	}
+	curs_set(0);
+	if (viewport.shown) memset(viewport.shown, 0xff, viewport.shownCapacity * sizeof(unsigned long long));
+}
+
+// Color of a curses color at a light level, as 24 bit RGB or as a color from the 256 color cube
+int shadeColor(int color, int light) {
+	int palette[8] = {0x000000, 0xcd0000, 0x00cd00, 0xcdcd00, 0x0000ee, 0xcd00cd, 0x00cdcd, 0xe5e5e5};
+	int rgb = palette[color & 7];
+	double level = 0.3 + 0.7 * light / MAX_LIGHT;
+	int r = (rgb >> 16) * level;
+	int g = ((rgb >> 8) & 255) * level;
+	int b = (rgb & 255) * level;
+	if (viewport.output == OUTPUT_256) return 16 + 36 * ((r * 5 + 127) / 255) + 6 * ((g * 5 + 127) / 255) + (b * 5 + 127) / 255;
+	return (r << 16) | (g << 8) | b;
+}
+
+// Packs what a terminal cell shows into one number: character, foreground and background.
+// spaces don't show their foreground so it is left out, which lets more cells be skipped
+unsigned long long ansiCell(chtype cell, int light, short pairColors[HALF_BLOCK_PAIRS][2]) {
+	int pair = PAIR_NUMBER(cell) % HALF_BLOCK_PAIRS;
+	unsigned long long glyph = cell & A_CHARTEXT;
+	unsigned long long background = shadeColor(pairColors[pair][1], light);
+	unsigned long long foreground = glyph == ' ' ? 0 : shadeColor(pairColors[pair][0], light);
+	return (glyph << 48) | (foreground << 24) | background;
+}
+
+// Adds the escape sequence for a foreground or background color
+char* ansiColor(char* out, int background, int color) {
+	if (viewport.output == OUTPUT_256) return out + sprintf(out, "\x1b[%d;5;%dm", background ? 48 : 38, color);
+	return out + sprintf(out, "\x1b[%d;2;%d;%d;%dm", background ? 48 : 38, color >> 16, (color >> 8) & 255, color & 255);
+}
+
+// Builds the whole frame as escape sequences and sends it with one write(). text drawn on stdscr goes over the world,
+// cells that look the same as last frame are skipped and colors are only sent when they change
+void presentAnsi() {
+	short pairColors[HALF_BLOCK_PAIRS][2];
+	for (int i = 0; i < HALF_BLOCK_PAIRS; i++) {
+		pair_content(i, &pairColors[i][0], &pairColors[i][1]);
+		if (pairColors[i][0] < 0) pairColors[i][0] = COLOR_WHITE;
+		if (pairColors[i][1] < 0) pairColors[i][1] = COLOR_BLACK;
+	}
+	chtype blank = getbkgd(stdscr);
+	char* out = viewport.ansi;
+	int foreground = -1;
+	int background = -1;
+	int cursor = -1;
+	
+	for (int y = 0; y < viewport.lines; y++) {
+		mvinchnstr(y, 0, viewport.row, viewport.cols);
+		for (int x = 0; x < viewport.cols; x++) {
+			unsigned long long cell;
+			if (viewport.row[x] != blank) {
+				cell = ansiCell(viewport.row[x], viewport.row[x] & A_DIM ? MAX_LIGHT / 2 : MAX_LIGHT, pairColors);
+			} else if (viewport.halfBlocks) {
+				// the top pixel is the foreground of ▀ and the bottom pixel is its background
+				int top = (y * 2) * viewport.width + x;
+				int bottom = top + viewport.width;
+				unsigned long long topCell = ansiCell(viewport.frame[top], viewport.light[top], pairColors);
+				unsigned long long bottomCell = ansiCell(viewport.frame[bottom], viewport.light[bottom], pairColors);
+				int topColor = (topCell >> 48) == ' ' ? topCell & 0xffffff : (topCell >> 24) & 0xffffff;
+				int bottomColor = (bottomCell >> 48) == ' ' ? bottomCell & 0xffffff : (bottomCell >> 24) & 0xffffff;
+				cell = (1ULL << 48) | ((unsigned long long)topColor << 24) | bottomColor;
+			} else {
+				int pixel = (y / viewport.scale) * viewport.width + x / viewport.scale;
+				cell = ansiCell(viewport.frame[pixel], viewport.light[pixel], pairColors);
+			}
+			
+			int index = y * viewport.cols + x;
+			if (viewport.shown[index] == cell) continue;
+			viewport.shown[index] = cell;
+			
+			if (cursor != index) out += sprintf(out, "\x1b[%d;%dH", y + 1, x + 1);
+			cursor = index + 1;
+			int glyph = cell >> 48;
+			if ((int)(cell & 0xffffff) != background) {
+				background = cell & 0xffffff;
+				out = ansiColor(out, 1, background);
+			}
+			if (glyph != ' ' && (int)((cell >> 24) & 0xffffff) != foreground) {
+				foreground = (cell >> 24) & 0xffffff;
+				out = ansiColor(out, 0, foreground);
+			}
+			if (glyph == 1) {
+				memcpy(out, "▀", 3);
+				out += 3;
+			} else {
+				*out++ = glyph;
+			}
+		}
+	}
+	if (out != viewport.ansi) {
+		ssize_t written = write(viewport.terminal, viewport.ansi, out - viewport.ansi);
+		// a headless screen's socket already counts everything sent to it
+		if (viewport.terminal != profiler.outputSocket) PROFILE_OUTPUT(written);
+	}
+}
+
+// Sends the finished frame to the terminal through whichever output is in use
+void presentScreen() {
+	if (viewport.output == OUTPUT_CURSES) {
+		refresh();
+		waitForTerminalOutput();
+	} else {
+		presentAnsi();
+	}
+}
+
+// Starts ncurses drawing without a terminal so the renderer can be timed. with the profiler built in, what it sends goes to a socket
+// read by a thread that counts it, otherwise into /dev/null
+void openHeadlessScreen(int lines, int cols) {
+	FILE* out = NULL;
+#ifndef NO_PROFILER
+	int sockets[2];
+	pthread_t counter;
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sockets) == 0) {
+		if (pthread_create(&counter, NULL, countTerminalOutput, (void*)(intptr_t)sockets[1]) == 0) {
+			pthread_detach(counter);
+			out = fdopen(sockets[0], "w");
+			profiler.outputSocket = sockets[0];
+		} else {
+			close(sockets[0]);
+			close(sockets[1]);
+		}
+	}
+#endif
+	if (out == NULL) out = fopen("/dev/null", "w");
+	FILE* in = fopen("/dev/null", "r");
+	profiler.terminalFd = fileno(out);
+	set_term(newterm("xterm-256color", out, in));
+	resizeterm(lines, cols);
+	initColors();
+	setViewport(lines, cols, 1, 0);
+}
+
+// ==================================================> FIXED POINT <==================================================
+
+// Orders the triangles from back to front like orderPoly, but on integer depth keys with a radix sort
+void orderPolyFixed(ChunkMesh mesh[NUM_CHUNKS], float screenCoords[NUM_CHUNKS][CHUNK_VERTICIES][3], int drawOrder[MAX_TRIANGLES], int numDraw) {
+	unsigned int* keys = arenaAlloc(&frameArena, numDraw * sizeof(unsigned int));
+	unsigned int* sortedKeys = arenaAlloc(&frameArena, numDraw * sizeof(unsigned int));
+	int* sortedOrder = arenaAlloc(&frameArena, numDraw * sizeof(int));
+	int counts[4][256] = {{0}};
+	
+	// the summed depth of the corners in 16.16, flipped so the farthest triangle has the smallest key
+	for (int i = 0; i < numDraw; i++) {
+		int c = drawOrder[i] / CHUNK_TRIANGLES;
+		unsigned char* triangle = mesh[c].triangles[drawOrder[i] % CHUNK_TRIANGLES];
+		double depth = ((double)screenCoords[c][triangle[0]][2] + screenCoords[c][triangle[1]][2] + screenCoords[c][triangle[2]][2]) * FIXED_ONE;
+		if (depth > INT_MAX) depth = INT_MAX;
+		if (depth < -INT_MAX) depth = -INT_MAX;
+		keys[i] = ~((unsigned int)(int)depth ^ 0x80000000u);
+		for (int b = 0; b < 4; b++) counts[b][(keys[i] >> (b * 8)) & 255]++;
+	}
+	
+	// one stable counting pass per byte, skipping bytes that are the same for every triangle
+	for (int b = 0; b < 4; b++) {
+		if (numDraw == 0 || counts[b][(keys[0] >> (b * 8)) & 255] == numDraw) continue;
+		int start = 0;
+		for (int i = 0; i < 256; i++) {
+			int count = counts[b][i];
+			counts[b][i] = start;
+			start += count;
+		}
+		for (int i = 0; i < numDraw; i++) {
+			int slot = counts[b][(keys[i] >> (b * 8)) & 255]++;
+			sortedKeys[slot] = keys[i];
+			sortedOrder[slot] = drawOrder[i];
+		}
+		memcpy(keys, sortedKeys, numDraw * sizeof(unsigned int));
+		memcpy(drawOrder, sortedOrder, numDraw * sizeof(int));
+	}
+}
+
+// Turns a depth into the 1/z key the fixed point rasterizer tests. depths at or in front of the near plane get the nearest key
+unsigned int depthToKey(double depth) {
+	if (depth < NEAR_PLANE) depth = NEAR_PLANE;
+	return (unsigned int)(DEPTH_KEY_ONE / llround(depth * FIXED_ONE));
+}
+
+// Copies the triangles into fixed point draw commands in draw order
+void buildFixedCommands(ChunkMesh mesh[NUM_CHUNKS], float screenCoords[NUM_CHUNKS][CHUNK_VERTICIES][3], int drawOrder[MAX_TRIANGLES], int numDraw, FixedCommand commands[MAX_TRIANGLES]) {
+	// cells are counted from the middle of the framebuffer the same way fillPolygon does
+	double scaleX = (double)(viewport.width / 2) * FIXED_ONE;
+	double scaleY = (double)(viewport.height / 2) * FIXED_ONE;
+	for (int i = 0; i < numDraw; i++) {
+		int c = drawOrder[i] / CHUNK_TRIANGLES;
+		int t = drawOrder[i] % CHUNK_TRIANGLES;
+		FaceStyle* face = &mesh[c].faces[t / 2];
+		FixedCommand* command = &commands[i];
+		float* corners[3];
+		double largest = 0;
+		int near = 0;
+		for (int j = 0; j < 3; j++) {
+			corners[j] = screenCoords[c][mesh[c].triangles[t][j]];
+			if (corners[j][2] <= NEAR_PLANE) near = 1;
+			if (fabs(corners[j][0] * scaleX) > largest) largest = fabs(corners[j][0] * scaleX);
+			if (fabs(corners[j][1] * scaleY) > largest) largest = fabs(corners[j][1] * scaleY);
+		}
+		
+		// triangles too big on screen lose fraction bits until they fit
+		int shift = 0;
+		while (largest / (1 << shift) >= FIXED_LIMIT && shift < FIXED_SHIFT) shift++;
+		if (near || largest / (1 << shift) >= FIXED_LIMIT) {
+			for (int j = 0; j < 3; j++) memcpy(command->points[j], corners[j], sizeof(command->points[j]));
+			command->shift = -1;
+		} else {
+			for (int j = 0; j < 3; j++) {
+				command->fixedPoints[j][0] = (int)lround(corners[j][0] * scaleX / (1 << shift));
+				command->fixedPoints[j][1] = (int)lround(corners[j][1] * scaleY / (1 << shift));
+				command->fixedPoints[j][2] = (int)depthToKey(corners[j][2]);
+			}
+			command->shift = shift;
+		}
+		command->color = face->color;
+		command->glyph = face->glyph;
+		command->light = face->light;
+	}
+}
+
+// Fills a triangle using integer edge functions stepped across each row and an integer depth test on 1/z keys
+int fillPolygonFixed(int polygon[3][3], int shift, int color, char draw, int light) {
+	int width = viewport.width;
+	int height = viewport.height;
+	int bits = FIXED_SHIFT - shift;
+	long long one = 1LL << bits;
+	long long x[3], y[3];
+	int v[3] = {0, 1, 2};
+	
+	// edge functions are positive inside a counterclockwise triangle, so clockwise ones are walked the other way round
+	long long area = ((long long)polygon[1][0] - polygon[0][0]) * ((long long)polygon[2][1] - polygon[0][1]) - ((long long)polygon[1][1] - polygon[0][1]) * ((long long)polygon[2][0] - polygon[0][0]);
+	if (area == 0) return 0;
+	if (area < 0) {
+		v[1] = 2;
+		v[2] = 1;
+		area = -area;
+	}
+	for (int i = 0; i < 3; i++) {
+		x[i] = polygon[v[i]][0];
+		y[i] = polygon[v[i]][1];
+	}
+	
+	// bounding box in whole cells, clamped to the framebuffer
+	long long minX = x[0], maxX = x[0], minY = y[0], maxY = y[0];
+	for (int i = 1; i < 3; i++) {
+		if (x[i] < minX) minX = x[i];
+		if (x[i] > maxX) maxX = x[i];
+		if (y[i] < minY) minY = y[i];
+		if (y[i] > maxY) maxY = y[i];
+	}
+	int left = (int)((minX + one - 1) >> bits);
+	int right = (int)(maxX >> bits);
+	int bottom = (int)((minY + one - 1) >> bits);
+	int top = (int)(maxY >> bits);
+	if (left < -width / 2 + 1) left = -width / 2 + 1;
+	if (right > width / 2) right = width / 2;
+	if (bottom < -height / 2) bottom = -height / 2;
+	if (top > height / 2 - 1) top = height / 2 - 1;
+	if (left > right || bottom > top) return 0;
+	
+	// edge i runs from corner i to the next one. a cell exactly on an edge belongs to one of the two triangles sharing it,
+	// the one the edge goes up (or left) in, so shared edges are never filled twice
+	long long edge[3], stepX[3], stepY[3];
+	for (int i = 0; i < 3; i++) {
+		int next = (i + 1) % 3;
+		long long dx = x[next] - x[i];
+		long long dy = y[next] - y[i];
+		int owned = dy > 0 || (dy == 0 && dx < 0);
+		edge[i] = dx * (((long long)bottom << bits) - y[i]) - dy * (((long long)left << bits) - x[i]) - !owned;
+		stepX[i] = -dy * one;
+		stepY[i] = dx * one;
+	}
+	
+	// 1/z changes evenly across the screen. its slope is worked out once and then stepped in 16 bit fractions of a key
+	double keySlopeX = ((double)(polygon[v[1]][2] - polygon[v[0]][2]) * (y[2] - y[0]) - (double)(polygon[v[2]][2] - polygon[v[0]][2]) * (y[1] - y[0])) / area * one;
+	double keySlopeY = ((double)(polygon[v[2]][2] - polygon[v[0]][2]) * (x[1] - x[0]) - (double)(polygon[v[1]][2] - polygon[v[0]][2]) * (x[2] - x[0])) / area * one;
+	long long keyStepX = llround(keySlopeX * FIXED_ONE);
+	long long keyStepY = llround(keySlopeY * FIXED_ONE);
+	long long rowKey = llround((polygon[v[0]][2] + keySlopeX * ((double)((long long)left << bits) - x[0]) / one + keySlopeY * ((double)((long long)bottom << bits) - y[0]) / one) * FIXED_ONE);
+	
+	chtype cell = faceCell(color, draw, light);
+	
+	int filled = 0;
+	for (int j = bottom; j <= top; j++) {
+		long long e0 = edge[0], e1 = edge[1], e2 = edge[2];
+		long long key = rowKey;
+		int index = (-j + height / 2 - 1) * width + left + width / 2 - 1;
+		for (int i = left; i <= right; i++, index++) {
+			if ((e0 | e1 | e2) >= 0) {
+				// a key more than 1/1024th smaller than the one stored is behind it
+				unsigned int depth = key > 0 ? (unsigned int)(key >> FIXED_SHIFT) : 0;
+				unsigned int stored = viewport.depthKey[index];
+				if (depth + (stored >> 10) >= stored) {
+					viewport.depthKey[index] = depth;
+					viewport.frame[index] = cell;
+					viewport.light[index] = light;
+					filled++;
+				}
+			}
+			e0 += stepX[0];
+			e1 += stepX[1];
+			e2 += stepX[2];
+			key += keyStepX;
+		}
+		edge[0] += stepY[0];
+		edge[1] += stepY[1];
+		edge[2] += stepY[2];
+		rowKey += keyStepY;
+	}
+	return filled;
+}
+
+// Draws fixed point draw commands into the framebuffer and puts it on the screen. the triangles left to fillPolygon write their depths
+// as keys, so the fixed point ones drawn after them are tested against them. ones reaching behind the camera have no depth and are
+// left to the draw order, the same as in drawAll
+int drawAllFixed(FixedCommand commands[MAX_TRIANGLES], int numDraw) {
+	int filled = 0;
+	clearViewport();
+	memset(viewport.depthKey, 0, viewport.width * viewport.height * sizeof(unsigned int));
+	viewport.keyedDepth = 1;
+	for (int i = 0; i < numDraw; i++) {
+		if (commands[i].shift < 0) filled += fillPolygon(commands[i].points, commands[i].color, commands[i].glyph, commands[i].light);
+		else filled += fillPolygonFixed(commands[i].fixedPoints, commands[i].shift, commands[i].color, commands[i].glyph, commands[i].light);
+	}
+	presentViewport();
+	attron(COLOR_PAIR(15));
+	move(LINES / 2, COLS / 2);
+	addch('+');
+	attroff(COLOR_PAIR(15));
+	return filled;
+}
+
+// ==================================================> BRICKMAP <==================================================
+
+// Rebuilds the brickmap from every block in a world
+void buildBrickMap(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE]) {
+	brickmap.world = blockPositions;
+	brickmap.occupied = 0;
+	memset(brickmap.cells, 0, sizeof(brickmap.cells));
+	for (int x = 0; x < WORLD_SIZE; x++) {
+		for (int y = 0; y < WORLD_SIZE; y++) {
+			for (int z = 0; z < WORLD_SIZE; z++) {
+				if (blockPositions[x][y][z] != -1) brickmap.cells[brickIndex(x, y, z)] |= 1ULL << brickBit(x, y, z);
+			}
+		}
+	}
+	for (int i = 0; i < NUM_BRICKS; i++) {
+		if (brickmap.cells[i]) brickmap.occupied |= 1ULL << i;
+	}
+}
+
+// Sets the bit of one cell to match the block that is in it now
+void updateBrickMap(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int x, int y, int z) {
+	if (brickmap.world != blockPositions) {
+		buildBrickMap(blockPositions);
+		return;
+	}
+	int brick = brickIndex(x, y, z);
+	if (blockPositions[x][y][z] != -1) brickmap.cells[brick] |= 1ULL << brickBit(x, y, z);
+	else brickmap.cells[brick] &= ~(1ULL << brickBit(x, y, z));
+	if (brickmap.cells[brick]) brickmap.occupied |= 1ULL << brick;
+	else brickmap.occupied &= ~(1ULL << brick);
+}
+
+// The brickmap of a world, built first if the last one was for a different world
+BrickMap* brickMapFor(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE]) {
+	if (brickmap.world != blockPositions) buildBrickMap(blockPositions);
+	return &brickmap;
+}
+
+// Which brick a cell is in. bricks are numbered like chunks
+int brickIndex(int x, int y, int z) {
+	return ((x / BRICK_SIZE) * BRICKS + y / BRICK_SIZE) * BRICKS + z / BRICK_SIZE;
+}
+
+// Which bit of its brick's word a cell is
+int brickBit(int x, int y, int z) {
+	return ((x % BRICK_SIZE) * BRICK_SIZE + y % BRICK_SIZE) * BRICK_SIZE + z % BRICK_SIZE;
+}
+
+// Whether a cell inside the world has a block in it
+int brickSolid(BrickMap* bricks, int x, int y, int z) {
+	return bricks->cells[brickIndex(x, y, z)] >> brickBit(x, y, z) & 1;
+}
+
+// ==================================================> HEIGHTMAP <==================================================
+
+// Rebuilds the heightmap from every column of a world
+void buildHeightMap(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE]) {
+	heightmap.world = blockPositions;
+	memset(heightmap.columns, 0, sizeof(heightmap.columns));
+	heightmap.highest = -1;
+	for (int x = 0; x < WORLD_SIZE; x++) {
+		for (int z = 0; z < WORLD_SIZE; z++) {
+			int y = WORLD_SIZE - 1;
+			while (y >= 0 && blockPositions[x][y][z] == -1) y--;
+			heightmap.height[x][z] = y;
+			heightmap.surface[x][z] = y >= 0 ? blockPositions[x][y][z] : -1;
+			heightmap.columns[y + 1]++;
+			if (y > heightmap.highest) heightmap.highest = y;
+		}
+	}
+}
+
+// Keeps a column right after one of its blocks changed. only breaking its top block has to look down the column for the next one
+void updateHeightMap(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int x, int y, int z) {
+	if (heightmap.world != blockPositions) {
+		buildHeightMap(blockPositions);
+		return;
+	}
+	int height = heightmap.height[x][z];
+	if (blockPositions[x][y][z] != -1 && y >= height) {
+		setColumnHeight(&heightmap, x, z, y);
+	} else if (blockPositions[x][y][z] == -1 && y == height) {
+		while (height >= 0 && blockPositions[x][height][z] == -1) height--;
+		setColumnHeight(&heightmap, x, z, height);
+	}
+	height = heightmap.height[x][z];
+	heightmap.surface[x][z] = height >= 0 ? blockPositions[x][height][z] : -1;
+}
+
+// The heightmap of a world, built first if the last one was for a different world
+HeightMap* heightMapFor(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE]) {
+	if (heightmap.world != blockPositions) buildHeightMap(blockPositions);
+	return &heightmap;
+}
+
+// Moves a column to a new height, and the tallest column with it
+void setColumnHeight(HeightMap* heights, int x, int z, int height) {
+	heights->columns[heights->height[x][z] + 1]--;
+	heights->columns[height + 1]++;
+	heights->height[x][z] = height;
+	if (height > heights->highest) heights->highest = height;
+	while (heights->highest >= 0 && heights->columns[heights->highest + 1] == 0) heights->highest--;
+}
+
+// The y of the highest block in a column, or -1 if it is empty
+int columnHeight(HeightMap* heights, int x, int z) {
+	return heights->height[x][z];
+}
+
+// The block on top of a column, or -1 if it is empty
+int surfaceBlock(HeightMap* heights, int x, int z) {
+	return heights->surface[x][z];
+}
+
+// The y of the highest block in the world, or -1 if it is empty
+int highestBlock(HeightMap* heights) {
+	return heights->highest;
+}
+
+// ==================================================> RAYMARCH <==================================================
+
+// Walks a ray through the grid one block at a time (DDA) to the first face between air and a block, crossing empty bricks in one step.
+// direction is in blocks per game unit of depth, so the distance it returns is the depth the rasterizer would use. without a brickmap every block is looked up in blockPositions
+int castRay(double origin[3], double direction[3], int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], BrickMap* bricks, LightMap* light, chtype* cell, int* cellLight, float* depth) {
+	double enter = 0, leave = INFINITY;
+	int enterAxis = -1;
+	
+	// clips the ray to the world box. outside the world counts as air so the faces around its edge are hit like the mesh draws them
+	for (int a = 0; a < 3; a++) {
+		if (direction[a] == 0) {
+			if (origin[a] < 0 || origin[a] >= WORLD_SIZE) return 0;
+			continue;
+		}
+		double near = ((direction[a] > 0 ? 0 : WORLD_SIZE) - origin[a]) / direction[a];
+		double far = ((direction[a] > 0 ? WORLD_SIZE : 0) - origin[a]) / direction[a];
+		if (near > enter) {
+			enter = near;
+			enterAxis = a;
+		}
+		if (far < leave) leave = far;
+	}
+	if (enter >= leave) return 0;
+	
+	int block[3], step[3];
+	double next[3], delta[3], inverse[3];
+	for (int a = 0; a < 3; a++) {
+		double position = origin[a] + direction[a] * enter;
+		block[a] = (int)floor(position);
+		if (a == enterAxis) block[a] = direction[a] > 0 ? 0 : WORLD_SIZE - 1;
+		if (block[a] < 0) block[a] = 0;
+		if (block[a] >= WORLD_SIZE) block[a] = WORLD_SIZE - 1;
+		step[a] = direction[a] > 0 ? 1 : -1;
+		inverse[a] = direction[a] != 0 ? 1 / direction[a] : 0;
+		delta[a] = direction[a] != 0 ? fabs(inverse[a]) : INFINITY;
+		next[a] = direction[a] != 0 ? ((block[a] + (direction[a] > 0 ? 1 : 0)) - origin[a]) / direction[a] : INFINITY;
+	}
+	
+	// a camera inside a block sees out of it, like the mesh which has no faces inside blocks
+	int inAir = enterAxis != -1 || blockPositions[block[0]][block[1]][block[2]] == -1;
+	int axis = enterAxis;
+	double distance = enter;
+	while (1) {
+		// a ray in the air leaves an empty brick through whichever of its far sides it reaches first
+		if (bricks && inAir && !(bricks->occupied >> brickIndex(block[0], block[1], block[2]) & 1)) {
+			distance = INFINITY;
+			for (int a = 0; a < 3; a++) {
+				if (direction[a] == 0) continue;
+				double side = ((block[a] / BRICK_SIZE + (step[a] > 0 ? 1 : 0)) * BRICK_SIZE - origin[a]) * inverse[a];
+				if (side < distance) {
+					distance = side;
+					axis = a;
+				}
+			}
+			for (int a = 0; a < 3; a++) {
+				int low = block[a] / BRICK_SIZE * BRICK_SIZE;
+				if (a == axis) {
+					block[a] = step[a] > 0 ? low + BRICK_SIZE : low - 1;
+				} else if (direction[a] != 0) {
+					block[a] = (int)(origin[a] + direction[a] * distance);
+					if (block[a] < low) block[a] = low;
+					if (block[a] >= low + BRICK_SIZE) block[a] = low + BRICK_SIZE - 1;
+				}
+				if (direction[a] != 0) next[a] = ((block[a] + (step[a] > 0 ? 1 : 0)) - origin[a]) * inverse[a];
+			}
+			if (block[axis] < 0 || block[axis] >= WORLD_SIZE) return 0;
+			continue;
+		}
+		
+		int solid = bricks ? brickSolid(bricks, block[0], block[1], block[2]) : blockPositions[block[0]][block[1]][block[2]] != -1;
+		if (!solid) {
+			inAir = 1;
+		} else if (inAir) {
+			break;
+		}
+		axis = next[0] < next[1] ? (next[0] < next[2] ? 0 : 2) : (next[1] < next[2] ? 1 : 2);
+		distance = next[axis];
+		next[axis] += delta[axis];
+		block[axis] += step[axis];
+		if (block[axis] < 0 || block[axis] >= WORLD_SIZE) return 0;
+	}
+	
+	// faces are numbered -x, +x, -y, +y, -z, +z like addFace, and the ray hits the side facing back along it
+	int face = axis * 2 + (step[axis] > 0 ? 0 : 1);
+	int type = blockPositions[block[0]][block[1]][block[2]];
+	int color = blockColors[type][face == 3 ? 0 : (face == 2 ? 2 : 1)];
+	int lit = faceLight(light, block[0] - (axis == 0 ? step[0] : 0), block[1] - (axis == 1 ? step[1] : 0), block[2] - (axis == 2 ? step[2] : 0));
+	*cell = faceCell(color, color > 0 ? ' ' : "@@##$$"[face], lit);
+	*cellLight = lit;
+	*depth = distance;
+	return 1;
+}
+
+// Casts the rays for every step-th row of the framebuffer from first
+int raymarchRows(int first, int step) {
+	int width = viewport.width;
+	int height = viewport.height;
+	int filled = 0;
+	for (int row = first; row < height; row += step) {
+		// cells are spread over the screen the same way fillPolygon counts them from the middle
+		double y = (double)(height / 2 - 1 - row) / (height / 2);
+		for (int col = 0; col < width; col++) {
+			double x = (double)(col - width / 2 + 1) / (width / 2);
+			double direction[3];
+			for (int a = 0; a < 3; a++) direction[a] = raymarcher.axes[2][a] + x * raymarcher.axes[0][a] + y * raymarcher.axes[1][a];
+			int index = row * width + col;
+			int lit;
+			if (castRay(raymarcher.origin, direction, raymarcher.blockPositions, raymarcher.bricks, raymarcher.light, &viewport.frame[index], &lit, &viewport.depth[index])) {
+				viewport.light[index] = lit;
+				filled++;
+			}
+		}
+	}
+	return filled;
+}
+
+// Worker threads draw their rows each time the main thread reaches the start barrier
+void* raymarchWorker(void* id) {
+	int thread = (int)(long)id;
+	while (1) {
+		pthread_barrier_wait(&raymarcher.start);
+		if (raymarcher.stopping) break;
+		raymarcher.filled[thread] = raymarchRows(thread, raymarcher.workers + 1);
+		pthread_barrier_wait(&raymarcher.finish);
+	}
+	return NULL;
+}
+
+// Starts the worker threads. the main thread is one of the threads, so threads - 1 workers are started
+void startRaymarch(int threads) {
+	if (threads < 1) threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (threads < 1) threads = 1;
+	if (threads > MAX_RAY_THREADS) threads = MAX_RAY_THREADS;
+	stopRaymarch();
+	raymarcher.threads = threads;
+	raymarcher.workers = 0;
+	if (threads == 1) return;
+	pthread_barrier_init(&raymarcher.start, NULL, threads);
+	pthread_barrier_init(&raymarcher.finish, NULL, threads);
+	for (int i = 1; i < threads; i++) {
+		if (pthread_create(&raymarcher.worker[i], NULL, raymarchWorker, (void*)(long)i) != 0) break;
+		raymarcher.workers++;
+	}
+	// the barriers were sized for every thread, so they are made again if some could not start
+	if (raymarcher.workers != threads - 1) {
+		int started = raymarcher.workers;
+		raymarcher.workers = threads - 1;
+		stopRaymarch();
+		startRaymarch(started + 1);
+	}
+}
+
+// Stops the worker threads
+void stopRaymarch() {
+	if (raymarcher.workers == 0) return;
+	raymarcher.stopping = 1;
+	pthread_barrier_wait(&raymarcher.start);
+	for (int i = 1; i <= raymarcher.workers; i++) pthread_join(raymarcher.worker[i], NULL);
+	pthread_barrier_destroy(&raymarcher.start);
+	pthread_barrier_destroy(&raymarcher.finish);
+	raymarcher.stopping = 0;
+	raymarcher.workers = 0;
+}
+
+// Draws the world by casting a ray for every cell of the framebuffer and puts it on the screen
+int drawRaymarch(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], LightMap* light, double playerPos[3], double playerRot[3]) {
+	double matrixConversions[5][6];
+	double (*m)[6] = matrixConversions;
+	cameraMatrix(playerPos, playerRot, matrixConversions);
+	if (raymarcher.threads == 0) startRaymarch(0);
+	clearViewport();
+	
+	// the camera rotations turned back (they are transposed) give the world direction of each camera axis.
+	// screen x and y are scaled back out first, and everything is halved to go from game units to blocks
+	double camera[3][3] = {{1 / m[4][0], 0, 0}, {0, 1 / m[4][2], 0}, {0, 0, 1}};
+	for (int a = 0; a < 3; a++) {
+		double* v = camera[a];
+		double x = v[0];
+		double y = m[3][2] * v[1] + m[3][4] * v[2];
+		double z = m[3][3] * v[1] + m[3][5] * v[2];
+		double turnedX = m[2][0] * x + m[2][4] * z;
+		double turnedZ = m[2][1] * x + m[2][5] * z;
+		raymarcher.axes[a][0] = (m[1][0] * turnedX + m[1][2] * y) / 2;
+		raymarcher.axes[a][1] = (m[1][1] * turnedX + m[1][3] * y) / 2;
+		raymarcher.axes[a][2] = turnedZ / 2;
+	}
+	for (int a = 0; a < 3; a++) raymarcher.origin[a] = playerPos[a] / 2;
+	raymarcher.blockPositions = blockPositions;
+	raymarcher.bricks = brickMapFor(blockPositions);
+	raymarcher.light = light;
+	
+	int filled;
+	if (raymarcher.workers > 0) {
+		pthread_barrier_wait(&raymarcher.start);
+		filled = raymarchRows(0, raymarcher.workers + 1);
+		pthread_barrier_wait(&raymarcher.finish);
+		for (int i = 1; i <= raymarcher.workers; i++) filled += raymarcher.filled[i];
+	} else {
+		filled = raymarchRows(0, 1);
+	}
+	
+	presentViewport();
+	attron(COLOR_PAIR(15));
+	move(LINES / 2, COLS / 2);
+	addch('+');
+	attroff(COLOR_PAIR(15));
+	return filled;
+}
+
+// ==================================================> BLOCK UPDATES <==================================================
+
+// Starts the update queue and the brickmap for a world. blocks that can move are woken up once so a loaded world settles
+void initBlockUpdates(UpdateQueue* updates, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE]) {
+	int* blocks = &blockPositions[0][0][0];
+	free(updates->heap);
+	memset(updates, 0, sizeof(*updates));
+	buildBrickMap(blockPositions);
+	for (int cell = 0; cell < NUM_CELLS; cell++) {
+		if (blocks[cell] == BLOCK_WATER) updates->waterLevel[cell] = WATER_SOURCE;
+		if (isActiveBlock(blocks[cell])) scheduleUpdate(updates, cell, 1);
+	}
+}
+
+// Blocks that can change on their own. every other block only changes through editBlock
+int isActiveBlock(int block) {
+	return block == BLOCK_SAND || block == BLOCK_GRAVEL || block == BLOCK_WATER;
+}
+
+// Adds a cell to the queue to be updated delay ticks from now. a cell already waiting for an earlier tick is left alone
+void scheduleUpdate(UpdateQueue* updates, int cell, int delay) {
+	long tick = updates->tick + delay;
+	if (updates->scheduled[cell] != 0 && updates->scheduled[cell] <= tick) return;
+	updates->scheduled[cell] = tick;
+	
+	if (updates->count == updates->capacity) {
+		updates->capacity = updates->capacity ? updates->capacity * 2 : 256;
+		updates->heap = realloc(updates->heap, updates->capacity * sizeof(BlockUpdate));
+	}
+	
+	// binary heap with the earliest tick on top
+	int i = updates->count++;
+	while (i > 0 && updates->heap[(i - 1) / 2].tick > tick) {
+		updates->heap[i] = updates->heap[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	updates->heap[i].tick = tick;
+	updates->heap[i].cell = cell;
+}
+
+// Takes the earliest update off the heap
+BlockUpdate popUpdate(UpdateQueue* updates) {
+	BlockUpdate top = updates->heap[0];
+	BlockUpdate last = updates->heap[--updates->count];
+	int i = 0;
+	while (i * 2 + 1 < updates->count) {
+		int child = i * 2 + 1;
+		if (child + 1 < updates->count && updates->heap[child + 1].tick < updates->heap[child].tick) child++;
+		if (updates->heap[child].tick >= last.tick) break;
+		updates->heap[i] = updates->heap[child];
+		i = child;
+	}
+	updates->heap[i] = last;
+	return top;
+}
+
+// Wakes up the moving blocks around a changed cell and marks the chunks whose mesh it touches
+void blockChanged(UpdateQueue* updates, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int x, int y, int z) {
+	int offsets[7][3] = {{0,0,0}, {-1,0,0}, {1,0,0}, {0,-1,0}, {0,1,0}, {0,0,-1}, {0,0,1}};
+	int cell = (x * WORLD_SIZE + y) * WORLD_SIZE + z;
+	updateBrickMap(blockPositions, x, y, z);
+	updateHeightMap(blockPositions, x, y, z);
+	
+	// placed water is a source, anything else has no water in it
+	if (blockPositions[x][y][z] != BLOCK_WATER) updates->waterLevel[cell] = 0;
+	else if (updates->waterLevel[cell] == 0) updates->waterLevel[cell] = WATER_SOURCE;
+	
+	for (int i = 0; i < 7; i++) {
+		int nx = x + offsets[i][0];
+		int ny = y + offsets[i][1];
+		int nz = z + offsets[i][2];
+		if (nx < 0 || ny < 0 || nz < 0 || nx >= WORLD_SIZE || ny >= WORLD_SIZE || nz >= WORLD_SIZE) continue;
+		int block = blockPositions[nx][ny][nz];
+		if (isActiveBlock(block)) scheduleUpdate(updates, (nx * WORLD_SIZE + ny) * WORLD_SIZE + nz, block == BLOCK_WATER ? WATER_DELAY : FALL_DELAY);
+		updates->dirty[((nx / CHUNK_SIZE) * CHUNKS + ny / CHUNK_SIZE) * CHUNKS + nz / CHUNK_SIZE] = 1;
+	}
+	if (updates->numChanged < NUM_CELLS) updates->changed[updates->numChanged++] = cell;
+	if (updates->light) updateLight(updates->light, blockPositions, x, y, z, updates->dirty);
+}
+
+// Runs one block tick: every update that is due, up to budget of them. the rest are first in line next tick
+int runBlockUpdates(UpdateQueue* updates, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int budget) {
+	int done = 0;
+	updates->tick++;
+	while (updates->count > 0 && updates->heap[0].tick <= updates->tick && done < budget) {
+		BlockUpdate next = popUpdate(updates);
+		// skips updates that were moved to an earlier tick after being queued
+		if (updates->scheduled[next.cell] != next.tick) continue;
+		updates->scheduled[next.cell] = 0;
+		updateBlock(updates, blockPositions, next.cell);
+		done++;
+	}
+	updates->processed += done;
+	return done;
+}
+
+// Runs the block ticks that fit in the time since the last frame (in 60ths of a second like deltaTime)
+int advanceBlockUpdates(UpdateQueue* updates, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], double elapsed) {
+	int done = 0;
+	int ticks = 0;
+	updates->clock += elapsed;
+	while (updates->clock >= 60.0 / BLOCK_TICK_RATE && ticks < 4) {
+		done += runBlockUpdates(updates, blockPositions, TICK_BUDGET);
+		updates->clock -= 60.0 / BLOCK_TICK_RATE;
+		ticks++;
+	}
+	// a long frame skips ticks instead of running all of them at once
+	if (ticks == 4) updates->clock = 0;
+	return done;
+}
+
+// Moves a falling block down or spreads water out of one cell
+void updateBlock(UpdateQueue* updates, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int cell) {
+	int x = cell / (WORLD_SIZE * WORLD_SIZE);
+	int y = cell / WORLD_SIZE % WORLD_SIZE;
+	int z = cell % WORLD_SIZE;
+	int block = blockPositions[x][y][z];
+	int level = updates->waterLevel[cell];
+	
+	// sand and gravel fall through air and sink through water
+	if (block == BLOCK_SAND || block == BLOCK_GRAVEL) {
+		if (y == 0 || (blockPositions[x][y-1][z] != -1 && blockPositions[x][y-1][z] != BLOCK_WATER)) return;
+		blockPositions[x][y][z] = blockPositions[x][y-1][z];
+		blockPositions[x][y-1][z] = block;
+		updates->waterLevel[cell] = updates->waterLevel[cell - WORLD_SIZE];
+		updates->waterLevel[cell - WORLD_SIZE] = 0;
+		blockChanged(updates, blockPositions, x, y, z);
+		blockChanged(updates, blockPositions, x, y - 1, z);
+		
+	// water falls at full strength and otherwise spreads sideways, getting weaker each block
+	} else if (block == BLOCK_WATER) {
+		int sides[4][2] = {{-1,0}, {1,0}, {0,-1}, {0,1}};
+		if (y > 0 && blockPositions[x][y-1][z] == -1) {
+			blockPositions[x][y-1][z] = BLOCK_WATER;
+			updates->waterLevel[cell - WORLD_SIZE] = WATER_SOURCE;
+			blockChanged(updates, blockPositions, x, y - 1, z);
+			return;
+		}
+		if (y > 0 && blockPositions[x][y-1][z] == BLOCK_WATER) return;
+		for (int i = 0; i < 4 && level > 1; i++) {
+			int nx = x + sides[i][0];
+			int nz = z + sides[i][1];
+			if (nx < 0 || nz < 0 || nx >= WORLD_SIZE || nz >= WORLD_SIZE || blockPositions[nx][y][nz] != -1) continue;
+			blockPositions[nx][y][nz] = BLOCK_WATER;
+			updates->waterLevel[(nx * WORLD_SIZE + y) * WORLD_SIZE + nz] = level - 1;
+			blockChanged(updates, blockPositions, nx, y, nz);
+		}
+	}
+}
+
+// Rebuilds the mesh of every chunk a block change touched. returns how many were rebuilt
+int remeshDirty(UpdateQueue* updates, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], ChunkMesh mesh[NUM_CHUNKS]) {
+	int remeshed = 0;
+	for (int c = 0; c < NUM_CHUNKS; c++) {
+		if (!updates->dirty[c]) continue;
+		generateChunkMesh(blockPositions, &mesh[c], c / (CHUNKS * CHUNKS), c / CHUNKS % CHUNKS, c % CHUNKS, blockColors, updates->light);
+		updates->dirty[c] = 0;
+		remeshed++;
+	}
+	updates->numChanged = 0;
+	return remeshed;
+}
+
+// ==================================================> LIGHTING <==================================================
+
+// How much light a cell gives off by itself. sky light comes in from the top of the world and lamps light up around them
+int lightSource(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int channel, int cell) {
+	int block = (&blockPositions[0][0][0])[cell];
+	if (channel == LIGHT_SKY) return block == -1 && cell / WORLD_SIZE % WORLD_SIZE == WORLD_SIZE - 1 ? MAX_LIGHT : 0;
+	return block == BLOCK_LAMP ? MAX_LIGHT - 1 : 0;
+}
+
+// Lights the whole world from scratch with a flood fill from every light source. the air above each column of the heightmap
+// (rebuilt first, like the world is new) gets full sky light straight away instead of it being spread down one block at a time
+void computeLight(LightMap* light, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE]) {
+	buildHeightMap(blockPositions);
+	for (int channel = 0; channel < 2; channel++) {
+		unsigned char* level = light->level[channel];
+		int numAdd = 0;
+		memset(level, 0, NUM_CELLS);
+		if (channel == LIGHT_SKY) {
+			for (int x = 0; x < WORLD_SIZE; x++) {
+				for (int z = 0; z < WORLD_SIZE; z++) {
+					for (int y = WORLD_SIZE - 1; y > heightmap.height[x][z]; y--) {
+						int cell = (x * WORLD_SIZE + y) * WORLD_SIZE + z;
+						level[cell] = MAX_LIGHT;
+						light->addQueue[numAdd++] = cell;
+					}
+				}
+			}
+		} else {
+			for (int cell = 0; cell < NUM_CELLS; cell++) {
+				level[cell] = lightSource(blockPositions, channel, cell);
+				if (level[cell] > 0) light->addQueue[numAdd++] = cell;
+			}
+		}
+		spreadLight(light, blockPositions, channel, numAdd, NULL);
+	}
+}
+
+// Spreads light out of the cells in the add queue until it runs out. returns how many cells were visited
+int spreadLight(LightMap* light, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int channel, int numAdd, int dirty[NUM_CHUNKS]) {
+	static const int offsets[6][3] = {{-1,0,0}, {1,0,0}, {0,-1,0}, {0,1,0}, {0,0,-1}, {0,0,1}};
+	unsigned char* level = light->level[channel];
+	int* blocks = &blockPositions[0][0][0];
+	int visited = 0;
+	
+	// a cell only goes back in the queue when its light goes up, so each cell is queued at most MAX_LIGHT times
+	for (int i = 0; i < numAdd; i++) {
+		int cell = light->addQueue[i];
+		int x = cell / (WORLD_SIZE * WORLD_SIZE);
+		int y = cell / WORLD_SIZE % WORLD_SIZE;
+		int z = cell % WORLD_SIZE;
+		visited++;
+		for (int d = 0; d < 6; d++) {
+			int nx = x + offsets[d][0];
+			int ny = y + offsets[d][1];
+			int nz = z + offsets[d][2];
+			if (nx < 0 || ny < 0 || nz < 0 || nx >= WORLD_SIZE || ny >= WORLD_SIZE || nz >= WORLD_SIZE) continue;
+			int next = (nx * WORLD_SIZE + ny) * WORLD_SIZE + nz;
+			if (blocks[next] != -1) continue;
+			// sky light shines straight down without getting weaker
+			int spread = channel == LIGHT_SKY && d == 2 && level[cell] == MAX_LIGHT ? MAX_LIGHT : level[cell] - 1;
+			if (spread <= level[next]) continue;
+			level[next] = spread;
+			light->addQueue[numAdd++] = next;
+			if (dirty) lightChanged(dirty, nx, ny, nz);
+		}
+	}
+	return visited;
+}
+
+// Updates the light around a cell that was just changed. the work is limited to the cells its old and new light reached
+int updateLight(LightMap* light, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int x, int y, int z, int dirty[NUM_CHUNKS]) {
+	static const int offsets[6][3] = {{-1,0,0}, {1,0,0}, {0,-1,0}, {0,1,0}, {0,0,-1}, {0,0,1}};
+	int* blocks = &blockPositions[0][0][0];
+	int cell = (x * WORLD_SIZE + y) * WORLD_SIZE + z;
+	int visited = 0;
+	
+	for (int channel = 0; channel < 2; channel++) {
+		unsigned char* level = light->level[channel];
+		int numRemove = 0;
+		int numAdd = 0;
+		
+		// first takes away the light that came from this cell. lit cells at the edge of that area spread back in afterwards
+		if (level[cell] > 0) {
+			light->removeQueue[numRemove].cell = cell;
+			light->removeQueue[numRemove++].level = level[cell];
+			level[cell] = 0;
+			lightChanged(dirty, x, y, z);
+		}
+		for (int i = 0; i < numRemove; i++) {
+			int from = light->removeQueue[i].cell;
+			int fromLevel = light->removeQueue[i].level;
+			int fx = from / (WORLD_SIZE * WORLD_SIZE);
+			int fy = from / WORLD_SIZE % WORLD_SIZE;
+			int fz = from % WORLD_SIZE;
+			visited++;
+			for (int d = 0; d < 6; d++) {
+				int nx = fx + offsets[d][0];
+				int ny = fy + offsets[d][1];
+				int nz = fz + offsets[d][2];
+				if (nx < 0 || ny < 0 || nz < 0 || nx >= WORLD_SIZE || ny >= WORLD_SIZE || nz >= WORLD_SIZE) continue;
+				int next = (nx * WORLD_SIZE + ny) * WORLD_SIZE + nz;
+				int nextLevel = level[next];
+				if (nextLevel == 0) continue;
+				if (nextLevel < fromLevel || (channel == LIGHT_SKY && d == 2 && fromLevel == MAX_LIGHT)) {
+					level[next] = 0;
+					lightChanged(dirty, nx, ny, nz);
+					// sources keep shining even if light they got from here is gone
+					int source = lightSource(blockPositions, channel, next);
+					if (source > 0) {
+						level[next] = source;
+						light->addQueue[numAdd++] = next;
+					} else {
+						light->removeQueue[numRemove].cell = next;
+						light->removeQueue[numRemove++].level = nextLevel;
+					}
+				} else {
+					light->addQueue[numAdd++] = next;
+				}
+			}
+		}
+		
+		// then the cell's own light and, if it is air now, the light from around it spread again
+		int source = lightSource(blockPositions, channel, cell);
+		if (source > level[cell]) {
+			level[cell] = source;
+			light->addQueue[numAdd++] = cell;
+			lightChanged(dirty, x, y, z);
+		}
+		if (blocks[cell] == -1) {
+			for (int d = 0; d < 6; d++) {
+				int nx = x + offsets[d][0];
+				int ny = y + offsets[d][1];
+				int nz = z + offsets[d][2];
+				if (nx < 0 || ny < 0 || nz < 0 || nx >= WORLD_SIZE || ny >= WORLD_SIZE || nz >= WORLD_SIZE) continue;
+				int next = (nx * WORLD_SIZE + ny) * WORLD_SIZE + nz;
+				if (level[next] > 0) light->addQueue[numAdd++] = next;
+			}
+		}
+		visited += spreadLight(light, blockPositions, channel, numAdd, dirty);
+	}
+	
+	light->edits++;
+	light->lastWork = visited;
+	light->totalWork += visited;
+	if (visited > light->maxWork) light->maxWork = visited;
+	return visited;
+}
+
+// Marks the chunks with faces next to a cell whose light changed
+void lightChanged(int dirty[NUM_CHUNKS], int x, int y, int z) {
+	static const int offsets[7][3] = {{0,0,0}, {-1,0,0}, {1,0,0}, {0,-1,0}, {0,1,0}, {0,0,-1}, {0,0,1}};
+	for (int i = 0; i < 7; i++) {
+		int nx = x + offsets[i][0];
+		int ny = y + offsets[i][1];
+		int nz = z + offsets[i][2];
+		if (nx < 0 || ny < 0 || nz < 0 || nx >= WORLD_SIZE || ny >= WORLD_SIZE || nz >= WORLD_SIZE) continue;
+		dirty[((nx / CHUNK_SIZE) * CHUNKS + ny / CHUNK_SIZE) * CHUNKS + nz / CHUNK_SIZE] = 1;
+	}
+}
+
+// The light that falls on a face from the air cell in front of it. outside the world is always fully lit
+int faceLight(LightMap* light, int x, int y, int z) {
+	if (!light || x < 0 || y < 0 || z < 0 || x >= WORLD_SIZE || y >= WORLD_SIZE || z >= WORLD_SIZE) return MAX_LIGHT;
+	int cell = (x * WORLD_SIZE + y) * WORLD_SIZE + z;
+	return light->level[LIGHT_SKY][cell] > light->level[LIGHT_BLOCK][cell] ? light->level[LIGHT_SKY][cell] : light->level[LIGHT_BLOCK][cell];
+}
+
+// ==================================================> ENTITIES <==================================================
+
+// Whether a point (in blocks) is inside a block. outside the sides and bottom of the world counts as solid and above it is air
+int solidAt(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], double x, double y, double z) {
+	if (y >= WORLD_SIZE) return 0;
+	if (x < 0 || y < 0 || z < 0 || x >= WORLD_SIZE || z >= WORLD_SIZE) return 1;
+	if ((int)y > columnHeight(heightMapFor(blockPositions), (int)x, (int)z)) return 0;
+	return brickSolid(brickMapFor(blockPositions), (int)x, (int)y, (int)z);
+}
+
+// Checks if any of the points would be inside a block after moving distance blocks along one axis. used by the player and every entity
+int pointsCollide(double points[][3], int count, int axis, double distance, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE]) {
+	for (int i = 0; i < count; i++) {
+		double point[3] = {points[i][0], points[i][1], points[i][2]};
+		point[axis] += distance;
+		if (solidAt(blockPositions, point[0], point[1], point[2])) return 1;
+	}
+	return 0;
+}
+
+// Adds an entity standing still at a position. returns its number or -1 when the store is full
+int spawnEntity(EntityStore* entities, int kind, float x, float y, float z) {
+	if (entities->count == MAX_ENTITIES) return -1;
+	int i = entities->count++;
+	entities->kind[i] = kind;
+	entities->block[i] = -1;
+	entities->grounded[i] = 0;
+	entities->blocked[i] = 0;
+	entities->x[i] = x;
+	entities->y[i] = y;
+	entities->z[i] = z;
+	entities->vx[i] = entities->vy[i] = entities->vz[i] = 0;
+	entities->walkX[i] = entities->walkZ[i] = 0;
+	entities->halfWidth[i] = kind == ENTITY_MOB ? 0.3 : 0.125;
+	entities->height[i] = kind == ENTITY_MOB ? 0.9 : 0.25;
+	return i;
+}
+
+// Removes an entity by moving the last one into its place, so entity numbers change after a removal
+void removeEntity(EntityStore* entities, int i) {
+	int last = --entities->count;
+	entities->kind[i] = entities->kind[last];
+	entities->block[i] = entities->block[last];
+	entities->grounded[i] = entities->grounded[last];
+	entities->blocked[i] = entities->blocked[last];
+	entities->x[i] = entities->x[last];
+	entities->y[i] = entities->y[last];
+	entities->z[i] = entities->z[last];
+	entities->vx[i] = entities->vx[last];
+	entities->vy[i] = entities->vy[last];
+	entities->vz[i] = entities->vz[last];
+	entities->walkX[i] = entities->walkX[last];
+	entities->walkZ[i] = entities->walkZ[last];
+	entities->halfWidth[i] = entities->halfWidth[last];
+	entities->height[i] = entities->height[last];
+}
+
+// Random numbers for the entities. they have their own generator so replays and benchmarks always play out the same way
+int entityRandom(EntityStore* entities) {
+	entities->random = entities->random * 1103515245 + 12345;
+	return (entities->random >> 16) & 0x7fff;
+}
+
+// Puts mobs on top of the ground in random columns
+void spawnMobs(EntityStore* entities, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int seed, int count) {
+	entities->random = seed;
+	for (int i = 0; i < count; i++) {
+		int x = entityRandom(entities) % WORLD_SIZE;
+		int z = entityRandom(entities) % WORLD_SIZE;
+		int y = columnHeight(heightMapFor(blockPositions), x, z);
+		if (y == WORLD_SIZE - 1) continue;
+		spawnEntity(entities, ENTITY_MOB, x + 0.5, y + 1, z + 0.5);
+	}
+}
+
+// Drops a broken block as an item that pops up out of the middle of where it was
+void dropItem(EntityStore* entities, int block, int x, int y, int z) {
+	if (block < 0) return;
+	int i = spawnEntity(entities, ENTITY_ITEM, x + 0.5, y + 0.375, z + 0.5);
+	if (i == -1) return;
+	entities->block[i] = block;
+	entities->vx[i] = (entityRandom(entities) % 100 - 50) / 2000.0;
+	entities->vy[i] = 0.1;
+	entities->vz[i] = (entityRandom(entities) % 100 - 50) / 2000.0;
+}
+
+// The eight corners of an entity's box, pulled in slightly like the player's collision points. the bottom four come first
+void entityCorners(EntityStore* entities, int i, double corners[8][3]) {
+	double width = entities->halfWidth[i] - 0.001;
+	for (int c = 0; c < 8; c++) {
+		corners[c][0] = entities->x[i] + (c & 1 ? width : -width);
+		corners[c][1] = entities->y[i] + (c & 4 ? entities->height[i] - 0.001 : 0.001);
+		corners[c][2] = entities->z[i] + (c & 2 ? width : -width);
+	}
+}
+
+// Moves every entity by its velocity one axis at a time with the same point checks as the player, snapping to the block it hits
+void moveEntities(EntityStore* entities, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], double elapsed) {
+	double corners[8][3];
+	
+	// falling first, so entities land before they slide
+	for (int i = 0; i < entities->count; i++) {
+		double move = entities->vy[i] * elapsed;
+		entities->grounded[i] = 0;
+		if (move == 0) continue;
+		entityCorners(entities, i, corners);
+		if (move < 0 && pointsCollide(corners, 4, 1, move, blockPositions)) {
+			entities->y[i] = floor(corners[0][1] + move) + 1;
+			entities->vy[i] = 0;
+			entities->grounded[i] = 1;
+		} else if (move > 0 && pointsCollide(&corners[4], 4, 1, move, blockPositions)) {
+			entities->y[i] = floor(corners[4][1] + move) - entities->height[i];
+			entities->vy[i] = 0;
+		} else {
+			entities->y[i] += move;
+		}
+	}
+	
+	// then sideways, where hitting a wall stops the entity and marks it blocked
+	for (int i = 0; i < entities->count; i++) {
+		entities->blocked[i] = 0;
+		for (int axis = 0; axis < 3; axis += 2) {
+			float* position = axis == 0 ? entities->x : entities->z;
+			float* velocity = axis == 0 ? entities->vx : entities->vz;
+			double move = velocity[i] * elapsed;
+			if (move == 0) continue;
+			entityCorners(entities, i, corners);
+			if (pointsCollide(corners, 8, axis, move, blockPositions)) {
+				double width = entities->halfWidth[i];
+				if (move > 0) position[i] = floor(position[i] + width - 0.001 + move) - width;
+				else position[i] = floor(position[i] - width + 0.001 + move) + 1 + width;
+				velocity[i] = 0;
+				entities->blocked[i] = 1;
+			} else {
+				position[i] += move;
+			}
+		}
+	}
+}
+
+// Which hash bucket the 1 block grid cell holding a point goes in
+int entityBucket(float x, float y, float z) {
+	unsigned int cx = (int)floorf(x);
+	unsigned int cy = (int)floorf(y);
+	unsigned int cz = (int)floorf(z);
+	return ((cx * 73856093u) ^ (cy * 19349663u) ^ (cz * 83492791u)) & (HASH_BUCKETS - 1);
+}
+
+// Sorts the entities into the spatial hash by counting how many go in each bucket, then placing them
+void buildEntityHash(EntityStore* entities) {
+	memset(entities->bucketStart, 0, sizeof(entities->bucketStart));
+	for (int i = 0; i < entities->count; i++) {
+		entities->bucketStart[entityBucket(entities->x[i], entities->y[i], entities->z[i]) + 1]++;
+	}
+	for (int b = 0; b < HASH_BUCKETS; b++) {
+		entities->bucketStart[b + 1] += entities->bucketStart[b];
+		entities->bucketFill[b] = entities->bucketStart[b];
+	}
+	for (int i = 0; i < entities->count; i++) {
+		int bucket = entityBucket(entities->x[i], entities->y[i], entities->z[i]);
+		entities->sorted[entities->bucketFill[bucket]++] = i;
+	}
+}
+
+// Finds the entities whose box comes within radius of a point, using the hash built this tick. returns how many were put in found
+int queryEntities(EntityStore* entities, float x, float y, float z, float radius, int found[], int max) {
+	int buckets[64];
+	int numBuckets = 0;
+	int count = 0;
+	// entities are at most 1 block across and 1 tall, so half a block more to the sides and a block more below covers any box that reaches the radius
+	for (int cx = (int)floorf(x - radius - 0.5); cx <= (int)floorf(x + radius + 0.5); cx++) {
+		for (int cy = (int)floorf(y - radius - 1); cy <= (int)floorf(y + radius); cy++) {
+			for (int cz = (int)floorf(z - radius - 0.5); cz <= (int)floorf(z + radius + 0.5); cz++) {
+				// different cells can share a bucket, and each bucket is only searched once
+				int bucket = entityBucket(cx, cy, cz);
+				int seen = 0;
+				for (int b = 0; b < numBuckets; b++) if (buckets[b] == bucket) seen = 1;
+				if (seen || numBuckets == 64) continue;
+				buckets[numBuckets++] = bucket;
+				
+				for (int k = entities->bucketStart[bucket]; k < entities->bucketStart[bucket + 1]; k++) {
+					int j = entities->sorted[k];
+					entities->pairsChecked++;
+					float reach = radius + entities->halfWidth[j];
+					if (fabsf(entities->x[j] - x) > reach || fabsf(entities->z[j] - z) > reach) continue;
+					if (entities->y[j] > y + radius || entities->y[j] + entities->height[j] < y - radius) continue;
+					if (count < max) found[count++] = j;
+				}
+			}
+		}
+	}
+	return count;
+}
+
+// Pushes overlapping mobs apart. the push goes into their velocity so the block collisions still keep them out of walls
+void separateMobs(EntityStore* entities) {
+	int found[64];
+	for (int i = 0; i < entities->count; i++) {
+		if (entities->kind[i] != ENTITY_MOB) continue;
+		int count = queryEntities(entities, entities->x[i], entities->y[i] + entities->height[i] / 2, entities->z[i], entities->halfWidth[i], found, 64);
+		for (int k = 0; k < count; k++) {
+			int j = found[k];
+			if (j <= i || entities->kind[j] != ENTITY_MOB) continue;
+			float dx = entities->x[j] - entities->x[i];
+			float dz = entities->z[j] - entities->z[i];
+			float distance = sqrtf(dx * dx + dz * dz);
+			float overlap = entities->halfWidth[i] + entities->halfWidth[j] - distance;
+			if (overlap <= 0) continue;
+			if (distance < 0.001) {
+				dx = 1;
+				distance = 1;
+			}
+			float push = overlap / 4 / distance;
+			entities->vx[i] -= dx * push;
+			entities->vz[i] -= dz * push;
+			entities->vx[j] += dx * push;
+			entities->vz[j] += dz * push;
+		}
+	}
+}
+
+// Picks up the items near the player's feet. returns how many were picked up
+int collectItems(EntityStore* entities, double playerPos[3]) {
+	int found[64];
+	int count = queryEntities(entities, playerPos[0] / 2, playerPos[1] / 2 - 1.6, playerPos[2] / 2, 1, found, 64);
+	int collected = 0;
+	// removing moves the last entity into the gap, so the highest numbers are removed first
+	for (int k = count - 1; k >= 0; k--) {
+		for (int m = 0; m < k; m++) {
+			if (found[m] > found[k]) {
+				int swap = found[m];
+				found[m] = found[k];
+				found[k] = swap;
+			}
+		}
+		if (entities->kind[found[k]] != ENTITY_ITEM) continue;
+		removeEntity(entities, found[k]);
+		collected++;
+	}
+	entities->collected += collected;
+	return collected;
+}
+
+// Sets the speed of every entity for the next step: mobs wander and jump over blocks in their way, items slide to a stop and everything falls
+void steerEntities(EntityStore* entities, double elapsed) {
+	for (int i = 0; i < entities->count; i++) {
+		if (entities->kind[i] == ENTITY_MOB) {
+			// every couple of seconds a mob picks a new direction or stops
+			if (entityRandom(entities) % 120 == 0) {
+				int turn = entityRandom(entities);
+				double angle = turn % 360 / 180.0 * M_PI;
+				double speed = turn % 4 == 0 ? 0 : 0.03;
+				entities->walkX[i] = cos(angle) * speed;
+				entities->walkZ[i] = sin(angle) * speed;
+			}
+			entities->vx[i] = entities->walkX[i];
+			entities->vz[i] = entities->walkZ[i];
+			if (entities->blocked[i] && entities->vy[i] == 0) entities->vy[i] = 0.17;
+		} else if (entities->vy[i] == 0) {
+			// items slide to a stop on the ground
+			entities->vx[i] *= 0.8;
+			entities->vz[i] *= 0.8;
+		}
+		if (entities->vy[i] > -0.45) entities->vy[i] -= 0.01 * elapsed;
+	}
+}
+
+// Runs one step of every entity: they are steered, moved through the world and sorted into the spatial hash for the mob and item checks
+void updateEntities(EntityStore* entities, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], double playerPos[3], double elapsed) {
+	steerEntities(entities, elapsed);
+	buildEntityHash(entities);
+	separateMobs(entities);
+	moveEntities(entities, blockPositions, elapsed);
+	buildEntityHash(entities);
+	collectItems(entities, playerPos);
+}
+
+// Draws each entity as one character where its middle is on screen, unless the world in front of it is closer
+void drawEntities(EntityStore* entities, double playerPos[3], double playerRot[3], int blockColors[][3]) {
+	double matrixConversions[5][6];
+	cameraMatrix(playerPos, playerRot, matrixConversions);
+	int width = viewport.width;
+	int height = viewport.height;
+	for (int i = 0; i < entities->count; i++) {
+		double point[3] = {entities->x[i] * 2, (entities->y[i] + entities->height[i] / 2) * 2, entities->z[i] * 2};
+		transformPoint(matrixConversions, point);
+		if (point[2] <= 0.01) continue;
+		int pixelX = (int)(point[0] * (width / 2)) + width / 2 - 1;
+		int pixelY = (int)(-point[1] * (height / 2)) + height / 2 - 1;
+		if (pixelX < 0 || pixelX >= width || pixelY < 0 || pixelY >= height) continue;
+		// the fixed point rasterizer keeps 1/z keys instead of depths
+		int index = pixelY * width + pixelX;
+		if (viewport.keyedDepth ? depthToKey(point[2]) < viewport.depthKey[index] : point[2] > viewport.depth[index]) continue;
+		
+		int row = viewport.halfBlocks ? pixelY / 2 : pixelY * viewport.scale;
+		int col = pixelX * viewport.scale;
+		if (entities->kind[i] == ENTITY_MOB) mvaddch(row, col, 'M' | COLOR_PAIR(7));
+		else mvaddch(row, col, '*' | COLOR_PAIR(abs(blockColors[entities->block[i]][0])));
+	}
+}
+
+// ==================================================> EDITS <==================================================
+
+// Starts a new operation. anything that was undone can't be redone after this
+void beginEdit(EditLog* edits) {
+	if (edits->current < edits->numOperations) {
+		edits->numChanges = edits->operations[edits->current];
+		edits->numOperations = edits->current;
+	}
+	if (edits->numOperations == edits->operationCapacity) {
+		edits->operationCapacity = edits->operationCapacity ? edits->operationCapacity * 2 : 64;
+		edits->operations = realloc(edits->operations, edits->operationCapacity * sizeof(int));
+	}
+	edits->operations[edits->numOperations++] = edits->numChanges;
+	edits->current = edits->numOperations;
+}
+
+// Finishes the operation. one that didn't change anything is dropped so undo never does nothing
+void endEdit(EditLog* edits) {
+	if (edits->numOperations > 0 && edits->operations[edits->numOperations - 1] == edits->numChanges) {
+		edits->numOperations--;
+		edits->current = edits->numOperations;
+	}
+}
+
+// Remembers a cell that has to be written by the next delta save
+void markUnsaved(EditLog* edits, int cell) {
+	if (edits->isUnsaved[cell]) return;
+	edits->isUnsaved[cell] = 1;
+	edits->unsaved[edits->numUnsaved++] = cell;
+}
+
+// Changes one block as part of the current operation. the block updates and light see it, and its chunks are meshed again next frame
+void setBlock(EditLog* edits, UpdateQueue* updates, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int x, int y, int z, int block) {
+	if (x < 0 || y < 0 || z < 0 || x >= WORLD_SIZE || y >= WORLD_SIZE || z >= WORLD_SIZE) return;
+	if (blockPositions[x][y][z] == block) return;
+	if (edits->numChanges == edits->capacity) {
+		edits->capacity = edits->capacity ? edits->capacity * 2 : 1024;
+		edits->changes = realloc(edits->changes, edits->capacity * sizeof(BlockEdit));
+	}
+	int cell = (x * WORLD_SIZE + y) * WORLD_SIZE + z;
+	BlockEdit* change = &edits->changes[edits->numChanges++];
+	change->cell = cell;
+	change->before = blockPositions[x][y][z];
+	change->after = block;
+	blockPositions[x][y][z] = block;
+	blockChanged(updates, blockPositions, x, y, z);
+	markUnsaved(edits, cell);
+	edits->blocksEdited++;
+}
+
+// Sorts two corners into the lowest and highest corner of the box between them
+void regionBounds(int a[3], int b[3], int from[3], int to[3]) {
+	for (int i = 0; i < 3; i++) {
+		from[i] = a[i] < b[i] ? a[i] : b[i];
+		to[i] = a[i] < b[i] ? b[i] : a[i];
+	}
+}
+
+// Sets every block in a region to block, or only the ones that are match when match isn't ANY_BLOCK. returns how many changed
+int fillRegion(EditLog* edits, UpdateQueue* updates, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int a[3], int b[3], int block, int match) {
+	int from[3], to[3];
+	int changes = edits->numChanges;
+	regionBounds(a, b, from, to);
+	beginEdit(edits);
+	for (int x = from[0]; x <= to[0]; x++) {
+		for (int y = from[1]; y <= to[1]; y++) {
+			for (int z = from[2]; z <= to[2]; z++) {
+				if (match == ANY_BLOCK || blockPositions[x][y][z] == match) setBlock(edits, updates, blockPositions, x, y, z, block);
+			}
+		}
+	}
+	endEdit(edits);
+	return edits->numChanges - changes;
+}
+
+// Copies the blocks in a region into the clipboard
+void copyRegion(EditLog* edits, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int a[3], int b[3]) {
+	int from[3], to[3];
+	regionBounds(a, b, from, to);
+	for (int i = 0; i < 3; i++) edits->clipSize[i] = to[i] - from[i] + 1;
+	for (int x = 0; x < edits->clipSize[0]; x++) {
+		for (int y = 0; y < edits->clipSize[1]; y++) {
+			for (int z = 0; z < edits->clipSize[2]; z++) {
+				edits->clipboard[(x * edits->clipSize[1] + y) * edits->clipSize[2] + z] = blockPositions[from[0] + x][from[1] + y][from[2] + z];
+			}
+		}
+	}
+}
+
+// Pastes the clipboard with its lowest corner at a position. the part outside the world is left off. returns how many blocks changed
+int pasteRegion(EditLog* edits, UpdateQueue* updates, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int at[3]) {
+	int changes = edits->numChanges;
+	beginEdit(edits);
+	for (int x = 0; x < edits->clipSize[0]; x++) {
+		for (int y = 0; y < edits->clipSize[1]; y++) {
+			for (int z = 0; z < edits->clipSize[2]; z++) {
+				int block = edits->clipboard[(x * edits->clipSize[1] + y) * edits->clipSize[2] + z];
+				setBlock(edits, updates, blockPositions, at[0] + x, at[1] + y, at[2] + z, block);
+			}
+		}
+	}
+	endEdit(edits);
+	return edits->numChanges - changes;
+}
+
+// Puts a block back the way an undo or redo needs it, without adding to the log
+void restoreBlock(EditLog* edits, UpdateQueue* updates, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int cell, int block) {
+	int x = cell / (WORLD_SIZE * WORLD_SIZE);
+	int y = cell / WORLD_SIZE % WORLD_SIZE;
+	int z = cell % WORLD_SIZE;
+	blockPositions[x][y][z] = block;
+	blockChanged(updates, blockPositions, x, y, z);
+	markUnsaved(edits, cell);
+}
+
+// Undoes the last operation, last change first. returns 0 when there is nothing to undo
+int undoEdit(EditLog* edits, UpdateQueue* updates, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE]) {
+	if (edits->current == 0) return 0;
+	edits->current--;
+	int end = edits->current + 1 < edits->numOperations ? edits->operations[edits->current + 1] : edits->numChanges;
+	for (int i = end - 1; i >= edits->operations[edits->current]; i--) {
+		restoreBlock(edits, updates, blockPositions, edits->changes[i].cell, edits->changes[i].before);
+	}
+	return 1;
+}
+
+// Does the last undone operation again. returns 0 when there is nothing to redo
+int redoEdit(EditLog* edits, UpdateQueue* updates, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE]) {
+	if (edits->current == edits->numOperations) return 0;
+	int end = edits->current + 1 < edits->numOperations ? edits->operations[edits->current + 1] : edits->numChanges;
+	for (int i = edits->operations[edits->current]; i < end; i++) {
+		restoreBlock(edits, updates, blockPositions, edits->changes[i].cell, edits->changes[i].after);
+	}
+	edits->current++;
+	return 1;
+}
+
+// Runs a building key: c picks the corners of a region at the block being looked at, f fills it with the held block,
+// h replaces the looked at block's type in it with the held block, y copies it, v pastes in front of the player, u undoes and i redoes
+void editCommand(EditLog* edits, UpdateQueue* updates, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int key, int blocksTouching[2][3], int blockType) {
+	int* target = blocksTouching[1];
+	int regionReady = edits->numCorners == 2;
+	switch (key) {
+		case 'c':
+		if (target[0] == -1) break;
+		if (edits->numCorners == 2) edits->numCorners = 0;
+		memcpy(edits->corners[edits->numCorners++], target, sizeof(edits->corners[0]));
+		break;
+		
+		case 'f':
+		if (regionReady) fillRegion(edits, updates, blockPositions, edits->corners[0], edits->corners[1], blockType, ANY_BLOCK);
+		break;
+		
+		case 'h':
+		if (regionReady && target[0] != -1) fillRegion(edits, updates, blockPositions, edits->corners[0], edits->corners[1], blockType, blockPositions[target[0]][target[1]][target[2]]);
+		break;
+		
+		case 'y':
+		if (regionReady) copyRegion(edits, blockPositions, edits->corners[0], edits->corners[1]);
+		break;
+		
+		case 'v':
+		if (blocksTouching[0][0] != -1) pasteRegion(edits, updates, blockPositions, blocksTouching[0]);
+		break;
+		
+		case 'u':
+		undoEdit(edits, updates, blockPositions);
+		break;
+		
+		case 'i':
+		redoEdit(edits, updates, blockPositions);
+		break;
+	}
+}
+
+// Saves the world. the first save and full saves write the whole world to world.txt and empty the delta file,
+// after that only the blocks changed since the last save are added to the end of world.edits. returns 0 if a file couldn't be opened
+long saveEdits(EditLog* edits, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int full) {
+	long bytes = 0;
+	if (full || !edits->baseSaved) {
+		saveWorld(blockPositions, NULL);
+		// the old deltas don't belong to the new world, so if they can't be emptied the next save tries a full save again
+		FILE* file = fopen(EDITS_FILE, "w");
+		if (!file) return 0;
+		fclose(file);
+		edits->baseSaved = 1;
+		bytes = NUM_CELLS;
+	} else if (edits->numUnsaved > 0) {
+		FILE* file = fopen(EDITS_FILE, "a");
+		if (!file) return 0;
+		for (int i = 0; i < edits->numUnsaved; i++) {
+			int cell = edits->unsaved[i];
+			bytes += fprintf(file, "%d %d\n", cell, (&blockPositions[0][0][0])[cell]);
+		}
+		fclose(file);
+	}
+	for (int i = 0; i < edits->numUnsaved; i++) edits->isUnsaved[edits->unsaved[i]] = 0;
+	edits->numUnsaved = 0;
+	return bytes;
+}
+
+// Applies the deltas saved after world.txt was last written in full. returns how many were read
+int loadEdits(EditLog* edits, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE]) {
+	int cell, block;
+	int count = 0;
+	edits->baseSaved = 1;
+	FILE* file = fopen(EDITS_FILE, "r");
+	if (!file) return 0;
+	while (fscanf(file, "%d %d", &cell, &block) == 2) {
+		if (cell < 0 || cell >= NUM_CELLS) continue;
+		(&blockPositions[0][0][0])[cell] = block;
+		count++;
+	}
+	fclose(file);
+	return count;
+}
+
+// ==================================================> STARTUP <==================================================
+
+// Generates or loads the world and builds everything the first frame of play needs from it
+void loadWorld(WorldLoad* load) {
+	if (load->online) {
+		// the world already came from the server
+	} else if (load->seed != -1) {
+		generateTerrain(load->blockPositions, load->seed);
+	} else {
+		loadTerrain(load->blockPositions, load->level);
+		// world.txt is the world the game saves to, and the edits saved since it was last written in full go on top of it
+		if (strcmp(load->levelName, "world.txt") == 0) loadEdits(load->edits, load->blockPositions);
+	}
+	computeLight(load->light, load->blockPositions);
+	generatePolygons(load->blockPositions, load->mesh, blockColors, load->light);
+	computeChunkConnections(load->blockPositions, load->chunkConnections);
+	initBlockUpdates(load->updates, load->blockPositions);
+	load->updates->light = load->light;
+	if (!load->online) spawnMobs(load->entities, load->blockPositions, load->seed, MOB_COUNT);
+	load->finishTime = getTime();
+	// the main thread only reads the world once it sees this
+	__atomic_store_n(&load->done, 1, __ATOMIC_RELEASE);
+}
+
+// pthread entry point for loadWorld
+void* loadWorldThread(void* load) {
+	loadWorld(load);
+	return NULL;
+}
+
+// Draws the frame shown while the world is still being built
+void drawLoading(int frame, double elapsed) {
+	const char spinner[] = "|/-\\";
+	erase();
+	clearViewport();
+	attron(COLOR_PAIR(16));
+	mvprintw(LINES / 2, COLS / 2 - 10, "Building world %c %.1fs", spinner[frame / 4 % 4], elapsed);
+	attroff(COLOR_PAIR(16));
+}
+
+// ==================================================> STREAMING <==================================================
+
+// Mixes a seed and a position into 32 evenly spread bits
+unsigned int hashPosition(int seed, int x, int y, int z) {
+	unsigned int h = (unsigned int)seed * 0x9E3779B1u ^ (unsigned int)x * 0x85EBCA77u ^ (unsigned int)y * 0xC2B2AE3Du ^ (unsigned int)z * 0x27D4EB2Fu;
+	h ^= h >> 15;
+	h *= 0x2C1B3C6Du;
+	h ^= h >> 12;
+	h *= 0x297A2D39u;
+	h ^= h >> 15;
+	return h;
+}
+
+// Generates one chunk of a streamed world. the ground height is smoothed noise of the seed so any chunk can be made on its own
+void generateStreamChunk(int seed, int chunkX, int chunkY, int chunkZ, signed char blocks[CHUNK_CELLS]) {
+	for (int x = 0; x < CHUNK_SIZE; x++) {
+		for (int z = 0; z < CHUNK_SIZE; z++) {
+			int bx = chunkX * CHUNK_SIZE + x;
+			int bz = chunkZ * CHUNK_SIZE + z;
+			
+			// two octaves of noise blended between the corners of a 16 and a 4 block grid
+			double height = 6;
+			for (int octave = 0; octave < 2; octave++) {
+				int spacing = octave == 0 ? 16 : 4;
+				double amplitude = octave == 0 ? 6 : 1.5;
+				double fx = (double)(bx % spacing) / spacing;
+				double fz = (double)(bz % spacing) / spacing;
+				double corner[4];
+				for (int i = 0; i < 4; i++) corner[i] = hashPosition(seed + octave, bx / spacing + (i & 1), 0, bz / spacing + (i >> 1)) / 4294967295.0;
+				double near = corner[0] + (corner[1] - corner[0]) * fx;
+				double far = corner[2] + (corner[3] - corner[2]) * fx;
+				height += (near + (far - near) * fz) * amplitude;
+			}
+			
+			// grass on top of two blocks of dirt on top of stone, like the flat world
+			for (int y = 0; y < CHUNK_SIZE; y++) {
+				int by = chunkY * CHUNK_SIZE + y;
+				signed char block = -1;
+				if (by < height - 3) block = 2;
+				else if (by < height - 1) block = 1;
+				else if (by < height) block = 0;
+				blocks[(x * CHUNK_SIZE + y) * CHUNK_SIZE + z] = block;
+			}
+		}
+	}
+}
+
+// Sets up a cache holding as many chunks as fit in budget bytes for a world size chunks across.
+// file is a descriptor of chunk records in x, y, z order, or -1 to generate the chunks from the seed
+void openChunkCache(ChunkCache* cache, long budget, int size[3], int seed, int file, int prefetch) {
+	memset(cache, 0, sizeof(*cache));
+	for (int i = 0; i < 3; i++) cache->size[i] = size[i];
+	cache->seed = seed;
+	cache->file = file;
+	cache->capacity = budget / (sizeof(StreamChunk) + 2 * sizeof(int));
+	if (cache->capacity < 1) cache->capacity = 1;
+	cache->numBuckets = 1;
+	while (cache->numBuckets < cache->capacity) cache->numBuckets *= 2;
+	cache->slots = calloc(cache->capacity, sizeof(StreamChunk));
+	cache->buckets = malloc(cache->numBuckets * sizeof(int));
+	memset(cache->buckets, -1, cache->numBuckets * sizeof(int));
+	pthread_mutex_init(&cache->lock, NULL);
+	pthread_cond_init(&cache->loaded, NULL);
+	pthread_cond_init(&cache->wake, NULL);
+	cache->prefetching = prefetch;
+	if (prefetch) pthread_create(&cache->prefetcher, NULL, prefetchWorker, cache);
+}
+
+// Stops the prefetch thread and frees the cache. the counters are left as they were
+void closeChunkCache(ChunkCache* cache) {
+	pthread_mutex_lock(&cache->lock);
+	cache->stopping = 1;
+	pthread_cond_broadcast(&cache->wake);
+	pthread_mutex_unlock(&cache->lock);
+	if (cache->prefetching) pthread_join(cache->prefetcher, NULL);
+	pthread_mutex_destroy(&cache->lock);
+	pthread_cond_destroy(&cache->loaded);
+	pthread_cond_destroy(&cache->wake);
+	free(cache->slots);
+	free(cache->buckets);
+	cache->slots = NULL;
+	cache->buckets = NULL;
+}
+
+// The slot holding a chunk (loaded or being loaded), or -1. the lock has to be held
+int findChunk(ChunkCache* cache, int key[3]) {
+	int slot = cache->buckets[hashPosition(0, key[0], key[1], key[2]) & (cache->numBuckets - 1)];
+	while (slot != -1) {
+		StreamChunk* chunk = &cache->slots[slot];
+		if (chunk->key[0] == key[0] && chunk->key[1] == key[1] && chunk->key[2] == key[2]) return slot;
+		slot = chunk->next;
+	}
+	return -1;
+}
+
+// Squared distance in chunks from the player to the middle of a chunk
+double chunkDistance(ChunkCache* cache, int key[3]) {
+	double distance = 0;
+	for (int i = 0; i < 3; i++) distance += (key[i] + 0.5 - cache->center[i]) * (key[i] + 0.5 - cache->center[i]);
+	return distance;
+}
+
+// Takes a slot for a chunk that is about to be loaded, evicting the chunk furthest from the player (the least recently used of the furthest)
+// if there is no free one. only chunks further than limit can go, and pinned or loading chunks never do. returns -1 if nothing could go
+int claimChunk(ChunkCache* cache, int key[3], double limit) {
+	int slot = -1;
+	double furthest = 0;
+	if (cache->used < cache->capacity) {
+		slot = cache->used++;
+	} else {
+		for (int i = 0; i < cache->capacity; i++) {
+			StreamChunk* chunk = &cache->slots[i];
+			if (chunk->state != CHUNK_READY || chunk->pins > 0) continue;
+			double distance = chunkDistance(cache, chunk->key);
+			if (distance <= limit) continue;
+			if (slot == -1 || distance > furthest || (distance == furthest && chunk->lastUsed < cache->slots[slot].lastUsed)) {
+				slot = i;
+				furthest = distance;
+			}
+		}
+	}
+	if (slot == -1) return -1;
+	
+	// takes an evicted chunk out of its bucket
+	StreamChunk* chunk = &cache->slots[slot];
+	if (chunk->state == CHUNK_READY) {
+		int* link = &cache->buckets[hashPosition(0, chunk->key[0], chunk->key[1], chunk->key[2]) & (cache->numBuckets - 1)];
+		while (*link != slot) link = &cache->slots[*link].next;
+		*link = chunk->next;
+		cache->evictions++;
+	}
+	int bucket = hashPosition(0, key[0], key[1], key[2]) & (cache->numBuckets - 1);
+	for (int i = 0; i < 3; i++) chunk->key[i] = key[i];
+	chunk->state = CHUNK_LOADING;
+	chunk->pins = 0;
+	chunk->next = cache->buckets[bucket];
+	cache->buckets[bucket] = slot;
+	return slot;
+}
+
+// Reads or generates the blocks of a claimed chunk. called without the lock so the other thread can use the cache meanwhile
+void fillChunk(ChunkCache* cache, StreamChunk* chunk) {
+	if (cache->file < 0) {
+		generateStreamChunk(cache->seed, chunk->key[0], chunk->key[1], chunk->key[2], chunk->blocks);
+		return;
+	}
+	off_t offset = (((off_t)chunk->key[0] * cache->size[1] + chunk->key[1]) * cache->size[2] + chunk->key[2]) * CHUNK_CELLS;
+	if (pread(cache->file, chunk->blocks, CHUNK_CELLS, offset) != CHUNK_CELLS) memset(chunk->blocks, -1, CHUNK_CELLS);
+}
+
+// Pins the chunk at chunk coordinates until releaseChunk, loading it first or waiting for the prefetcher if it isn't ready.
+// returns NULL outside the world. a thread can't pin more chunks than the cache holds
+StreamChunk* useChunk(ChunkCache* cache, int chunkX, int chunkY, int chunkZ) {
+	if (chunkX < 0 || chunkY < 0 || chunkZ < 0 || chunkX >= cache->size[0] || chunkY >= cache->size[1] || chunkZ >= cache->size[2]) return NULL;
+	int key[3] = {chunkX, chunkY, chunkZ};
+	pthread_mutex_lock(&cache->lock);
+	cache->lookups++;
+	int slot = findChunk(cache, key);
+	if (slot != -1 && cache->slots[slot].state == CHUNK_READY) {
+		cache->hits++;
+	} else {
+		double start = getTime();
+		cache->stalls++;
+		while (slot == -1 || cache->slots[slot].state != CHUNK_READY) {
+			if (slot == -1) {
+				slot = claimChunk(cache, key, -1);
+				if (slot != -1) {
+					// loads it here. loading chunks are never evicted so the slot is still this chunk's once the lock is back
+					StreamChunk* chunk = &cache->slots[slot];
+					pthread_mutex_unlock(&cache->lock);
+					fillChunk(cache, chunk);
+					pthread_mutex_lock(&cache->lock);
+					chunk->state = CHUNK_READY;
+					pthread_cond_broadcast(&cache->loaded);
+					break;
+				}
+			}
+			// the prefetcher is loading it, or every chunk is pinned or loading
+			pthread_cond_wait(&cache->loaded, &cache->lock);
+			slot = findChunk(cache, key);
+		}
+		cache->stallTime += getTime() - start;
+	}
+	StreamChunk* chunk = &cache->slots[slot];
+	chunk->pins++;
+	chunk->lastUsed = cache->tick;
+	pthread_mutex_unlock(&cache->lock);
+	return chunk;
+}
+
+// Unpins a chunk from useChunk
+void releaseChunk(ChunkCache* cache, StreamChunk* chunk) {
+	pthread_mutex_lock(&cache->lock);
+	chunk->pins--;
+	pthread_mutex_unlock(&cache->lock);
+}
+
+// The block at a block position of a streamed world. outside the world is air
+int streamBlock(ChunkCache* cache, int x, int y, int z) {
+	if (x < 0 || y < 0 || z < 0) return -1;
+	StreamChunk* chunk = useChunk(cache, x / CHUNK_SIZE, y / CHUNK_SIZE, z / CHUNK_SIZE);
+	if (chunk == NULL) return -1;
+	int block = chunk->blocks[((x % CHUNK_SIZE) * CHUNK_SIZE + y % CHUNK_SIZE) * CHUNK_SIZE + z % CHUNK_SIZE];
+	releaseChunk(cache, chunk);
+	return block;
+}
+
+// Moves the cache's idea of where the player is and queues the chunks within radius of where they are heading for the prefetch thread,
+// nearest first. each chunk of the way ahead only adds the chunks the one before didn't cover. a player who isn't moving gets the chunks around them
+void prefetchAhead(ChunkCache* cache, double playerPos[3], double playerMove[3], int radius) {
+	double speed = sqrt(playerMove[0] * playerMove[0] + playerMove[1] * playerMove[1] + playerMove[2] * playerMove[2]);
+	pthread_mutex_lock(&cache->lock);
+	cache->tick++;
+	for (int i = 0; i < 3; i++) cache->center[i] = playerPos[i] / 2 / CHUNK_SIZE;
+	cache->queueHead = 0;
+	cache->queueCount = 0;
+	if (!cache->prefetching) {
+		pthread_mutex_unlock(&cache->lock);
+		return;
+	}
+	
+	int previous[3] = {0, 0, 0};
+	for (int ahead = 0; ahead <= (speed > 0 ? PREFETCH_AHEAD : 0); ahead++) {
+		int middle[3];
+		for (int i = 0; i < 3; i++) middle[i] = (int)floor(cache->center[i] + (speed > 0 ? playerMove[i] / speed * ahead : 0));
+		for (int x = middle[0] - radius; x <= middle[0] + radius; x++) {
+			for (int y = middle[1] - radius; y <= middle[1] + radius; y++) {
+				for (int z = middle[2] - radius; z <= middle[2] + radius; z++) {
+					int key[3] = {x, y, z};
+					if (x < 0 || y < 0 || z < 0 || x >= cache->size[0] || y >= cache->size[1] || z >= cache->size[2]) continue;
+					if (ahead > 0 && abs(x - previous[0]) <= radius && abs(y - previous[1]) <= radius && abs(z - previous[2]) <= radius) continue;
+					if (cache->queueCount == PREFETCH_QUEUE || findChunk(cache, key) != -1) continue;
+					for (int i = 0; i < 3; i++) cache->queue[cache->queueCount][i] = key[i];
+					cache->queueCount++;
+				}
+			}
+		}
+		for (int i = 0; i < 3; i++) previous[i] = middle[i];
+	}
+	if (cache->queueCount > 0) pthread_cond_signal(&cache->wake);
+	pthread_mutex_unlock(&cache->lock);
+}
+
+// Loads the queued chunks in the background. it only evicts chunks further from the player than the one it is loading,
+// so it never pushes out what the player is using for something they might need later
+void* prefetchWorker(void* data) {
+	ChunkCache* cache = data;
+	pthread_mutex_lock(&cache->lock);
+	while (!cache->stopping) {
+		if (cache->queueCount == 0) {
+			pthread_cond_wait(&cache->wake, &cache->lock);
+			continue;
+		}
+		int key[3];
+		for (int i = 0; i < 3; i++) key[i] = cache->queue[cache->queueHead][i];
+		cache->queueHead++;
+		cache->queueCount--;
+		if (findChunk(cache, key) != -1) continue;
+		int slot = claimChunk(cache, key, chunkDistance(cache, key));
+		if (slot == -1) continue;
+		
+		StreamChunk* chunk = &cache->slots[slot];
+		pthread_mutex_unlock(&cache->lock);
+		fillChunk(cache, chunk);
+		pthread_mutex_lock(&cache->lock);
+		chunk->state = CHUNK_READY;
+		chunk->lastUsed = cache->tick;
+		cache->prefetched++;
+		pthread_cond_broadcast(&cache->loaded);
+	}
+	pthread_mutex_unlock(&cache->lock);
+	return NULL;
+}
+
+// ==================================================> EVENTS <==================================================
+
+// Adds a file descriptor to an epoll set. source is handed back by epoll_wait to say which one is ready
+int watchEvents(int epoll, int fd, unsigned int source) {
+	struct epoll_event event = {0};
+	event.events = EPOLLIN;
+	event.data.u32 = source;
+	return epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event);
+}
+
+// Starts a timer that becomes readable every period seconds. returns -1 when the period is 0
+int openTimer(int epoll, double period, unsigned int source) {
+	if (period <= 0) return -1;
+	struct itimerspec interval;
+	interval.it_interval.tv_sec = (time_t)period;
+	interval.it_interval.tv_nsec = (long)((period - (time_t)period) * 1000000000);
+	interval.it_value = interval.it_interval;
+	int timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+	timerfd_settime(timer, 0, &interval, NULL);
+	watchEvents(epoll, timer, source);
+	return timer;
+}
+
+// Sets up the game's event loop. fps and autosave of 0 turn the frame cap and autosaving off
+void openEventLoop(int input, int connection, double fps, double autosave) {
+	events.epoll = epoll_create1(0);
+	events.input = input;
+	events.connection = connection;
+	if (input != -1) watchEvents(events.epoll, input, EVENT_INPUT);
+	if (connection != -1) watchEvents(events.epoll, connection, EVENT_SOCKET);
+	events.frameTimer = openTimer(events.epoll, fps > 0 ? 1 / fps : 0, EVENT_FRAME);
+	events.autosaveTimer = openTimer(events.epoll, autosave, EVENT_AUTOSAVE);
+	events.socketReady = connection != -1;
+}
+
+// Waits until the next frame is due and queues every key that arrived in the meantime
+void waitForFrame() {
+	struct epoll_event ready[8];
+	unsigned long long expirations;
+	int frameDue = events.frameTimer == -1;
+	
+	// without a frame cap this only checks what is ready and returns straight away
+	do {
+		int numReady = epoll_wait(events.epoll, ready, 8, frameDue ? 0 : -1);
+		double now = getTime();
+		for (int i = 0; i < numReady; i++) {
+			switch (ready[i].data.u32) {
+				case EVENT_INPUT:
+				pumpInput(now);
+				break;
+				
+				case EVENT_FRAME:
+				if (read(events.frameTimer, &expirations, sizeof(expirations)) > 0) frameDue = 1;
+				break;
+				
+				case EVENT_AUTOSAVE:
+				if (read(events.autosaveTimer, &expirations, sizeof(expirations)) > 0) events.autosaveDue = 1;
+				break;
+				
+				case EVENT_SOCKET:
+				events.socketReady = 1;
+				break;
+			}
+		}
+	} while (!frameDue);
+	
+	// replays have no terminal to wait on, their keys come from the journal
+	pumpInput(getTime());
+}
+
+// Moves every key that can be read right now into the action queue
+void pumpInput(double now) {
+	int ch;
+	while ((ch = readKey()) != ERR) {
+		if (events.count == ACTION_QUEUE) {
+			events.dropped++;
+			continue;
+		}
+		Action* action = &events.actions[(events.head + events.count) % ACTION_QUEUE];
+		action->key = ch;
+		action->time = now;
+		events.count++;
+	}
+}
+
+// Takes the oldest queued key, or ERR if there are none
+int nextAction() {
+	if (events.count == 0) return ERR;
+	Action* action = &events.actions[events.head];
+	if (events.consumedTime == 0) events.consumedTime = action->time;
+	events.head = (events.head + 1) % ACTION_QUEUE;
+	events.count--;
+	return action->key;
+}
+
+// Called once a frame is on screen. the time since the oldest key it used arrived is the input latency
+void presentFrame() {
+	double latency = 0;
+	if (events.consumedTime != 0) {
+		latency = getTime() - events.consumedTime;
+		events.latencyTotal += latency;
+		events.latencyCount++;
+		if (latency > events.latencyMax) events.latencyMax = latency;
+		events.consumedTime = 0;
+	}
+	PROFILE_COUNT(COUNTER_LATENCY, (long)(latency * 1000000));
+}
+
+// Closes the epoll set and timers
+void closeEventLoop() {
+	if (events.frameTimer != -1) close(events.frameTimer);
+	if (events.autosaveTimer != -1) close(events.autosaveTimer);
+	close(events.epoll);
+}
+
+// ==================================================> NETWORK <==================================================
+
+// Fills in a socket address. a number is a TCP port, "host:port" is a TCP address and anything else is a unix socket path
+int socketAddress(const char* address, struct sockaddr_storage* addr, socklen_t* length) {
+	memset(addr, 0, sizeof(*addr));
+	const char* colon = strrchr(address, ':');
+	if (address[0] != '\0' && address[strspn(address, "0123456789")] == '\0') {
+		struct sockaddr_in* in = (struct sockaddr_in*)addr;
+		in->sin_family = AF_INET;
+		in->sin_port = htons(atoi(address));
+		in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		*length = sizeof(*in);
+	} else if (colon && colon[1] != '\0' && colon[1 + strspn(colon + 1, "0123456789")] == '\0') {
+		struct sockaddr_in* in = (struct sockaddr_in*)addr;
+		char host[64];
+		int hostLength = colon - address < 63 ? colon - address : 63;
+		memcpy(host, address, hostLength);
+		host[hostLength] = '\0';
+		in->sin_family = AF_INET;
+		in->sin_port = htons(atoi(colon + 1));
+		if (inet_pton(AF_INET, host, &in->sin_addr) != 1) return -1;
+		*length = sizeof(*in);
+	} else {
+		struct sockaddr_un* un = (struct sockaddr_un*)addr;
+		if (strlen(address) >= sizeof(un->sun_path)) return -1;
+		un->sun_family = AF_UNIX;
+		strcpy(un->sun_path, address);
+		*length = sizeof(*un);
+	}
+	return addr->ss_family;
+}
+
+// Opens the socket the server listens on. a plain port listens on every interface so other machines can join
+int openServerSocket(const char* address) {
+	struct sockaddr_storage addr;
+	socklen_t length;
+	int family = socketAddress(address, &addr, &length);
+	if (family == -1) return -1;
+	if (address[strspn(address, "0123456789")] == '\0') ((struct sockaddr_in*)&addr)->sin_addr.s_addr = htonl(INADDR_ANY);
+	if (family == AF_UNIX) unlink(address);
+	
+	int listener = socket(family, SOCK_STREAM, 0);
+	int on = 1;
+	if (listener == -1) return -1;
+	if (family == AF_INET) setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	if (bind(listener, (struct sockaddr*)&addr, length) == -1 || listen(listener, MAX_CLIENTS) == -1) {
+		close(listener);
+		return -1;
+	}
+	fcntl(listener, F_SETFL, O_NONBLOCK);
+	return listener;
+}
+
+// Connects to a server and waits for the player id and the world. returns the socket, or -1 if joining failed.
+// whatever arrived after the snapshot is left at the start of buffer, so clientReceive carries on from it
+int joinServer(const char* address, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int* playerId, unsigned char* buffer, int* bufferLength) {
+	struct sockaddr_storage addr;
+	socklen_t length;
+	int family = socketAddress(address, &addr, &length);
+	if (family == -1) return -1;
+	int connection = socket(family, SOCK_STREAM, 0);
+	int on = 1;
+	if (connection == -1) return -1;
+	if (connect(connection, (struct sockaddr*)&addr, length) == -1) {
+		close(connection);
+		return -1;
+	}
+	if (family == AF_INET) setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	
+	// the server always sends the welcome and the snapshot first
+	int haveWorld = 0;
+	*bufferLength = 0;
+	*playerId = -1;
+	while (!haveWorld) {
+		int received = recv(connection, buffer + *bufferLength, NET_BUFFER - *bufferLength, 0);
+		if (received <= 0) break;
+		*bufferLength += received;
+		
+		int offset = 0;
+		int type;
+		unsigned char* payload;
+		int payloadLength;
+		// stops at the snapshot, the updates sent after it belong to clientReceive
+		while (!haveWorld && takeMessage(buffer, bufferLength, &offset, &type, &payload, &payloadLength)) {
+			if (type == MSG_WELCOME && payloadLength >= 1) {
+				*playerId = payload[0];
+			} else if (type == MSG_SNAPSHOT) {
+				decompressWorld(payload, payloadLength, blockPositions);
+				haveWorld = 1;
+			}
+		}
+		memmove(buffer, buffer + offset, *bufferLength - offset);
+		*bufferLength -= offset;
+	}
+	
+	if (!haveWorld || *playerId == -1) {
+		close(connection);
+		return -1;
+	}
+	fcntl(connection, F_SETFL, O_NONBLOCK);
+	return connection;
+}
+
+// Runs the world for every connected player at a fixed tick rate. runs until ctrl+c when seconds is 0
+void runServer(int listener, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], double seconds, ServerStats* stats) {
+	static NetPlayer players[MAX_CLIENTS];
+	static UpdateQueue updates;
+	struct epoll_event ready[MAX_CLIENTS + 2];
+	unsigned long long expirations;
+	ServerStats total = {0};
+	ServerStats second = {0};
+	double start = getTime();
+	double nextReport = start + 1;
+	
+	// the listener, every player's socket and the tick timer share one epoll set
+	int epoll = epoll_create1(0);
+	watchEvents(epoll, listener, EVENT_LISTENER);
+	int tickTimer = openTimer(epoll, 1.0 / TICK_RATE, EVENT_TICK);
+	
+	memset(players, 0, sizeof(players));
+	initBlockUpdates(&updates, blockPositions);
+	deltaTime = 60.0 / TICK_RATE;
+	while (!serverStopping && (seconds == 0 || getTime() - start < seconds)) {
+		int tickDue = 0;
+		int numReady = epoll_wait(epoll, ready, MAX_CLIENTS + 2, -1);
+		for (int i = 0; i < numReady; i++) {
+			unsigned int source = ready[i].data.u32;
+			if (source == EVENT_LISTENER) {
+				serverAccept(listener, epoll, players, blockPositions);
+			} else if (source == EVENT_TICK) {
+				// a late tick is only run once instead of catching up
+				tickDue = read(tickTimer, &expirations, sizeof(expirations)) > 0;
+			} else if (source >= EVENT_PLAYER && players[source - EVENT_PLAYER].active == 1) {
+				serverRead(&players[source - EVENT_PLAYER]);
+				if (players[source - EVENT_PLAYER].active == -1) dropPlayer(players, source - EVENT_PLAYER);
+			}
+		}
+		if (!tickDue) continue;
+		
+		double tickStart = getTime();
+		serverTick(players, blockPositions, &updates, &second);
+		double tickTime = getTime() - tickStart;
+		second.ticks++;
+		second.tickTime += tickTime;
+		if (tickTime > second.maxTickTime) second.maxTickTime = tickTime;
+		
+		int clients = 0;
+		for (int i = 0; i < MAX_CLIENTS; i++) clients += players[i].active;
+		if (clients > second.maxClients) second.maxClients = clients;
+		
+		if (getTime() >= nextReport) {
+			if (seconds == 0) {
+				printf("ticks %ld  tick %.3f ms (max %.3f)  clients %d  %.1f KB/s per client\n", second.ticks, second.tickTime / second.ticks * 1000, second.maxTickTime * 1000, clients, clients ? second.bytesSent / 1024.0 / clients : 0.0);
+				fflush(stdout);
+			}
+			total.ticks += second.ticks;
+			total.tickTime += second.tickTime;
+			total.bytesSent += second.bytesSent;
+			if (second.maxTickTime > total.maxTickTime) total.maxTickTime = second.maxTickTime;
+			if (second.maxClients > total.maxClients) total.maxClients = second.maxClients;
+			memset(&second, 0, sizeof(second));
+			nextReport += 1;
+		}
+	}
+	
+	for (int i = 0; i < MAX_CLIENTS; i++) {
+		if (players[i].active) dropPlayer(players, i);
+	}
+	close(tickTimer);
+	close(epoll);
+	if (stats) {
+		total.ticks += second.ticks;
+		total.tickTime += second.tickTime;
+		total.bytesSent += second.bytesSent;
+		if (second.maxTickTime > total.maxTickTime) total.maxTickTime = second.maxTickTime;
+		if (second.maxClients > total.maxClients) total.maxClients = second.maxClients;
+		*stats = total;
+	}
+}
+
+// Accepts new players and sends them their id and the whole world
+void serverAccept(int listener, int epoll, NetPlayer players[MAX_CLIENTS], int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE]) {
+	static unsigned char snapshot[WORLD_SIZE * WORLD_SIZE * WORLD_SIZE * 2];
+	int connection;
+	while ((connection = accept(listener, NULL, NULL)) != -1) {
+		int id = 0;
+		while (id < MAX_CLIENTS && players[id].active) id++;
+		if (id == MAX_CLIENTS) {
+			close(connection);
+			continue;
+		}
+		
+		int on = 1;
+		setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+		fcntl(connection, F_SETFL, O_NONBLOCK);
+		watchEvents(epoll, connection, EVENT_PLAYER + id);
+		NetPlayer* player = &players[id];
+		memset(player, 0, sizeof(*player));
+		player->active = 1;
+		player->socket = connection;
+		player->pos[0] = 16;
+		player->pos[1] = 32;
+		player->pos[2] = 16;
+		player->grounded = 1;
+		player->in = malloc(NET_BUFFER);
+		player->out = malloc(NET_BUFFER);
+		
+		unsigned char welcome = id;
+		queueMessage(player, MSG_WELCOME, &welcome, 1);
+		queueMessage(player, MSG_SNAPSHOT, snapshot, compressWorld(blockPositions, snapshot));
+		
+		// every player is sent again on the next tick so the new player can see them
+		for (int i = 0; i < MAX_CLIENTS; i++) players[i].sentPos[0] = NAN;
+	}
+}
+
+// Reads the keys a player has sent and queues them for the next ticks
+void serverRead(NetPlayer* player) {
+	if (receiveBytes(player->socket, player->in, &player->inLength) == -1) {
+		player->active = -1;
+		return;
+	}
+	
+	int offset = 0;
+	int type;
+	unsigned char* payload;
+	int payloadLength;
+	while (takeMessage(player->in, &player->inLength, &offset, &type, &payload, &payloadLength)) {
+		if (type != MSG_INPUT) continue;
+		for (int i = 0; i + 4 <= payloadLength && player->keyCount < KEY_QUEUE; i += 4) {
+			memcpy(&player->keys[(player->keyHead + player->keyCount) % KEY_QUEUE], payload + i, 4);
+			player->keyCount++;
+		}
+	}
+	memmove(player->in, player->in + offset, player->inLength - offset);
+	player->inLength -= offset;
+}
+
+// Moves every player one tick and sends the block edits and moved players to everyone in one message
+void serverTick(NetPlayer players[MAX_CLIENTS], int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], UpdateQueue* updates, ServerStats* stats) {
+	static unsigned char update[2 + NUM_CELLS * 4 + 1 + MAX_CLIENTS * 21];
+	int length = 2;
+	int menu, destroy, toggle;
+	updates->numChanged = 0;
+	
+	// same order as a frame of the single player game: input, physics, edit, picking
+	for (int i = 0; i < MAX_CLIENTS; i++) {
+		NetPlayer* player = &players[i];
+		if (player->active != 1) continue;
+		destroy = 0;
+		if (player->keyCount > 0) {
+			handleGameKey(player->keys[player->keyHead], player->move, player->rot, &menu, &player->grounded, &destroy, &player->blockType, &toggle);
+			player->keyHead = (player->keyHead + 1) % KEY_QUEUE;
+			player->keyCount--;
+		}
+		player->grounded = checkCollisions(player->pos, player->move, blockPositions);
+		
+		if (destroy != 0 && player->blocksTouching[1][0] != -1) {
+			int* cell = player->blocksTouching[destroy == 1 ? 1 : 0];
+			editBlock(blockPositions, player->blocksTouching, player->blockType, destroy);
+			blockChanged(updates, blockPositions, cell[0], cell[1], cell[2]);
+		}
+		playerTouching(player->pos, player->rot, blockPositions, player->blocksTouching);
+	}
+	advanceBlockUpdates(updates, blockPositions, deltaTime);
+	
+	// every cell the players or the block updates changed, with what is in it now
+	int numEdits = updates->numChanged;
+	for (int i = 0; i < numEdits; i++) {
+		int cell = updates->changed[i];
+		update[length++] = cell / (WORLD_SIZE * WORLD_SIZE);
+		update[length++] = cell / WORLD_SIZE % WORLD_SIZE;
+		update[length++] = cell % WORLD_SIZE;
+		update[length++] = (signed char)(&blockPositions[0][0][0])[cell];
+	}
+	update[0] = numEdits & 0xff;
+	update[1] = numEdits >> 8;
+	
+	// only players that moved or turned since the last message are sent
+	int countAt = length++;
+	int numMoved = 0;
+	for (int i = 0; i < MAX_CLIENTS; i++) {
+		NetPlayer* player = &players[i];
+		if (player->active != 1) continue;
+		float pos[3] = {player->pos[0], player->pos[1], player->pos[2]};
+		float rot[2] = {player->rot[0], player->rot[1]};
+		if (memcmp(pos, player->sentPos, sizeof(pos)) == 0 && memcmp(rot, player->sentRot, sizeof(rot)) == 0) continue;
+		memcpy(player->sentPos, pos, sizeof(pos));
+		memcpy(player->sentRot, rot, sizeof(rot));
+		update[length++] = i;
+		memcpy(update + length, pos, sizeof(pos));
+		memcpy(update + length + sizeof(pos), rot, sizeof(rot));
+		length += sizeof(pos) + sizeof(rot);
+		numMoved++;
+	}
+	update[countAt] = numMoved;
+	
+	for (int i = 0; i < MAX_CLIENTS; i++) {
+		NetPlayer* player = &players[i];
+		if (player->active != 1) continue;
+		long sent = player->bytesSent;
+		if (numEdits > 0 || numMoved > 0) queueMessage(player, MSG_UPDATE, update, length);
+		if (flushMessages(player) == -1) player->active = -1;
+		stats->bytesSent += player->bytesSent - sent;
+	}
+	for (int i = 0; i < MAX_CLIENTS; i++) {
+		if (players[i].active == -1) dropPlayer(players, i);
+	}
+}
+
+// Disconnects a player and tells everyone else they left
+void dropPlayer(NetPlayer players[MAX_CLIENTS], int id) {
+	unsigned char leaving = id;
+	close(players[id].socket);
+	free(players[id].in);
+	free(players[id].out);
+	memset(&players[id], 0, sizeof(NetPlayer));
+	for (int i = 0; i < MAX_CLIENTS; i++) {
+		if (players[i].active == 1) queueMessage(&players[i], MSG_LEAVE, &leaving, 1);
+	}
+}
+
+// Run length encodes the world as (count, block + 1) pairs. returns the number of bytes written
+int compressWorld(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], unsigned char* out) {
+	int* blocks = &blockPositions[0][0][0];
+	int length = 0;
+	for (int i = 0; i < WORLD_SIZE * WORLD_SIZE * WORLD_SIZE;) {
+		int run = 1;
+		while (run < 255 && i + run < WORLD_SIZE * WORLD_SIZE * WORLD_SIZE && blocks[i + run] == blocks[i]) run++;
+		out[length++] = run;
+		out[length++] = blocks[i] + 1;
+		i += run;
+	}
+	return length;
+}
+
+// Fills the world from the output of compressWorld
+void decompressWorld(const unsigned char* in, int length, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE]) {
+	int* blocks = &blockPositions[0][0][0];
+	int cell = 0;
+	for (int i = 0; i + 1 < length; i += 2) {
+		for (int j = 0; j < in[i] && cell < WORLD_SIZE * WORLD_SIZE * WORLD_SIZE; j++) {
+			blocks[cell++] = in[i + 1] - 1;
+		}
+	}
+}
+
+// Adds a message to a player's outgoing buffer. a player whose buffer fills up is too far behind and is dropped
+void queueMessage(NetPlayer* player, int type, const void* payload, int length) {
+	if (player->outLength + 5 + length > NET_BUFFER) {
+		player->active = -1;
+		return;
+	}
+	unsigned int size = length;
+	player->out[player->outLength] = type;
+	memcpy(player->out + player->outLength + 1, &size, 4);
+	memcpy(player->out + player->outLength + 5, payload, length);
+	player->outLength += 5 + length;
+}
+
+// Sends as much of a player's outgoing buffer as the socket takes. returns -1 if the player disconnected
+int flushMessages(NetPlayer* player) {
+	int sent = 0;
+	while (sent < player->outLength) {
+		int written = send(player->socket, player->out + sent, player->outLength - sent, MSG_NOSIGNAL);
+		if (written <= 0) {
+			if (written == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+			return -1;
+		}
+		sent += written;
+	}
+	player->bytesSent += sent;
+	memmove(player->out, player->out + sent, player->outLength - sent);
+	player->outLength -= sent;
+	return 0;
+}
+
+// Reads everything waiting on a non blocking socket. returns -1 if it was closed
+int receiveBytes(int socket, unsigned char* buffer, int* length) {
+	while (*length < NET_BUFFER) {
+		int received = recv(socket, buffer + *length, NET_BUFFER - *length, 0);
+		if (received == 0) return -1;
+		if (received == -1) return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+		*length += received;
+	}
+	return 0;
+}
+
+// Takes the next whole message out of a buffer. returns 0 when only part of a message has arrived
+int takeMessage(unsigned char* buffer, int* length, int* offset, int* type, unsigned char** payload, int* payloadLength) {
+	unsigned int size;
+	if (*length - *offset < 5) return 0;
+	memcpy(&size, buffer + *offset + 1, 4);
+	if (size > NET_BUFFER - 5) {
+		// a broken message can never finish so the rest of the buffer is thrown away
+		*offset = *length;
+		return 0;
+	}
+	if (*length - *offset < 5 + (int)size) return 0;
+	*type = buffer[*offset];
+	*payload = buffer + *offset + 5;
+	*payloadLength = size;
+	*offset += 5 + size;
+	return 1;
+}
+
+// Queues a batch of keys for the server and sends as much of what is waiting as the socket takes, like the server does for its players.
+// whatever doesn't fit goes out on a later frame, so a short send never splits a message. returns -1 if the connection is broken
+int sendKeys(NetPlayer* server, int keys[], int count) {
+	if (count > 0) queueMessage(server, MSG_INPUT, keys, count * 4);
+	if (server->active == -1) return -1;
+	return flushMessages(server);
+}
+
+// Sends every key pressed this frame to the server. the pause menu and debug keys stay on the client. returns -1 if the connection is broken
+int clientInputs(NetPlayer* server, int* menu, int* toggle, int* blockType) {
+	int keys[KEY_QUEUE];
+	int count = 0;
+	int ch;
+	*toggle = 0;
+	while (count < KEY_QUEUE && (ch = nextAction()) != ERR) {
+		if (ch == 27) {
+			*menu = 1;
+			break;
+		} else if (ch == 'o' || ch == 'p' || ch == 'r' || ch == 't' || ch == 'g') {
+			*toggle = ch;
+			continue;
+		} else if (ch == 'q' && *blockType > 0) {
+			*blockType -= 1;
+		} else if (ch == 'e' && *blockType < NUM_BLOCKS) {
+			*blockType += 1;
+		}
+		keys[count++] = ch;
+	}
+	if (sendKeys(server, keys, count) == -1) return -1;
+	return count;
+}
+
+// Applies the messages from the server. block edits go through blockChanged so only the chunks they touch are lit and meshed again,
+// a new world sets edited for a full rebuild. returns -1 if the server went away
+int clientReceive(int socket, unsigned char* buffer, int* length, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], UpdateQueue* updates, int playerId, double playerPos[3], double playerRot[3], NetPlayer others[MAX_CLIENTS], int* edited) {
+	int closed = receiveBytes(socket, buffer, length);
+	int offset = 0;
+	int type;
+	unsigned char* payload;
+	int payloadLength;
+	while (takeMessage(buffer, length, &offset, &type, &payload, &payloadLength)) {
+		if (type == MSG_SNAPSHOT) {
+			decompressWorld(payload, payloadLength, blockPositions);
+			buildBrickMap(blockPositions);
+			buildHeightMap(blockPositions);
+			*edited = 1;
+		} else if (type == MSG_LEAVE && payloadLength >= 1) {
+			others[payload[0] % MAX_CLIENTS].active = 0;
+		} else if (type == MSG_UPDATE && payloadLength >= 3) {
+			// the counts are checked against the payload first, so a short or broken update is dropped instead of read past its end
+			int numEdits = payload[0] | payload[1] << 8;
+			if (2 + numEdits * 4 + 1 > payloadLength) continue;
+			int numMoved = payload[2 + numEdits * 4];
+			if (2 + numEdits * 4 + 1 + numMoved * 21 > payloadLength) continue;
+			unsigned char* edit = payload + 2;
+			for (int i = 0; i < numEdits; i++, edit += 4) {
+				// blocks are air or an index into blockColors, which has a color for 0 up to NUM_BLOCKS
+				int block = (signed char)edit[3];
+				if (edit[0] < WORLD_SIZE && edit[1] < WORLD_SIZE && edit[2] < WORLD_SIZE && block >= -1 && block <= NUM_BLOCKS) {
+					blockPositions[edit[0]][edit[1]][edit[2]] = block;
+					blockChanged(updates, blockPositions, edit[0], edit[1], edit[2]);
+				}
+			}
+			edit++;
+			for (int i = 0; i < numMoved; i++, edit += 21) {
+				float pos[3], rot[2];
+				int id = edit[0] % MAX_CLIENTS;
+				memcpy(pos, edit + 1, sizeof(pos));
+				memcpy(rot, edit + 1 + sizeof(pos), sizeof(rot));
+				double* toPos = id == playerId ? playerPos : others[id].pos;
+				double* toRot = id == playerId ? playerRot : others[id].rot;
+				for (int j = 0; j < 3; j++) toPos[j] = pos[j];
+				toRot[0] = rot[0];
+				toRot[1] = rot[1];
+				others[id].active = id != playerId;
+			}
+		}
+	}
+	memmove(buffer, buffer + offset, *length - offset);
+	*length -= offset;
+	return closed;
+}
+
+// Draws the other players as a head and a name tag on top of the world
+void drawPlayers(NetPlayer others[MAX_CLIENTS], int playerId, double playerPos[3], double playerRot[3]) {
+	double matrixConversions[5][6];
+	cameraMatrix(playerPos, playerRot, matrixConversions);
+	attron(COLOR_PAIR(15));
+	for (int i = 0; i < MAX_CLIENTS; i++) {
+		if (!others[i].active || i == playerId) continue;
+		double point[3] = {others[i].pos[0], others[i].pos[1], others[i].pos[2]};
+		transformPoint(matrixConversions, point);
+		if (point[2] <= 0.01) continue;
+		int row = (int)(-point[1] * (LINES / 2)) + LINES / 2 - 1;
+		int col = (int)(point[0] * (COLS / 2)) + COLS / 2 - 1;
+		if (row < 1 || row >= LINES || col < 0 || col >= COLS - 3) continue;
+		mvprintw(row - 1, col - 1, "P%d", i);
+		mvaddch(row, col, 'O');
+	}
+	attroff(COLOR_PAIR(15));
+}
+
+// Lets the server close its socket cleanly on ctrl+c
+void stopServer(int signal) {
+	serverStopping = signal;
+}
@@ -0,0 +1,958 @@
+// Declarations shared by the game and the benchmark suite
+
+#ifndef BLOCKGAME_FINAL_PROJECT_H
+#define BLOCKGAME_FINAL_PROJECT_H
+
+// ==================================================> INCLUDES <==================================================
+
+#define NCURSES_WIDECHAR 1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ncurses.h>
+#include <locale.h>
+#include <time.h>
+#include <math.h>
+#include <limits.h>
+#include <stdint.h>
+
+#include <string.h>
+#include <unistd.h> // For sleep()
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/ioctl.h>
+#include <linux/sockios.h> // For SIOCOUTQ
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+
+#define WORLD_SIZE 16
+#define NUM_BLOCKS 17
+#define CHUNK_SIZE 4
+#define CHUNKS (WORLD_SIZE / CHUNK_SIZE)
+#define NUM_CHUNKS (CHUNKS * CHUNKS * CHUNKS)
+// every corner of every block in a chunk
+#define CHUNK_VERTICIES ((CHUNK_SIZE + 1) * (CHUNK_SIZE + 1) * (CHUNK_SIZE + 1))
+// a face can only be on one of the planes between blocks so this is the most a chunk can have
+#define CHUNK_FACES (3 * CHUNK_SIZE * CHUNK_SIZE * (CHUNK_SIZE + 1))
+#define CHUNK_TRIANGLES (CHUNK_FACES * 2)
+#define MAX_TRIANGLES (NUM_CHUNKS * CHUNK_TRIANGLES)
+
+// Multiplayer
+#define MAX_CLIENTS 64
+#define TICK_RATE 60
+#define KEY_QUEUE 64
+#define NET_BUFFER 262144
+
+// Block updates. sand, gravel and water are the block types with those colors
+#define NUM_CELLS (WORLD_SIZE * WORLD_SIZE * WORLD_SIZE)
+#define BLOCK_TICK_RATE 20
+#define TICK_BUDGET 1024
+#define BLOCK_GRAVEL 6
+#define BLOCK_SAND 7
+#define BLOCK_WATER 10
+#define WATER_SOURCE 4
+#define FALL_DELAY 1
+#define WATER_DELAY 3
+
+// Lighting. sky and block light are kept separately and a cell is lit by the brighter one
+#define MAX_LIGHT 15
+#define LIGHT_SKY 0
+#define LIGHT_BLOCK 1
+#define BLOCK_LAMP 13
+#define LIGHT_QUEUE (NUM_CELLS * (MAX_LIGHT + 8))
+
+// Color pairs for half block rendering start here, one for every foreground and background color
+#define HALF_BLOCK_PAIRS 17
+
+// How much the three part areas may add up to past the whole triangle and the point still counts as inside, so rounding doesn't drop cells on an edge
+#define INSIDE_EPSILON 1e-6
+
+// How the picture gets to the terminal: through ncurses, or as escape sequences with 256 or 24 bit color
+enum outputMode {OUTPUT_CURSES, OUTPUT_256, OUTPUT_TRUECOLOR};
+
+// Mobs and dropped items. the spatial hash sorts them into 1 block grid cells spread over HASH_BUCKETS buckets
+#define MAX_ENTITIES 16384
+#define HASH_BUCKETS 4096
+#define MOB_COUNT 8
+
+// Buffers allocated while the frame arena is full are 16 byte aligned like the arena itself
+#define ARENA_ALIGN 16
+
+// Region fills that change every block. the world is saved in full to world.txt and edits after that are added to EDITS_FILE
+#define ANY_BLOCK -2
+#define EDITS_FILE "world.edits"
+
+// Keys waiting to be used by the game
+#define ACTION_QUEUE 256
+
+// Blocks are grouped into 4x4x4 bricks so one 64 bit word says which cells of a brick are filled, and one more says which bricks have anything in them.
+// the layer masks are the cells of a brick with y or z at 0 or 3. chunks are the same size as bricks so meshing reads a chunk's word directly
+#define BRICK_SIZE 4
+#define BRICKS (WORLD_SIZE / BRICK_SIZE)
+#define NUM_BRICKS (BRICKS * BRICKS * BRICKS)
+#define BRICK_Y0 0x000F000F000F000FULL
+#define BRICK_Y3 0xF000F000F000F000ULL
+#define BRICK_Z0 0x1111111111111111ULL
+#define BRICK_Z3 0x8888888888888888ULL
+
+// Streamed worlds are kept as chunks of one byte per block. the prefetcher looks this many chunks ahead of the player and keeps up to PREFETCH_QUEUE chunks waiting
+#define CHUNK_CELLS (CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE)
+#define PREFETCH_AHEAD 6
+#define PREFETCH_QUEUE 4096
+
+// Most threads the raymarch renderer splits the rows of a frame between
+#define MAX_RAY_THREADS 16
+
+// Fixed point rasterizer (built in with -DFIXED_RASTER). screen coordinates are 16.16 framebuffer cells and depth keys are 2^24 / z.
+// triangles with a corner this close to the camera are drawn by the float rasterizer
+#define FIXED_SHIFT 16
+#define FIXED_ONE (1 << FIXED_SHIFT)
+#define FIXED_LIMIT (1 << 30)
+#define NEAR_PLANE 0.01
+#define DEPTH_KEY_ONE (1LL << 40)
+
+// Profiler timers cost one branch while the profiler is off and nothing at all when built with -DNO_PROFILER
+#ifdef NO_PROFILER
+#define PROFILE_BEGIN(stage)
+#define PROFILE_END(stage)
+#define PROFILE_COUNT(counter, value) ((void)(value))
+#define PROFILE_OUTPUT(written) ((void)(written))
+#define profileFrameStart()
+#define profileFrameEnd()
+#define drawProfiler()
+#define startTrace(fileName) ((void)(fileName))
+#define stopTrace()
+#define printProfileSummary()
+#define waitForTerminalOutput()
+#else
+#define PROFILE_BEGIN(stage) if (profiler.enabled) profileBegin(stage)
+#define PROFILE_END(stage) if (profiler.enabled) profileEnd(stage)
+#define PROFILE_COUNT(counter, value) (profiler.counters[counter] = (value))
+// bytes and write() calls the game sends to the terminal itself
+#define PROFILE_OUTPUT(written) (profiler.terminalWrites++, profiler.terminalBytes += (written) > 0 ? (written) : 0)
+#endif
+
+// ==================================================> STRUCTS <==================================================
+
+// How a face is drawn, worked out once when the chunk is meshed
+typedef struct faceStyle {
+	signed char color;
+	unsigned char direction;
+	char glyph;
+	unsigned char light;
+}FaceStyle;
+
+// Mesh of one chunk. vertices are stored in blocks from the corner of the chunk and each face is two triangles in the index buffer
+typedef struct chunkMesh {
+	int origin[3];
+	unsigned char (*vertices)[3];
+	unsigned char (*triangles)[3];
+	FaceStyle* faces;
+	int numVertices;
+	int numFaces;
+	int vertexCapacity;
+	int faceCapacity;
+}ChunkMesh;
+
+// Everything the rasterizer needs for one triangle, copied out in draw order so it reads memory front to back
+typedef struct drawCommand {
+	float points[3][3];
+	signed char color;
+	char glyph;
+	unsigned char light;
+}DrawCommand;
+
+// One triangle ready for the fill loops: its corners in framebuffer cells, the cells to test and what to fill them with
+typedef struct fillJob {
+	double poly[3][2];
+	float (*polygon)[3];
+	double area;
+	int left, right, bottom, top;
+	chtype cell;
+	int light;
+	int depthTest;
+	int keepLight;
+}FillJob;
+
+// A draw command for the fixed point rasterizer. triangles near the camera keep their float points and go to fillPolygon.
+// the others have x and y in 16.16 cells shifted right by shift when they are too big to fit, and a depth key for each corner
+typedef struct fixedCommand {
+	union {
+		int fixedPoints[3][3];
+		float points[3][3];
+	};
+	signed char color;
+	char glyph;
+	unsigned char light;
+	signed char shift;
+}FixedCommand;
+
+// The part of the terminal the world is drawn in. scale is how many terminal cells wide and tall each rendered cell is
+typedef struct viewport {
+	int lines;
+	int cols;
+	int scale;
+	int halfBlocks;
+	int width;
+	int height;
+	chtype* frame;
+	float* depth;
+	unsigned int* depthKey;
+	int keyedDepth;
+	int capacity;
+	chtype* row;
+	cchar_t* wideRow;
+	int rowCapacity;
+	long allocations;
+	int output;
+	int terminal;
+	unsigned char* light;
+	unsigned long long* shown;
+	int shownCapacity;
+	char* ansi;
+	WINDOW* keys;
+}Viewport;
+
+// Memory for the temporary buffers of one frame. allocating moves used forward and everything is freed at once at the start of the next frame.
+// allocations that don't fit go on the heap in a list, and the next reset grows the arena so the frame after fits
+typedef struct arena {
+	char* memory;
+	size_t capacity;
+	size_t used;
+	size_t highWater;
+	void* overflow;
+	size_t overflowBytes;
+	long grows;
+}Arena;
+
+// Parts of a frame timed by the profiler
+enum profileStage {STAGE_INPUT, STAGE_PHYSICS, STAGE_BLOCKS, STAGE_ENTITIES, STAGE_PICKING, STAGE_MESHING, STAGE_TRANSFORM, STAGE_CULL, STAGE_SORT, STAGE_RASTER, STAGE_PRESENT, NUM_STAGES};
+
+// Numbers the profiler shows for each frame
+enum profileCounter {COUNTER_TRIANGLES, COUNTER_OCCLUDED, COUNTER_CELLS, COUNTER_BYTES, COUNTER_LATENCY, COUNTER_UPDATES, COUNTER_LIGHT, COUNTER_WRITES, COUNTER_ENTITIES, COUNTER_ARENA, NUM_COUNTERS};
+
+// Per frame timings and counters. the overlay shows smoothed times and the trace gets every stage of every frame
+typedef struct profiler {
+	int enabled;
+	int overlay;
+	double stageStart[NUM_STAGES];
+	double stageTime[NUM_STAGES];
+	double stageAverage[NUM_STAGES];
+	long counters[NUM_COUNTERS];
+	int terminalFd;
+	// the socket a headless screen's output is counted through, or -1
+	int outputSocket;
+	long terminalBytes;
+	long terminalWrites;
+	long frameBytes;
+	long frameWrites;
+	FILE* trace;
+	double traceStart;
+	int traceEvents;
+	FILE* timings;
+	long frames;
+	double stageTotal[NUM_STAGES];
+	double frameMax;
+}Profiler;
+
+enum journalMode {JOURNAL_OFF, JOURNAL_RECORD, JOURNAL_REPLAY};
+
+// Recording or replaying of every key press with the time it happened. replays run at a fixed 60 frames per second
+typedef struct journal {
+	int mode;
+	FILE* file;
+	long frame;
+	double startTime;
+	double nextTime;
+	int nextKey;
+	double endTime;
+}Journal;
+
+// A cell that lost light and how bright it was before
+typedef struct lightRemoval {
+	int cell;
+	int level;
+}LightRemoval;
+
+// Sky and block light for every cell, the flood fill queues and how much work each edit took
+typedef struct lightMap {
+	unsigned char level[2][NUM_CELLS];
+	int addQueue[LIGHT_QUEUE];
+	LightRemoval removeQueue[NUM_CELLS];
+	long edits;
+	int lastWork;
+	int maxWork;
+	long totalWork;
+}LightMap;
+
+// A cell waiting to be updated on a block tick. cells are numbered (x * WORLD_SIZE + y) * WORLD_SIZE + z
+typedef struct blockUpdate {
+	long tick;
+	int cell;
+}BlockUpdate;
+
+// Scheduled block updates for sand, gravel and water, and what they changed since the last remesh
+typedef struct updateQueue {
+	BlockUpdate* heap;
+	int count;
+	int capacity;
+	long tick;
+	double clock;
+	long scheduled[NUM_CELLS];
+	unsigned char waterLevel[NUM_CELLS];
+	int dirty[NUM_CHUNKS];
+	int changed[NUM_CELLS];
+	int numChanged;
+	long processed;
+	LightMap* light;
+}UpdateQueue;
+
+enum entityKind {ENTITY_MOB, ENTITY_ITEM};
+
+// Every mob and dropped item, in blocks. each component has its own array so a pass over the entities only loads what it uses.
+// position is the middle of the bottom of the entity's box, which is halfWidth out to each side and height tall
+typedef struct entityStore {
+	int count;
+	unsigned char kind[MAX_ENTITIES];
+	signed char block[MAX_ENTITIES];
+	unsigned char grounded[MAX_ENTITIES];
+	unsigned char blocked[MAX_ENTITIES];
+	float x[MAX_ENTITIES];
+	float y[MAX_ENTITIES];
+	float z[MAX_ENTITIES];
+	float vx[MAX_ENTITIES];
+	float vy[MAX_ENTITIES];
+	float vz[MAX_ENTITIES];
+	float walkX[MAX_ENTITIES];
+	float walkZ[MAX_ENTITIES];
+	float halfWidth[MAX_ENTITIES];
+	float height[MAX_ENTITIES];
+	// entity numbers sorted by hash bucket, and where each bucket starts in that list
+	int sorted[MAX_ENTITIES];
+	int bucketStart[HASH_BUCKETS + 1];
+	int bucketFill[HASH_BUCKETS];
+	unsigned int random;
+	long collected;
+	long pairsChecked;
+}EntityStore;
+
+// One block changed by an edit
+typedef struct blockEdit {
+	int cell;
+	signed char before;
+	signed char after;
+}BlockEdit;
+
+// Every edit made while playing. operations[i] is where operation i starts in changes, and the operations before current are the ones
+// that are applied. the ones after it were undone and can be redone
+typedef struct editLog {
+	BlockEdit* changes;
+	int numChanges;
+	int capacity;
+	int* operations;
+	int numOperations;
+	int operationCapacity;
+	int current;
+	// cells changed since the last save, for delta saves
+	int unsaved[NUM_CELLS];
+	unsigned char isUnsaved[NUM_CELLS];
+	int numUnsaved;
+	int baseSaved;
+	// the region picked with c and the last region copied
+	int corners[2][3];
+	int numCorners;
+	signed char clipboard[NUM_CELLS];
+	int clipSize[3];
+	long blocksEdited;
+}EditLog;
+
+// Which cells of a world have a block in them. built from the whole world when it is loaded or meshed from scratch and kept up to date by blockChanged
+typedef struct brickMap {
+	int (*world)[WORLD_SIZE][WORLD_SIZE];
+	unsigned long long occupied;
+	unsigned long long cells[NUM_BRICKS];
+}BrickMap;
+
+// The highest block of every column and which block it is, kept next to the world like the brickmap. an empty column has height -1.
+// columns counts the columns of each height (shifted up by one) so the tallest column is known without looking at all of them
+typedef struct heightMap {
+	int (*world)[WORLD_SIZE][WORLD_SIZE];
+	signed char height[WORLD_SIZE][WORLD_SIZE];
+	signed char surface[WORLD_SIZE][WORLD_SIZE];
+	int columns[WORLD_SIZE + 1];
+	int highest;
+}HeightMap;
+
+// The raymarch renderer. every cell casts a ray through the brickmap instead of drawing the chunk meshes.
+// the rows of a frame are shared between the main thread and workers that wait on the start barrier
+typedef struct raymarcher {
+	int enabled;
+	int threads;
+	int workers;
+	int stopping;
+	pthread_t worker[MAX_RAY_THREADS];
+	pthread_barrier_t start;
+	pthread_barrier_t finish;
+	// the frame being drawn. axes are how far a ray moves in blocks for one unit of screen x and y and of depth
+	int (*blockPositions)[WORLD_SIZE][WORLD_SIZE];
+	BrickMap* bricks;
+	LightMap* light;
+	double origin[3];
+	double axes[3][3];
+	int filled[MAX_RAY_THREADS];
+}Raymarcher;
+
+// Everything built before the first frame of play. loadWorld fills it in, on its own thread unless the world has to be ready straight away
+typedef struct worldLoad {
+	int seed;
+	FILE* level;
+	const char* levelName;
+	int online;
+	int (*blockPositions)[WORLD_SIZE][WORLD_SIZE];
+	ChunkMesh* mesh;
+	LightMap* light;
+	UpdateQueue* updates;
+	EntityStore* entities;
+	EditLog* edits;
+	int (*chunkConnections)[CHUNKS][CHUNKS][6];
+	int done;
+	double finishTime;
+}WorldLoad;
+
+// What a slot of the chunk cache holds
+enum chunkState {CHUNK_EMPTY, CHUNK_LOADING, CHUNK_READY};
+
+// One cached chunk of a streamed world. a pinned chunk is being read and is never evicted
+typedef struct streamChunk {
+	int key[3];
+	int state;
+	int pins;
+	int next;
+	long lastUsed;
+	signed char blocks[CHUNK_CELLS];
+}StreamChunk;
+
+// A bounded cache of the chunks of a world too big to keep in memory, filled from the seed or from a file of chunk records.
+// a chunk that isn't there when it is used is loaded on the spot (a stall), the prefetch thread loads the ones ahead of the player before that.
+// when it is full the chunk furthest from the player goes first, and the least recently used of chunks as far away
+typedef struct chunkCache {
+	int size[3];
+	int seed;
+	int file;
+	int capacity;
+	int used;
+	StreamChunk* slots;
+	int* buckets;
+	int numBuckets;
+	pthread_mutex_t lock;
+	pthread_cond_t loaded;
+	pthread_cond_t wake;
+	pthread_t prefetcher;
+	int prefetching;
+	int stopping;
+	int queue[PREFETCH_QUEUE][3];
+	int queueHead;
+	int queueCount;
+	double center[3];
+	long tick;
+	// counters. stallTime is the seconds spent waiting for chunks that weren't ready
+	long lookups;
+	long hits;
+	long stalls;
+	long evictions;
+	long prefetched;
+	double stallTime;
+}ChunkCache;
+
+// What woke up an epoll_wait. server players use EVENT_PLAYER + their id
+enum eventSource {EVENT_INPUT, EVENT_FRAME, EVENT_AUTOSAVE, EVENT_SOCKET, EVENT_LISTENER, EVENT_TICK, EVENT_PLAYER};
+
+// A key press and the time it was read from the terminal
+typedef struct action {
+	int key;
+	double time;
+}Action;
+
+// The file descriptors the game waits on each frame and the keys read from them
+typedef struct eventLoop {
+	int epoll;
+	int input;
+	int connection;
+	int frameTimer;
+	int autosaveTimer;
+	int socketReady;
+	int autosaveDue;
+	Action actions[ACTION_QUEUE];
+	int head;
+	int count;
+	long dropped;
+	double consumedTime;
+	double latencyTotal;
+	double latencyMax;
+	long latencyCount;
+}EventLoop;
+
+// Messages between the server and clients. each one starts with a 1 byte type and a 4 byte payload length
+enum messageType {MSG_WELCOME = 1, MSG_SNAPSHOT, MSG_UPDATE, MSG_INPUT, MSG_LEAVE};
+
+// A player connected to the server. clients use the same struct for the other players they can see
+typedef struct netPlayer {
+	int active;
+	int socket;
+	double pos[3];
+	double rot[3];
+	double move[3];
+	float sentPos[3];
+	float sentRot[2];
+	int grounded;
+	int blockType;
+	int blocksTouching[2][3];
+	int keys[KEY_QUEUE];
+	int keyHead;
+	int keyCount;
+	unsigned char* in;
+	int inLength;
+	unsigned char* out;
+	int outLength;
+	long bytesSent;
+}NetPlayer;
+
+// Totals the server keeps for load testing
+typedef struct serverStats {
+	long ticks;
+	double tickTime;
+	double maxTickTime;
+	long bytesSent;
+	int maxClients;
+}ServerStats;
+
+// ==================================================> PROTOTYPES <==================================================
+
+void cameraMatrix(double playerPos[3], double playerRot[3], double matrixConversions[5][6]);
+
+void transformPoint(double matrixConversions[5][6], double point[3]);
+
+void convertScreen(ChunkMesh mesh[NUM_CHUNKS], float screenCoords[NUM_CHUNKS][CHUNK_VERTICIES][3], double playerPos[3], double playerRot[3], int chunkVisible[CHUNKS][CHUNKS][CHUNKS]);
+
+chtype faceCell(int color, char draw, int light);
+
+int fillPolygon(float polygon[3][3], int color, char draw, int light);
+
+int setupFill(float polygon[3][3], int color, char draw, int light, FillJob* job);
+
+int isInside(double poly[3][2], int pointX, int pointY);
+
+int fillFlat(FillJob* job);
+
+int fillFlatLit(FillJob* job);
+
+int fillDepth(FillJob* job);
+
+int fillDepthLit(FillJob* job);
+
+int fillGeneric(FillJob* job);
+
+void getGameInputs(double playerMove[], double playerRot[], int* menu, int* grounded, int* destroy, int* blockType, int* toggle);
+
+void handleGameKey(int ch, double playerMove[], double playerRot[], int* menu, int* grounded, int* destroy, int* blockType, int* toggle);
+
+int getMenuInputs(int* menuX, int* menuY, int* menu);
+
+int drawAll(DrawCommand commands[MAX_TRIANGLES], int numDraw);
+
+void buildDrawCommands(ChunkMesh mesh[NUM_CHUNKS], float screenCoords[NUM_CHUNKS][CHUNK_VERTICIES][3], int drawOrder[MAX_TRIANGLES], int numDraw, DrawCommand commands[MAX_TRIANGLES]);
+
+void generateTerrain(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int seed);
+
+void loadTerrain(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], FILE* level);
+
+void saveWorld(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], FILE* level);
+
+void generatePolygons(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], ChunkMesh mesh[NUM_CHUNKS], int blockColors[][3], LightMap* light);
+
+void generateChunkMesh(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], ChunkMesh* chunk, int chunkX, int chunkY, int chunkZ, int blockColors[][3], LightMap* light);
+
+int addVertex(int x, int y, int z, ChunkMesh* chunk, short vertexLookup[CHUNK_SIZE+1][CHUNK_SIZE+1][CHUNK_SIZE+1]);
+
+void addFace(int x, int y, int z, int direction, int color, int light, ChunkMesh* chunk, short vertexLookup[CHUNK_SIZE+1][CHUNK_SIZE+1][CHUNK_SIZE+1]);
+
+long meshBytes(ChunkMesh mesh[NUM_CHUNKS]);
+
+int cullBack(ChunkMesh mesh[NUM_CHUNKS], float screenCoords[NUM_CHUNKS][CHUNK_VERTICIES][3], int drawOrder[MAX_TRIANGLES], int chunkVisible[CHUNKS][CHUNKS][CHUNKS], int* occluded);
+
+void computeChunkConnections(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int chunkConnections[CHUNKS][CHUNKS][CHUNKS][6]);
+
+void cullOcclusion(double playerPos[3], int chunkConnections[CHUNKS][CHUNKS][CHUNKS][6], int chunkVisible[CHUNKS][CHUNKS][CHUNKS]);
+
+void orderPoly(ChunkMesh mesh[NUM_CHUNKS], float screenCoords[NUM_CHUNKS][CHUNK_VERTICIES][3], int drawOrder[MAX_TRIANGLES], int numDraw);
+
+int checkCollisions(double playerPos[3], double playerMove[3], int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE]);
+
+void drawPaused(int menuX, int menuY);
+
+void playerTouching(double playerPos[], double playerRot[], int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int blocksTouching[2][3]);
+
+void editBlock(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int blocksTouching[2][3], int blockType, int destroy);
+
+void drawInventory(int blockColors[][3], int blockType);
+
+void initColors();
+
+double getTime();
+
+#ifndef NO_PROFILER
+void profileBegin(int stage);
+
+void profileEnd(int stage);
+
+void profileFrameStart();
+
+void profileFrameEnd();
+
+void drawProfiler();
+
+void startTrace(const char* fileName);
+
+void stopTrace();
+
+void printProfileSummary();
+
+void* countTerminalOutput(void* socket);
+
+void waitForTerminalOutput();
+#endif
+
+int readKey();
+
+void startRecording(const char* fileName, int seed, const char* levelName);
+
+int startReplay(const char* fileName, int* seed, char levelName[100]);
+
+void readJournalEvent();
+
+int journalFrame();
+
+void stopJournal();
+
+
+
+void setColor(const char *color);
+
+void resetColor();
+
+void welcomeScreen();
+
+void displayMenu();
+
+int getValidatedChoice();
+
+int playMenu();
+
+void loadMenu(FILE** level, char fileName[100]);
+
+void mainMenu(int* seed, FILE** level, char levelName[100]);
+
+void quitMenu();
+
+void drawGraphicalMenu(void);
+
+void* arenaAlloc(Arena* arena, size_t size);
+
+void arenaReset(Arena* arena);
+
+int countTriangles(ChunkMesh mesh[NUM_CHUNKS], int chunkVisible[CHUNKS][CHUNKS][CHUNKS]);
+
+void setViewport(int lines, int cols, int scale, int halfBlocks);
+
+void clearViewport();
+
+void presentViewport();
+
+void cycleRenderScale();
+
+void orderPolyFixed(ChunkMesh mesh[NUM_CHUNKS], float screenCoords[NUM_CHUNKS][CHUNK_VERTICIES][3], int drawOrder[MAX_TRIANGLES], int numDraw);
+
+unsigned int depthToKey(double depth);
+
+void buildFixedCommands(ChunkMesh mesh[NUM_CHUNKS], float screenCoords[NUM_CHUNKS][CHUNK_VERTICIES][3], int drawOrder[MAX_TRIANGLES], int numDraw, FixedCommand commands[MAX_TRIANGLES]);
+
+int fillPolygonFixed(int polygon[3][3], int shift, int color, char draw, int light);
+
+int drawAllFixed(FixedCommand commands[MAX_TRIANGLES], int numDraw);
+
+void handleResize();
+
+void resizeSignal(int signal);
+
+void startAnsiOutput(int terminal, int output);
+
+int shadeColor(int color, int light);
+
+unsigned long long ansiCell(chtype cell, int light, short pairColors[HALF_BLOCK_PAIRS][2]);
+
+char* ansiColor(char* out, int background, int color);
+
+void presentAnsi();
+
+void presentScreen();
+
+void initBlockUpdates(UpdateQueue* updates, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE]);
+
+int isActiveBlock(int block);
+
+void scheduleUpdate(UpdateQueue* updates, int cell, int delay);
+
+BlockUpdate popUpdate(UpdateQueue* updates);
+
+void blockChanged(UpdateQueue* updates, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int x, int y, int z);
+
+int runBlockUpdates(UpdateQueue* updates, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int budget);
+
+int advanceBlockUpdates(UpdateQueue* updates, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], double elapsed);
+
+void updateBlock(UpdateQueue* updates, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int cell);
+
+int remeshDirty(UpdateQueue* updates, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], ChunkMesh mesh[NUM_CHUNKS]);
+
+int lightSource(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int channel, int cell);
+
+void computeLight(LightMap* light, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE]);
+
+int spreadLight(LightMap* light, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int channel, int numAdd, int dirty[NUM_CHUNKS]);
+
+int updateLight(LightMap* light, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int x, int y, int z, int dirty[NUM_CHUNKS]);
+
+void lightChanged(int dirty[NUM_CHUNKS], int x, int y, int z);
+
+int faceLight(LightMap* light, int x, int y, int z);
+
+int solidAt(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], double x, double y, double z);
+
+int pointsCollide(double points[][3], int count, int axis, double distance, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE]);
+
+int spawnEntity(EntityStore* entities, int kind, float x, float y, float z);
+
+void removeEntity(EntityStore* entities, int i);
+
+int entityRandom(EntityStore* entities);
+
+void spawnMobs(EntityStore* entities, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int seed, int count);
+
+void dropItem(EntityStore* entities, int block, int x, int y, int z);
+
+void entityCorners(EntityStore* entities, int i, double corners[8][3]);
+
+void moveEntities(EntityStore* entities, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], double elapsed);
+
+int entityBucket(float x, float y, float z);
+
+void buildEntityHash(EntityStore* entities);
+
+int queryEntities(EntityStore* entities, float x, float y, float z, float radius, int found[], int max);
+
+void separateMobs(EntityStore* entities);
+
+int collectItems(EntityStore* entities, double playerPos[3]);
+
+void steerEntities(EntityStore* entities, double elapsed);
+
+void updateEntities(EntityStore* entities, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], double playerPos[3], double elapsed);
+
+void drawEntities(EntityStore* entities, double playerPos[3], double playerRot[3], int blockColors[][3]);
+
+void beginEdit(EditLog* edits);
+
+void endEdit(EditLog* edits);
+
+void markUnsaved(EditLog* edits, int cell);
+
+void setBlock(EditLog* edits, UpdateQueue* updates, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int x, int y, int z, int block);
+
+void regionBounds(int a[3], int b[3], int from[3], int to[3]);
+
+int fillRegion(EditLog* edits, UpdateQueue* updates, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int a[3], int b[3], int block, int match);
+
+void copyRegion(EditLog* edits, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int a[3], int b[3]);
+
+int pasteRegion(EditLog* edits, UpdateQueue* updates, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int at[3]);
+
+void restoreBlock(EditLog* edits, UpdateQueue* updates, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int cell, int block);
+
+int undoEdit(EditLog* edits, UpdateQueue* updates, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE]);
+
+int redoEdit(EditLog* edits, UpdateQueue* updates, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE]);
+
+void editCommand(EditLog* edits, UpdateQueue* updates, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int key, int blocksTouching[2][3], int blockType);
+
+long saveEdits(EditLog* edits, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int full);
+
+int loadEdits(EditLog* edits, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE]);
+
+void loadWorld(WorldLoad* load);
+
+void* loadWorldThread(void* load);
+
+void drawLoading(int frame, double elapsed);
+
+unsigned int hashPosition(int seed, int x, int y, int z);
+
+void generateStreamChunk(int seed, int chunkX, int chunkY, int chunkZ, signed char blocks[CHUNK_CELLS]);
+
+void openChunkCache(ChunkCache* cache, long budget, int size[3], int seed, int file, int prefetch);
+
+void closeChunkCache(ChunkCache* cache);
+
+int findChunk(ChunkCache* cache, int key[3]);
+
+double chunkDistance(ChunkCache* cache, int key[3]);
+
+int claimChunk(ChunkCache* cache, int key[3], double limit);
+
+void fillChunk(ChunkCache* cache, StreamChunk* chunk);
+
+StreamChunk* useChunk(ChunkCache* cache, int chunkX, int chunkY, int chunkZ);
+
+void releaseChunk(ChunkCache* cache, StreamChunk* chunk);
+
+int streamBlock(ChunkCache* cache, int x, int y, int z);
+
+void prefetchAhead(ChunkCache* cache, double playerPos[3], double playerMove[3], int radius);
+
+void* prefetchWorker(void* cache);
+
+void buildBrickMap(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE]);
+
+void updateBrickMap(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int x, int y, int z);
+
+BrickMap* brickMapFor(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE]);
+
+int brickIndex(int x, int y, int z);
+
+int brickBit(int x, int y, int z);
+
+int brickSolid(BrickMap* bricks, int x, int y, int z);
+
+void buildHeightMap(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE]);
+
+void updateHeightMap(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int x, int y, int z);
+
+HeightMap* heightMapFor(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE]);
+
+void setColumnHeight(HeightMap* heights, int x, int z, int height);
+
+int columnHeight(HeightMap* heights, int x, int z);
+
+int surfaceBlock(HeightMap* heights, int x, int z);
+
+int highestBlock(HeightMap* heights);
+
+int castRay(double origin[3], double direction[3], int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], BrickMap* bricks, LightMap* light, chtype* cell, int* cellLight, float* depth);
+
+int raymarchRows(int first, int step);
+
+void* raymarchWorker(void* id);
+
+void startRaymarch(int threads);
+
+void stopRaymarch();
+
+int drawRaymarch(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], LightMap* light, double playerPos[3], double playerRot[3]);
+
+int watchEvents(int epoll, int fd, unsigned int source);
+
+int openTimer(int epoll, double period, unsigned int source);
+
+void openEventLoop(int input, int connection, double fps, double autosave);
+
+void waitForFrame();
+
+void pumpInput(double now);
+
+int nextAction();
+
+void presentFrame();
+
+void closeEventLoop();
+
+int socketAddress(const char* address, struct sockaddr_storage* addr, socklen_t* length);
+
+int openServerSocket(const char* address);
+
+int joinServer(const char* address, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int* playerId, unsigned char* buffer, int* bufferLength);
+
+void runServer(int listener, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], double seconds, ServerStats* stats);
+
+void serverAccept(int listener, int epoll, NetPlayer players[MAX_CLIENTS], int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE]);
+
+void serverRead(NetPlayer* player);
+
+void serverTick(NetPlayer players[MAX_CLIENTS], int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], UpdateQueue* updates, ServerStats* stats);
+
+void dropPlayer(NetPlayer players[MAX_CLIENTS], int id);
+
+int compressWorld(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], unsigned char* out);
+
+void decompressWorld(const unsigned char* in, int length, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE]);
+
+void queueMessage(NetPlayer* player, int type, const void* payload, int length);
+
+int flushMessages(NetPlayer* player);
+
+int receiveBytes(int socket, unsigned char* buffer, int* length);
+
+int takeMessage(unsigned char* buffer, int* length, int* offset, int* type, unsigned char** payload, int* payloadLength);
+
+int sendKeys(NetPlayer* server, int keys[], int count);
+
+int clientInputs(NetPlayer* server, int* menu, int* toggle, int* blockType);
+
+int clientReceive(int socket, unsigned char* buffer, int* length, int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], UpdateQueue* updates, int playerId, double playerPos[3], double playerRot[3], NetPlayer others[MAX_CLIENTS], int* edited);
+
+void drawPlayers(NetPlayer others[MAX_CLIENTS], int playerId, double playerPos[3], double playerRot[3]);
+
+void stopServer(int signal);
+
+void openHeadlessScreen(int lines, int cols);
+
+// ==================================================> GLOBAL <==================================================
+
+extern double deltaTime;
+
+extern Profiler profiler;
+
+extern Arena frameArena;
+
+extern const char* stageNames[NUM_STAGES];
+
+extern const char* counterNames[NUM_COUNTERS];
+
+extern Journal journal;
+
+extern EventLoop events;
+
+extern volatile sig_atomic_t serverStopping;
+
+extern Viewport viewport;
+
+extern Raymarcher raymarcher;
+
+extern BrickMap brickmap;
+
+extern HeightMap heightmap;
+
+extern volatile sig_atomic_t terminalResized;
+
+extern int (*const fillVariants[2][2])(FillJob* job);
+
+extern int blockColors[][3];
+
+#endif
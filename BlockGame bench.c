@@ -0,0 +1,1975 @@
+// ==================================================> INCLUDES <==================================================
+
+#include "BlockGame Final project.h"
+#include <sys/syscall.h>
+#include <linux/perf_event.h> // For counting cache misses in benchmarks
+
+// Fixtures, samples and probes of the standalone benchmarks
+#define NUM_FIXTURES 4
+#define MAX_SAMPLES 1000
+#define NUM_PROBES 256
+// each sample runs a stage enough times to take about this long, so the clock's resolution doesn't matter
+#define SAMPLE_TIME 0.002
+
+// ==================================================> STRUCTS <==================================================
+
+// A world every stage runs against and everything the later stages read from the ones before them
+typedef struct fixture {
+	const char* name;
+	const char* description;
+	int seed;
+	int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE];
+	ChunkMesh mesh[NUM_CHUNKS];
+	LightMap light;
+	int chunkVisible[CHUNKS][CHUNKS][CHUNKS];
+	double camera[6];
+	float screenCoords[NUM_CHUNKS][CHUNK_VERTICIES][3];
+	// the triangles cullBack keeps, before they are sorted
+	int culled[MAX_TRIANGLES];
+	int drawOrder[MAX_TRIANGLES];
+	DrawCommand commands[MAX_TRIANGLES];
+	int numDraw;
+	// where the player stands, looks and moves for picking and collisions
+	double probePos[NUM_PROBES][3];
+	double probeRot[NUM_PROBES][3];
+	double probeMove[NUM_PROBES][3];
+}Fixture;
+
+// One part of the engine timed on its own. run does it once and returns how much work it did
+typedef struct stage {
+	const char* name;
+	const char* description;
+	long (*run)(Fixture* fixture);
+}Stage;
+
+// Nanoseconds per call of one stage on one fixture
+typedef struct result {
+	const Fixture* fixture;
+	const Stage* stage;
+	int calls;
+	long work;
+	double samples[MAX_SAMPLES];
+	double min;
+	double median;
+	double mean;
+	double max;
+}Result;
+
+// ==================================================> PROTOTYPES <==================================================
+
+void makeFixture(Fixture* fixture);
+
+void prepareFixture(Fixture* fixture);
+
+long stageTerrain(Fixture* fixture);
+
+long stageMesh(Fixture* fixture);
+
+long stageTransform(Fixture* fixture);
+
+long stageCull(Fixture* fixture);
+
+long stageSort(Fixture* fixture);
+
+long stageFill(Fixture* fixture);
+
+long stageCollide(Fixture* fixture);
+
+long stagePick(Fixture* fixture);
+
+long stageSave(Fixture* fixture);
+
+long stageLoad(Fixture* fixture);
+
+void timeStage(Fixture* fixture, const Stage* stage, int warmup, int reps, Result* result);
+
+int compareDoubles(const void* a, const void* b);
+
+void writeJson(FILE* file, Result* results, int numResults, int warmup, int reps);
+
+void* __real_malloc(size_t size);
+
+void* __real_calloc(size_t count, size_t size);
+
+void* __real_realloc(void* pointer, size_t size);
+
+void* __wrap_malloc(size_t size);
+
+void* __wrap_calloc(size_t count, size_t size);
+
+void* __wrap_realloc(void* pointer, size_t size);
+
+int runBenchmark(const char* name);
+
+void runBot(const char* address, int seed);
+
+void carveCaves(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int seed, int caves);
+
+void makeCaveWorld(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int seed);
+
+void showAllChunks(int chunkVisible[CHUNKS][CHUNKS][CHUNKS]);
+
+void benchOcclusion();
+
+void benchMesh();
+
+void benchRaster();
+
+int openCacheCounter();
+
+long readCacheCounter(int counter);
+
+void benchNetwork();
+
+void benchLatency();
+
+void benchUpdates();
+
+void benchLight();
+
+void benchScale();
+
+void benchColor();
+
+void benchEntities();
+
+void benchArena();
+
+void benchEdits();
+
+void benchStartup();
+
+void benchFixed();
+
+void benchVariants();
+
+void benchRaymarch();
+
+void benchBrickmap();
+
+void benchStream();
+
+void benchHeightmap();
+
+// ==================================================> GLOBAL <==================================================
+
+// Heap calls counted for the arena benchmark. the world loader allocates on its own thread, so it is counted atomically
+long heapCalls;
+
+// seed 0 is the flat test world, the random seed can be changed with --seed
+Fixture fixtures[NUM_FIXTURES] = {
+	{.name = "seed0", .description = "the flat world with a tree from seed 0", .seed = 0},
+	{.name = "random", .description = "a generated world", .seed = 1234},
+	{.name = "caves", .description = "solid ground up to y = 12 with caves carved through it", .seed = 7},
+	{.name = "dense", .description = "every other block solid like a 3D checkerboard, the most faces a world can have", .seed = 0}
+};
+
+// in pipeline order
+const Stage stages[] = {
+	{"terrain", "generateTerrain, plus the caves or checkerboard of those fixtures", stageTerrain},
+	{"mesh", "generatePolygons for the whole world", stageMesh},
+	{"transform", "convertScreen for every chunk", stageTransform},
+	{"cull", "cullBack of every triangle", stageCull},
+	{"sort", "orderPoly of the triangles cullBack kept", stageSort},
+	{"fill", "fillPolygon for every triangle of the frame into a 200x50 viewport", stageFill},
+	{"collide", "checkCollisions from each of 256 places and moves", stageCollide},
+	{"pick", "playerTouching from each of 256 places and directions", stagePick},
+	{"save", "saveWorld", stageSave},
+	{"load", "loadTerrain of the saved world", stageLoad}
+};
+
+#define NUM_STAGES_TIMED ((int)(sizeof(stages) / sizeof(stages[0])))
+
+// ==================================================> MAIN <==================================================
+
+int main(int argc, char* argv[]) {
+	// the locale lets ncurses draw the half block characters
+	setlocale(LC_ALL, "");
+	int warmup = 3;
+	int reps = 15;
+	const char* fixtureName = "all";
+	const char* stageName = "all";
+	const char* jsonFile = NULL;
+	
+	// Command line options
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--bench") == 0) {
+			// the older benchmarks each measure one feature their own way: ./blockbench --bench <name>
+			return runBenchmark(i + 1 < argc ? argv[i + 1] : "all");
+		} else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+			warmup = atoi(argv[++i]);
+			if (warmup < 0) warmup = 0;
+		} else if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc) {
+			reps = atoi(argv[++i]);
+			if (reps < 1) reps = 1;
+			if (reps > MAX_SAMPLES) reps = MAX_SAMPLES;
+		} else if (strcmp(argv[i], "--fixture") == 0 && i + 1 < argc) {
+			fixtureName = argv[++i];
+		} else if (strcmp(argv[i], "--stage") == 0 && i + 1 < argc) {
+			stageName = argv[++i];
+		} else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+			fixtures[1].seed = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+			jsonFile = argv[++i];
+		} else if (strcmp(argv[i], "--list") == 0) {
+			for (int f = 0; f < NUM_FIXTURES; f++) printf("fixture %-10s %s\n", fixtures[f].name, fixtures[f].description);
+			for (int s = 0; s < NUM_STAGES_TIMED; s++) printf("stage   %-10s %s\n", stages[s].name, stages[s].description);
+			return 0;
+		} else {
+			printf("Usage: %s [--fixture name|all] [--stage name|all] [--warmup samples] [--reps samples] [--seed number] [--json results.json] [--list] [--bench name]\n", argv[0]);
+			return 1;
+		}
+	}
+	
+	int runFixture[NUM_FIXTURES], runStage[NUM_STAGES_TIMED];
+	int numFixtures = 0, numStages = 0;
+	for (int f = 0; f < NUM_FIXTURES; f++) numFixtures += runFixture[f] = strcmp(fixtureName, "all") == 0 || strcmp(fixtureName, fixtures[f].name) == 0;
+	for (int s = 0; s < NUM_STAGES_TIMED; s++) numStages += runStage[s] = strcmp(stageName, "all") == 0 || strcmp(stageName, stages[s].name) == 0;
+	if (numFixtures == 0 || numStages == 0) {
+		printf("Unknown %s: %s (see --list)\n", numFixtures == 0 ? "fixture" : "stage", numFixtures == 0 ? fixtureName : stageName);
+		return 1;
+	}
+	
+	FILE* json = NULL;
+	if (jsonFile) {
+		json = fopen(jsonFile, "w");
+		if (json == NULL) {
+			printf("Could not open %s\n", jsonFile);
+			return 1;
+		}
+	}
+	
+	// saveWorld always writes world.txt in the working directory, so the benchmark works in a directory of its own
+	char directory[] = "/tmp/blockbench.XXXXXX";
+	char* previous = getcwd(NULL, 0);
+	if (previous == NULL || mkdtemp(directory) == NULL || chdir(directory) != 0) {
+		printf("Could not make a directory to save worlds in\n");
+		return 1;
+	}
+	
+	openHeadlessScreen(50, 200);
+	Result* results = malloc(numFixtures * numStages * sizeof(Result));
+	int numResults = 0;
+	for (int f = 0; f < NUM_FIXTURES; f++) {
+		if (!runFixture[f]) continue;
+		prepareFixture(&fixtures[f]);
+		for (int s = 0; s < NUM_STAGES_TIMED; s++) {
+			if (runStage[s]) timeStage(&fixtures[f], &stages[s], warmup, reps, &results[numResults++]);
+		}
+	}
+	endwin();
+	
+	printf("%d warmup and %d timed samples of each stage, times are per call\n", warmup, reps);
+	printf("%-8s %-10s %8s %12s %12s %12s %12s %12s\n", "fixture", "stage", "calls", "min us", "median us", "mean us", "max us", "work");
+	for (int i = 0; i < numResults; i++) {
+		Result* result = &results[i];
+		printf("%-8s %-10s %8d %12.3f %12.3f %12.3f %12.3f %12ld\n", result->fixture->name, result->stage->name, result->calls,
+			result->min / 1000, result->median / 1000, result->mean / 1000, result->max / 1000, result->work);
+	}
+	if (json) {
+		writeJson(json, results, numResults, warmup, reps);
+		fclose(json);
+	}
+	
+	free(results);
+	unlink("world.txt");
+	if (chdir(previous) == 0) rmdir(directory);
+	free(previous);
+	return 0;
+}
+
+// ==================================================> FUNCTIONS <==================================================
+
+// Builds the blocks of a fixture. the same fixture always comes out the same
+void makeFixture(Fixture* fixture) {
+	if (strcmp(fixture->name, "dense") == 0) {
+		for (int x = 0; x < WORLD_SIZE; x++) {
+			for (int y = 0; y < WORLD_SIZE; y++) {
+				for (int z = 0; z < WORLD_SIZE; z++) {
+					fixture->blockPositions[x][y][z] = (x + y + z) % 2 == 0 ? 2 : -1;
+				}
+			}
+		}
+		buildHeightMap(fixture->blockPositions);
+		return;
+	}
+	if (strcmp(fixture->name, "caves") == 0) {
+		makeCaveWorld(fixture->blockPositions, fixture->seed);
+		buildHeightMap(fixture->blockPositions);
+	} else {
+		generateTerrain(fixture->blockPositions, fixture->seed);
+	}
+}
+
+// Runs the whole pipeline once so every stage has the input it would have in a frame, and picks the probes
+void prepareFixture(Fixture* fixture) {
+	// looking across the world from one corner, like the variants benchmark
+	double camera[6] = {4, 24, 4, -20, -135, 0};
+	memcpy(fixture->camera, camera, sizeof(camera));
+	
+	makeFixture(fixture);
+	computeLight(&fixture->light, fixture->blockPositions);
+	generatePolygons(fixture->blockPositions, fixture->mesh, blockColors, &fixture->light);
+	showAllChunks(fixture->chunkVisible);
+	convertScreen(fixture->mesh, fixture->screenCoords, fixture->camera, &fixture->camera[3], fixture->chunkVisible);
+	arenaReset(&frameArena);
+	int occluded;
+	fixture->numDraw = cullBack(fixture->mesh, fixture->screenCoords, fixture->culled, fixture->chunkVisible, &occluded);
+	memcpy(fixture->drawOrder, fixture->culled, fixture->numDraw * sizeof(int));
+	orderPoly(fixture->mesh, fixture->screenCoords, fixture->drawOrder, fixture->numDraw);
+	buildDrawCommands(fixture->mesh, fixture->screenCoords, fixture->drawOrder, fixture->numDraw, fixture->commands);
+	saveWorld(fixture->blockPositions, NULL);
+	
+	// anywhere in the world looking and moving anywhere, the same for every fixture
+	srand(13);
+	for (int i = 0; i < NUM_PROBES; i++) {
+		for (int a = 0; a < 3; a++) fixture->probePos[i][a] = (double)rand() / RAND_MAX * WORLD_SIZE * 2;
+		fixture->probeRot[i][0] = (double)rand() / RAND_MAX * 180 - 90;
+		fixture->probeRot[i][1] = (double)rand() / RAND_MAX * 360 - 180;
+		fixture->probeRot[i][2] = 0;
+		for (int a = 0; a < 3; a++) fixture->probeMove[i][a] = (double)rand() / RAND_MAX - 0.5;
+	}
+	deltaTime = 1;
+}
+
+// Builds the fixture's world again in place. returns the solid blocks
+long stageTerrain(Fixture* fixture) {
+	makeFixture(fixture);
+	long solid = 0;
+	for (int i = 0; i < NUM_CELLS; i++) solid += (&fixture->blockPositions[0][0][0])[i] != -1;
+	return solid;
+}
+
+// Meshes every chunk. returns the faces
+long stageMesh(Fixture* fixture) {
+	generatePolygons(fixture->blockPositions, fixture->mesh, blockColors, &fixture->light);
+	long faces = 0;
+	for (int i = 0; i < NUM_CHUNKS; i++) faces += fixture->mesh[i].numFaces;
+	return faces;
+}
+
+// Projects every vertex. returns the vertices
+long stageTransform(Fixture* fixture) {
+	convertScreen(fixture->mesh, fixture->screenCoords, fixture->camera, &fixture->camera[3], fixture->chunkVisible);
+	long vertices = 0;
+	for (int i = 0; i < NUM_CHUNKS; i++) vertices += fixture->mesh[i].numVertices;
+	return vertices;
+}
+
+// Drops the triangles facing away or off the screen. returns the ones kept
+long stageCull(Fixture* fixture) {
+	int occluded;
+	arenaReset(&frameArena);
+	return cullBack(fixture->mesh, fixture->screenCoords, fixture->drawOrder, fixture->chunkVisible, &occluded);
+}
+
+// Sorts the triangles back to front. they are copied from the culled order first, as a frame would sort them, so the copy is timed too
+long stageSort(Fixture* fixture) {
+	arenaReset(&frameArena);
+	memcpy(fixture->drawOrder, fixture->culled, fixture->numDraw * sizeof(int));
+	orderPoly(fixture->mesh, fixture->screenCoords, fixture->drawOrder, fixture->numDraw);
+	return fixture->numDraw;
+}
+
+// Fills every triangle of the frame into a cleared viewport. returns the cells filled
+long stageFill(Fixture* fixture) {
+	long filled = 0;
+	clearViewport();
+	for (int i = 0; i < fixture->numDraw; i++) {
+		DrawCommand* command = &fixture->commands[i];
+		filled += fillPolygon(command->points, command->color, command->glyph, command->light);
+	}
+	return filled;
+}
+
+// Moves the player once from each probe. returns how many ended up on the ground
+long stageCollide(Fixture* fixture) {
+	long grounded = 0;
+	double playerPos[3], playerMove[3];
+	for (int probe = 0; probe < NUM_PROBES; probe++) {
+		memcpy(playerPos, fixture->probePos[probe], sizeof(playerPos));
+		memcpy(playerMove, fixture->probeMove[probe], sizeof(playerMove));
+		grounded += checkCollisions(playerPos, playerMove, fixture->blockPositions);
+	}
+	return grounded;
+}
+
+// Finds the block each probe is looking at. returns how many found one
+long stagePick(Fixture* fixture) {
+	long picked = 0;
+	int blocksTouching[2][3];
+	for (int probe = 0; probe < NUM_PROBES; probe++) {
+		playerTouching(fixture->probePos[probe], fixture->probeRot[probe], fixture->blockPositions, blocksTouching);
+		picked += blocksTouching[1][0] != -1;
+	}
+	return picked;
+}
+
+// Writes the world to world.txt. returns the blocks written
+long stageSave(Fixture* fixture) {
+	saveWorld(fixture->blockPositions, NULL);
+	return NUM_CELLS;
+}
+
+// Reads world.txt back into the fixture, which is the same world. returns the blocks read
+long stageLoad(Fixture* fixture) {
+	FILE* level = fopen("world.txt", "r");
+	if (level == NULL) return 0;
+	loadTerrain(fixture->blockPositions, level);
+	fclose(level);
+	return NUM_CELLS;
+}
+
+// Times one stage on one fixture. the first warmup sample also works out how many calls make a sample long enough to time
+void timeStage(Fixture* fixture, const Stage* stage, int warmup, int reps, Result* result) {
+	int calls = 1;
+	double start = getTime();
+	stage->run(fixture);
+	double once = getTime() - start;
+	if (once < SAMPLE_TIME) calls = once > 0 ? (int)(SAMPLE_TIME / once) + 1 : 1000;
+	
+	result->fixture = fixture;
+	result->stage = stage;
+	result->calls = calls;
+	result->work = 0;
+	for (int sample = -warmup; sample < reps; sample++) {
+		long work = 0;
+		start = getTime();
+		for (int call = 0; call < calls; call++) work += stage->run(fixture);
+		double time = getTime() - start;
+		if (sample < 0) continue;
+		result->samples[sample] = time / calls * 1e9;
+		// work per call, which is the same in every sample
+		result->work = work / calls;
+	}
+	
+	double sorted[MAX_SAMPLES];
+	memcpy(sorted, result->samples, reps * sizeof(double));
+	qsort(sorted, reps, sizeof(double), compareDoubles);
+	result->min = sorted[0];
+	result->max = sorted[reps - 1];
+	result->median = reps % 2 ? sorted[reps / 2] : (sorted[reps / 2 - 1] + sorted[reps / 2]) / 2;
+	result->mean = 0;
+	for (int i = 0; i < reps; i++) result->mean += sorted[i] / reps;
+}
+
+// Ascending order for qsort
+int compareDoubles(const void* a, const void* b) {
+	double x = *(const double*)a, y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+// Every result with its samples, in nanoseconds per call
+void writeJson(FILE* file, Result* results, int numResults, int warmup, int reps) {
+	fprintf(file, "{\n\t\"warmup\": %d,\n\t\"reps\": %d,\n\t\"world_size\": %d,\n\t\"results\": [\n", warmup, reps, WORLD_SIZE);
+	for (int i = 0; i < numResults; i++) {
+		Result* result = &results[i];
+		fprintf(file, "\t\t{\"fixture\": \"%s\", \"seed\": %d, \"stage\": \"%s\", \"calls\": %d, \"work\": %ld, ", result->fixture->name, result->fixture->seed, result->stage->name, result->calls, result->work);
+		fprintf(file, "\"min_ns\": %.1f, \"median_ns\": %.1f, \"mean_ns\": %.1f, \"max_ns\": %.1f, \"samples_ns\": [", result->min, result->median, result->mean, result->max);
+		for (int sample = 0; sample < reps; sample++) fprintf(file, "%s%.1f", sample ? ", " : "", result->samples[sample]);
+		fprintf(file, "]}%s\n", i + 1 < numResults ? "," : "");
+	}
+	fprintf(file, "\t]\n}\n");
+}
+
+// ==================================================> BENCHMARKS <==================================================
+
+// The bench is linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc, so every heap call the engine makes comes through here first
+// (without them __real_malloc is missing and it doesn't link). ncurses is a shared library and its own allocations aren't seen
+void* __wrap_malloc(size_t size) {
+	__atomic_add_fetch(&heapCalls, 1, __ATOMIC_RELAXED);
+	return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+	__atomic_add_fetch(&heapCalls, 1, __ATOMIC_RELAXED);
+	return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* pointer, size_t size) {
+	__atomic_add_fetch(&heapCalls, 1, __ATOMIC_RELAXED);
+	return __real_realloc(pointer, size);
+}
+
+// Runs the benchmark with the given name, or all of them
+int runBenchmark(const char* name) {
+	int found = 0;
+	deltaTime = 1;
+	if (strcmp(name, "all") == 0 || strcmp(name, "occlusion") == 0) {
+		benchOcclusion();
+		found = 1;
+	}
+	if (strcmp(name, "all") == 0 || strcmp(name, "mesh") == 0) {
+		benchMesh();
+		found = 1;
+	}
+	if (strcmp(name, "all") == 0 || strcmp(name, "raster") == 0) {
+		benchRaster();
+		found = 1;
+	}
+	if (strcmp(name, "all") == 0 || strcmp(name, "net") == 0) {
+		benchNetwork();
+		found = 1;
+	}
+	if (strcmp(name, "all") == 0 || strcmp(name, "latency") == 0) {
+		benchLatency();
+		found = 1;
+	}
+	if (strcmp(name, "all") == 0 || strcmp(name, "updates") == 0) {
+		benchUpdates();
+		found = 1;
+	}
+	if (strcmp(name, "all") == 0 || strcmp(name, "light") == 0) {
+		benchLight();
+		found = 1;
+	}
+	if (strcmp(name, "all") == 0 || strcmp(name, "scale") == 0) {
+		benchScale();
+		found = 1;
+	}
+	if (strcmp(name, "all") == 0 || strcmp(name, "color") == 0) {
+		benchColor();
+		found = 1;
+	}
+	if (strcmp(name, "all") == 0 || strcmp(name, "entities") == 0) {
+		benchEntities();
+		found = 1;
+	}
+	if (strcmp(name, "all") == 0 || strcmp(name, "arena") == 0) {
+		benchArena();
+		found = 1;
+	}
+	if (strcmp(name, "all") == 0 || strcmp(name, "edits") == 0) {
+		benchEdits();
+		found = 1;
+	}
+	if (strcmp(name, "all") == 0 || strcmp(name, "startup") == 0) {
+		benchStartup();
+		found = 1;
+	}
+	if (strcmp(name, "all") == 0 || strcmp(name, "fixed") == 0) {
+		benchFixed();
+		found = 1;
+	}
+	if (strcmp(name, "all") == 0 || strcmp(name, "variants") == 0) {
+		benchVariants();
+		found = 1;
+	}
+	if (strcmp(name, "all") == 0 || strcmp(name, "raymarch") == 0) {
+		benchRaymarch();
+		found = 1;
+	}
+	if (strcmp(name, "all") == 0 || strcmp(name, "brickmap") == 0) {
+		benchBrickmap();
+		found = 1;
+	}
+	if (strcmp(name, "all") == 0 || strcmp(name, "stream") == 0) {
+		benchStream();
+		found = 1;
+	}
+	if (strcmp(name, "all") == 0 || strcmp(name, "heightmap") == 0) {
+		benchHeightmap();
+		found = 1;
+	}
+	if (!found) {
+		printf("Unknown benchmark: %s\n", name);
+		printf("Benchmarks: occlusion, mesh, raster, net, latency, updates, light, scale, color, entities, arena, edits, startup, fixed, variants, raymarch, brickmap, stream, heightmap, all\n");
+		return 1;
+	}
+	return 0;
+}
+
+// A fake player for load testing. presses random keys at the tick rate until the server closes the connection
+void runBot(const char* address, int seed) {
+	static int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE];
+	int keys[] = {KEY_UP, KEY_DOWN, KEY_LEFT, KEY_RIGHT, 'w', 'a', 's', 'd', ' ', 'z', 'x'};
+	unsigned char* buffer = malloc(NET_BUFFER);
+	int length = 0;
+	int playerId;
+	int connection = joinServer(address, blockPositions, &playerId, buffer, &length);
+	NetPlayer server = {.active = 1, .socket = connection, .out = malloc(NET_BUFFER)};
+	srand(seed);
+	
+	while (connection != -1) {
+		struct pollfd fd = {connection, POLLIN, 0};
+		poll(&fd, 1, 1000 / TICK_RATE);
+		length = 0;
+		if (receiveBytes(connection, buffer, &length) == -1) break;
+		int key = keys[rand() % (rand() % 20 == 0 ? 11 : 9)];
+		if (sendKeys(&server, &key, 1) == -1) break;
+	}
+	if (connection != -1) close(connection);
+	free(server.out);
+	free(buffer);
+}
+
+// Hollows out random spheres of air below the surface of a world
+void carveCaves(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int seed, int caves) {
+	srand(seed);
+	for (int i = 0; i < caves; i++) {
+		int cx = rand() % WORLD_SIZE;
+		int cy = rand() % (WORLD_SIZE / 2) + 1;
+		int cz = rand() % WORLD_SIZE;
+		int radius = rand() % 2 + 1;
+		for (int x = cx - radius; x <= cx + radius; x++) {
+			for (int y = cy - radius; y <= cy + radius; y++) {
+				for (int z = cz - radius; z <= cz + radius; z++) {
+					if (x < 0 || y < 1 || z < 0 || x >= WORLD_SIZE || y >= WORLD_SIZE || z >= WORLD_SIZE) continue;
+					if ((x-cx)*(x-cx) + (y-cy)*(y-cy) + (z-cz)*(z-cz) <= radius*radius) blockPositions[x][y][z] = -1;
+				}
+			}
+		}
+	}
+}
+
+// Makes the dense cave world most benchmarks share: the terrain with solid ground up to y = 12 and caves inside it
+void makeCaveWorld(int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE], int seed) {
+	generateTerrain(blockPositions, seed);
+	for (int x = 0; x < WORLD_SIZE; x++) {
+		for (int y = 8; y < 12; y++) {
+			for (int z = 0; z < WORLD_SIZE; z++) {
+				blockPositions[x][y][z] = 2;
+			}
+		}
+	}
+	carveCaves(blockPositions, seed, 24);
+}
+
+// Marks every chunk visible, for timing the pipeline without occlusion culling
+void showAllChunks(int chunkVisible[CHUNKS][CHUNKS][CHUNKS]) {
+	for (int x = 0; x < CHUNKS; x++) for (int y = 0; y < CHUNKS; y++) for (int z = 0; z < CHUNKS; z++) chunkVisible[x][y][z] = 1;
+}
+
+// Times the render pipeline in a dense world full of caves with and without occlusion culling
+void benchOcclusion() {
+	static int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE];
+	static ChunkMesh mesh[NUM_CHUNKS];
+	static float screenCoords[NUM_CHUNKS][CHUNK_VERTICIES][3];
+	static int drawOrder[MAX_TRIANGLES];
+	static DrawCommand commands[MAX_TRIANGLES];
+	static int chunkConnections[CHUNKS][CHUNKS][CHUNKS][6];
+	int chunkVisible[CHUNKS][CHUNKS][CHUNKS];
+	int frames = 200;
+	double cameras[4][6] = {
+		{16, 30, 16, -60, 0, 0},
+		{4, 28, 4, -30, -135, 0},
+		{30, 26, 2, -20, 45, 0},
+		{16, 14, 16, 0, 90, 0}
+	};
+	
+	makeCaveWorld(blockPositions, 7);
+	
+	generatePolygons(blockPositions, mesh, blockColors, NULL);
+	computeChunkConnections(blockPositions, chunkConnections);
+	int numTriangles = 0;
+	for (int c = 0; c < NUM_CHUNKS; c++) numTriangles += mesh[c].numFaces * 2;
+	
+	openHeadlessScreen(50, 200);
+	printf("occlusion: dense cave world, %d triangles, %d frames per camera\n", numTriangles, frames);
+	printf("%-8s %10s %10s %10s %10s %8s\n", "camera", "off ms", "on ms", "drawn off", "drawn on", "culled");
+	
+	for (int c = 0; c < 4; c++) {
+		double* playerPos = cameras[c];
+		double* playerRot = &cameras[c][3];
+		double time[2];
+		int drawn[2];
+		int culled = 0;
+		
+		for (int on = 0; on < 2; on++) {
+			double start = getTime();
+			// the first frames warm up the caches and are not timed
+			for (int frame = -20; frame < frames; frame++) {
+				if (frame == 0) start = getTime();
+				erase();
+				if (on) {
+					cullOcclusion(playerPos, chunkConnections, chunkVisible);
+				} else {
+					showAllChunks(chunkVisible);
+				}
+				convertScreen(mesh, screenCoords, playerPos, playerRot, chunkVisible);
+				arenaReset(&frameArena);
+				drawn[on] = cullBack(mesh, screenCoords, drawOrder, chunkVisible, &culled);
+				orderPoly(mesh, screenCoords, drawOrder, drawn[on]);
+				buildDrawCommands(mesh, screenCoords, drawOrder, drawn[on], commands);
+				drawAll(commands, drawn[on]);
+				refresh();
+			}
+			time[on] = (getTime() - start) * 1000 / frames;
+		}
+		printf("%-8d %10.3f %10.3f %10d %10d %8d\n", c, time[0], time[1], drawn[0], drawn[1], culled);
+	}
+	endwin();
+}
+
+// Compares the packed chunk meshes to the old int[3] vertex and int[4] polygon lists and times the stages that read them
+void benchMesh() {
+	static int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE];
+	static ChunkMesh mesh[NUM_CHUNKS];
+	static float screenCoords[NUM_CHUNKS][CHUNK_VERTICIES][3];
+	static int drawOrder[MAX_TRIANGLES];
+	int chunkVisible[CHUNKS][CHUNKS][CHUNKS];
+	double playerPos[3] = {16, 30, 16};
+	double playerRot[3] = {-45, 30, 0};
+	int seeds[2] = {0, 7};
+	int frames = 2000;
+	int culled;
+	
+	showAllChunks(chunkVisible);
+	int counter = openCacheCounter();
+	
+	printf("mesh: %d frames of convertScreen + cullBack + orderPoly\n", frames);
+	printf("%-6s %9s %10s %10s %10s %10s %12s\n", "seed", "triangles", "old bytes", "new bytes", "mesh ms", "frame ms", "misses/frame");
+	for (int s = 0; s < 2; s++) {
+		generateTerrain(blockPositions, seeds[s]);
+		
+		double start = getTime();
+		for (int i = 0; i < 100; i++) generatePolygons(blockPositions, mesh, blockColors, NULL);
+		double meshTime = (getTime() - start) * 1000 / 100;
+		
+		// the old lists used 12 bytes per vertex and 16 per polygon in fixed 3000 entry arrays
+		int numVertices = 0;
+		int numTriangles = 0;
+		for (int c = 0; c < NUM_CHUNKS; c++) {
+			numVertices += mesh[c].numVertices;
+			numTriangles += mesh[c].numFaces * 2;
+		}
+		long oldBytes = 3000 * 3 * sizeof(int) + 3000 * 4 * sizeof(int);
+		
+		long misses = readCacheCounter(counter);
+		start = getTime();
+		for (int frame = 0; frame < frames; frame++) {
+			playerRot[1] = frame % 360;
+			convertScreen(mesh, screenCoords, playerPos, playerRot, chunkVisible);
+			arenaReset(&frameArena);
+			int numDraw = cullBack(mesh, screenCoords, drawOrder, chunkVisible, &culled);
+			orderPoly(mesh, screenCoords, drawOrder, numDraw);
+		}
+		double frameTime = (getTime() - start) * 1000 / frames;
+		misses = readCacheCounter(counter) - misses;
+		
+		printf("%-6d %9d %10ld %10ld %10.3f %10.4f ", seeds[s], numTriangles, oldBytes, meshBytes(mesh), meshTime, frameTime);
+		if (counter >= 0) printf("%12ld\n", misses / frames);
+		else printf("%12s\n", "n/a");
+	}
+}
+
+// Times building the draw commands and rasterizing them from a few cameras
+void benchRaster() {
+	static int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE];
+	static ChunkMesh mesh[NUM_CHUNKS];
+	static float screenCoords[NUM_CHUNKS][CHUNK_VERTICIES][3];
+	static int drawOrder[MAX_TRIANGLES];
+	static DrawCommand commands[MAX_TRIANGLES];
+	int chunkVisible[CHUNKS][CHUNKS][CHUNKS];
+	int frames = 500;
+	int culled;
+	double cameras[3][6] = {
+		{16, 30, 16, -60, 0, 0},
+		{4, 24, 4, -20, -135, 0},
+		{16, 20, 40, -10, 180, 0}
+	};
+	
+	generateTerrain(blockPositions, 0);
+	generatePolygons(blockPositions, mesh, blockColors, NULL);
+	showAllChunks(chunkVisible);
+	
+	openHeadlessScreen(50, 200);
+	printf("raster: seed 0, 200x50 screen, %d frames per camera\n", frames);
+	printf("%-8s %10s %10s %10s %12s %12s\n", "camera", "triangles", "build ms", "raster ms", "tris/s", "cells/s");
+	for (int c = 0; c < 3; c++) {
+		convertScreen(mesh, screenCoords, cameras[c], &cameras[c][3], chunkVisible);
+		arenaReset(&frameArena);
+		int numDraw = cullBack(mesh, screenCoords, drawOrder, chunkVisible, &culled);
+		orderPoly(mesh, screenCoords, drawOrder, numDraw);
+		
+		double start = getTime();
+		for (int frame = 0; frame < frames; frame++) {
+			buildDrawCommands(mesh, screenCoords, drawOrder, numDraw, commands);
+		}
+		double buildTime = (getTime() - start) / frames;
+		
+		// only the raster loop is timed so the terminal output doesn't hide it
+		long cells = 0;
+		double rasterTime = 0;
+		for (int frame = 0; frame < frames; frame++) {
+			erase();
+			start = getTime();
+			cells += drawAll(commands, numDraw);
+			rasterTime += getTime() - start;
+		}
+		rasterTime /= frames;
+		printf("%-8d %10d %10.4f %10.4f %12.0f %12.0f\n", c, numDraw, buildTime * 1000, rasterTime * 1000, numDraw / rasterTime, cells / frames / rasterTime);
+	}
+	endwin();
+}
+
+// Opens a hardware counter for cache misses in this process. returns -1 if the system doesn't allow it
+int openCacheCounter() {
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof(attr);
+	attr.config = PERF_COUNT_HW_CACHE_MISSES;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// Reads the number of cache misses counted so far
+long readCacheCounter(int counter) {
+	long long count = 0;
+	if (counter < 0 || read(counter, &count, sizeof(count)) != sizeof(count)) return 0;
+	return count;
+}
+
+// Runs a server with 1, 8 and 32 bot clients in their own processes and reports tick time and bandwidth per client
+void benchNetwork() {
+	static int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE];
+	int clientCounts[3] = {1, 8, 32};
+	double seconds = 3;
+	char address[64];
+	
+	printf("Network benchmark (%d ticks/s, %.0f s per run)\n", TICK_RATE, seconds);
+	printf("%8s %10s %14s %14s %18s\n", "clients", "ticks", "tick avg ms", "tick max ms", "KB/s per client");
+	for (int run = 0; run < 3; run++) {
+		generateTerrain(blockPositions, 0);
+		snprintf(address, sizeof(address), "/tmp/blockgame-bench-%d.sock", (int)getpid());
+		int listener = openServerSocket(address);
+		if (listener == -1) {
+			printf("Could not open %s\n", address);
+			return;
+		}
+		
+		pid_t bots[32];
+		for (int i = 0; i < clientCounts[run]; i++) {
+			bots[i] = fork();
+			if (bots[i] == 0) {
+				close(listener);
+				runBot(address, i + 1);
+				_exit(0);
+			}
+		}
+		
+		ServerStats stats;
+		runServer(listener, blockPositions, seconds, &stats);
+		close(listener);
+		unlink(address);
+		for (int i = 0; i < clientCounts[run]; i++) waitpid(bots[i], NULL, 0);
+		
+		printf("%8d %10ld %14.4f %14.4f %18.2f\n", stats.maxClients, stats.ticks, stats.tickTime / stats.ticks * 1000, stats.maxTickTime * 1000, stats.bytesSent / 1024.0 / seconds / clientCounts[run]);
+	}
+}
+
+// Measures the time from a key arriving to the frame that used it being drawn, without a frame cap and at 60 and 30 FPS
+void benchLatency() {
+	static int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE];
+	static ChunkMesh mesh[NUM_CHUNKS];
+	static float screenCoords[NUM_CHUNKS][CHUNK_VERTICIES][3];
+	static int drawOrder[MAX_TRIANGLES];
+	static DrawCommand commands[MAX_TRIANGLES];
+	static int chunkConnections[CHUNKS][CHUNKS][CHUNKS][6];
+	int chunkVisible[CHUNKS][CHUNKS][CHUNKS];
+	double caps[3] = {0, 60, 30};
+	int keys = 100;
+	
+	generateTerrain(blockPositions, 0);
+	generatePolygons(blockPositions, mesh, blockColors, NULL);
+	computeChunkConnections(blockPositions, chunkConnections);
+	
+	printf("Input latency benchmark (%d keys sent through a pipe at random times)\n", keys);
+	printf("%8s %8s %10s %14s %14s %14s\n", "fps cap", "frames", "samples", "frame avg ms", "latency avg ms", "latency max ms");
+	for (int run = 0; run < 3; run++) {
+		// the key pipe stands in for the terminal so ncurses and epoll read from it like stdin
+		int keyPipe[2];
+		if (pipe(keyPipe) == -1) return;
+		FILE* out = fopen("/dev/null", "w");
+		FILE* in = fdopen(keyPipe[0], "r");
+		SCREEN* screen = newterm("xterm", out, in);
+		set_term(screen);
+		resizeterm(50, 200);
+		flushinp();
+		initColors();
+		setViewport(50, 200, 1, 0);
+		keypad(stdscr, TRUE);
+		nodelay(stdscr, TRUE);
+		profiler.terminalFd = fileno(out);
+		memset(&events, 0, sizeof(events));
+		openEventLoop(keyPipe[0], -1, caps[run], 0);
+		
+		pid_t typist = fork();
+		if (typist == 0) {
+			close(keyPipe[0]);
+			srand(run + 1);
+			for (int i = 0; i < keys; i++) {
+				usleep(10000 + rand() % 30000);
+				char key = i % 2 ? 'a' : 'd';
+				if (write(keyPipe[1], &key, 1) != 1) break;
+			}
+			_exit(0);
+		}
+		close(keyPipe[1]);
+		
+		double playerPos[3] = {16, 30, 16};
+		double playerRot[3] = {-45, 30, 0};
+		double playerMove[3] = {0, 0, 0};
+		int menu = 0, grounded = 1, destroy = 0, blockType = 0, toggle = 0;
+		long frames = 0;
+		int typing = 1;
+		double start = getTime();
+		while (typing || events.count > 0) {
+			if (waitpid(typist, NULL, WNOHANG) == typist) typing = 0;
+			waitForFrame();
+			getGameInputs(playerMove, playerRot, &menu, &grounded, &destroy, &blockType, &toggle);
+			menu = 0;
+			cullOcclusion(playerPos, chunkConnections, chunkVisible);
+			convertScreen(mesh, screenCoords, playerPos, playerRot, chunkVisible);
+			int occluded;
+			arenaReset(&frameArena);
+			int numDraw = cullBack(mesh, screenCoords, drawOrder, chunkVisible, &occluded);
+			orderPoly(mesh, screenCoords, drawOrder, numDraw);
+			buildDrawCommands(mesh, screenCoords, drawOrder, numDraw, commands);
+			erase();
+			drawAll(commands, numDraw);
+			refresh();
+			presentFrame();
+			frames++;
+		}
+		double elapsed = getTime() - start;
+		
+		printf("%8s %8ld %10ld %14.3f %14.3f %14.3f\n", caps[run] > 0 ? (run == 1 ? "60" : "30") : "none", frames, events.latencyCount, elapsed / frames * 1000, events.latencyCount ? events.latencyTotal / events.latencyCount * 1000 : 0.0, events.latencyMax * 1000);
+		closeEventLoop();
+		endwin();
+		delscreen(screen);
+		fclose(in);
+		fclose(out);
+	}
+}
+
+// Drops a layer of sand and gravel with water sources on top and times the block ticks until everything settles
+void benchUpdates() {
+	static int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE];
+	static ChunkMesh mesh[NUM_CHUNKS];
+	static UpdateQueue updates;
+	int budgets[2] = {TICK_BUDGET, NUM_CELLS * 8};
+	
+	printf("Block update benchmark (sand and gravel falling into water)\n");
+	printf("%8s %8s %10s %10s %14s %14s %12s %16s\n", "budget", "ticks", "updates", "max/tick", "tick avg ms", "tick max ms", "ns/update", "remesh ms/tick");
+	for (int run = 0; run < 2; run++) {
+		// flat ground up to y = 7, an air gap, then falling blocks with water scattered through the top layer
+		generateTerrain(blockPositions, 0);
+		srand(11);
+		for (int x = 0; x < WORLD_SIZE; x++) {
+			for (int y = 10; y < WORLD_SIZE; y++) {
+				for (int z = 0; z < WORLD_SIZE; z++) {
+					int roll = rand() % 16;
+					if (roll < 9) blockPositions[x][y][z] = BLOCK_SAND;
+					else if (roll < 13) blockPositions[x][y][z] = BLOCK_GRAVEL;
+					else if (roll == 13 && y == WORLD_SIZE - 1) blockPositions[x][y][z] = BLOCK_WATER;
+				}
+			}
+		}
+		generatePolygons(blockPositions, mesh, blockColors, NULL);
+		initBlockUpdates(&updates, blockPositions);
+		
+		long ticks = 0;
+		long maxPerTick = 0;
+		double tickTotal = 0, tickMax = 0, remeshTotal = 0;
+		while (updates.count > 0 && ticks < 2000) {
+			double start = getTime();
+			int done = runBlockUpdates(&updates, blockPositions, budgets[run]);
+			double middle = getTime();
+			remeshDirty(&updates, blockPositions, mesh);
+			double end = getTime();
+			
+			ticks++;
+			if (done > maxPerTick) maxPerTick = done;
+			tickTotal += middle - start;
+			if (middle - start > tickMax) tickMax = middle - start;
+			remeshTotal += end - middle;
+		}
+		
+		printf("%8d %8ld %10ld %10ld %14.4f %14.4f %12.1f %16.4f\n", budgets[run], ticks, updates.processed, maxPerTick, tickTotal / ticks * 1000, tickMax * 1000, tickTotal / updates.processed * 1000000000, remeshTotal / ticks * 1000);
+	}
+}
+
+// Makes random edits in a cave world with lamps and compares updating the light around each edit with lighting the whole world again
+void benchLight() {
+	static int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE];
+	static LightMap light;
+	static LightMap check;
+	static int dirty[NUM_CHUNKS];
+	int edits = 5000;
+	
+	generateTerrain(blockPositions, 7);
+	for (int x = 0; x < WORLD_SIZE; x++) for (int y = 0; y < 12; y++) for (int z = 0; z < WORLD_SIZE; z++) blockPositions[x][y][z] = 1;
+	carveCaves(blockPositions, 7, 24);
+	computeLight(&light, blockPositions);
+	
+	double start = getTime();
+	for (int i = 0; i < 100; i++) computeLight(&check, blockPositions);
+	double fullTime = (getTime() - start) / 100;
+	
+	// digs, builds and places lamps at random, mostly in the top half where the light changes the most
+	srand(5);
+	double editTime = 0;
+	double maxEditTime = 0;
+	int mismatches = 0;
+	for (int i = 0; i < edits; i++) {
+		int x = rand() % WORLD_SIZE;
+		int y = WORLD_SIZE / 2 + rand() % (WORLD_SIZE / 2);
+		int z = rand() % WORLD_SIZE;
+		int roll = rand() % 8;
+		blockPositions[x][y][z] = roll < 4 ? -1 : (roll < 7 ? 1 : BLOCK_LAMP);
+		
+		double editStart = getTime();
+		updateLight(&light, blockPositions, x, y, z, dirty);
+		double elapsed = getTime() - editStart;
+		editTime += elapsed;
+		if (elapsed > maxEditTime) maxEditTime = elapsed;
+		
+		if (i % 500 == 499) {
+			computeLight(&check, blockPositions);
+			mismatches += memcmp(light.level, check.level, sizeof(light.level)) != 0;
+		}
+	}
+	
+	printf("Light benchmark (%d random edits in a cave world)\n", edits);
+	printf("full flood fill       %10.4f ms\n", fullTime * 1000);
+	printf("incremental per edit  %10.4f ms (slowest %.4f ms)\n", editTime / edits * 1000, maxEditTime * 1000);
+	printf("cells visited per edit %9.1f (most %d of %d)\n", (double)light.totalWork / light.edits, light.maxWork, NUM_CELLS * 2);
+	printf("checks against a full flood fill: %d of %d differed\n", mismatches, edits / 500);
+}
+
+// Times rasterizing and presenting a frame at each render scale, then resizes the terminal many times to count reallocations
+void benchScale() {
+	static int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE];
+	static ChunkMesh mesh[NUM_CHUNKS];
+	static float screenCoords[NUM_CHUNKS][CHUNK_VERTICIES][3];
+	static int drawOrder[MAX_TRIANGLES];
+	static DrawCommand commands[MAX_TRIANGLES];
+	int chunkVisible[CHUNKS][CHUNKS][CHUNKS];
+	int frames = 300;
+	int culled;
+	double camera[6] = {16, 30, 16, -60, 0, 0};
+	int scales[4][2] = {{1, 0}, {2, 0}, {4, 0}, {1, 1}};
+	const char* scaleNames[4] = {"full", "half", "quarter", "half-blocks"};
+	
+	generateTerrain(blockPositions, 0);
+	generatePolygons(blockPositions, mesh, blockColors, NULL);
+	showAllChunks(chunkVisible);
+	convertScreen(mesh, screenCoords, camera, &camera[3], chunkVisible);
+	arenaReset(&frameArena);
+	int numDraw = cullBack(mesh, screenCoords, drawOrder, chunkVisible, &culled);
+	orderPoly(mesh, screenCoords, drawOrder, numDraw);
+	buildDrawCommands(mesh, screenCoords, drawOrder, numDraw, commands);
+	
+	openHeadlessScreen(50, 200);
+	printf("scale: seed 0, 200x50 screen, %d triangles, %d frames per scale\n", numDraw, frames);
+	printf("%-12s %10s %10s %12s\n", "scale", "pixels", "frame ms", "cells/frame");
+	for (int i = 0; i < 4; i++) {
+		setViewport(LINES, COLS, scales[i][0], scales[i][1]);
+		if (scales[i][1] && !viewport.halfBlocks) {
+			printf("%-12s not enough color pairs\n", scaleNames[i]);
+			continue;
+		}
+		long cells = 0;
+		double start = getTime();
+		for (int frame = 0; frame < frames; frame++) cells += drawAll(commands, numDraw);
+		double frameTime = (getTime() - start) / frames;
+		printf("%-12s %10d %10.4f %12ld\n", scaleNames[i], viewport.width * viewport.height, frameTime * 1000, cells / frames);
+	}
+	
+	// a window being dragged bigger and smaller sends a resize every few pixels
+	long before = viewport.allocations;
+	for (int i = 0; i < 1000; i++) {
+		int lines = 20 + rand() % 60;
+		int cols = 60 + rand() % 240;
+		resizeterm(lines, cols);
+		setViewport(LINES, COLS, 1, 0);
+		drawAll(commands, numDraw);
+	}
+	printf("1000 random resizes: %ld framebuffer reallocations\n", viewport.allocations - before);
+	endwin();
+}
+
+// Turns the camera a little every frame and compares bytes and write() calls per frame for ncurses and escape sequence output
+void benchColor() {
+	static int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE];
+	static ChunkMesh mesh[NUM_CHUNKS];
+	static float screenCoords[NUM_CHUNKS][CHUNK_VERTICIES][3];
+	static int drawOrder[MAX_TRIANGLES];
+	static DrawCommand commands[MAX_TRIANGLES];
+	static LightMap light;
+	int chunkVisible[CHUNKS][CHUNKS][CHUNKS];
+	int frames = 300;
+	int culled;
+	const char* outputNames[3] = {"ncurses", "256 color", "truecolor"};
+	
+	generateTerrain(blockPositions, 0);
+	computeLight(&light, blockPositions);
+	generatePolygons(blockPositions, mesh, blockColors, &light);
+	showAllChunks(chunkVisible);
+	
+	openHeadlessScreen(50, 200);
+	printf("color: seed 0, 200x50 screen, camera turning 1 degree a frame, %d frames per output\n", frames);
+	printf("%-10s %12s %12s %12s\n", "output", "bytes/frame", "writes/frame", "present ms");
+	for (int mode = OUTPUT_CURSES; mode <= OUTPUT_TRUECOLOR; mode++) {
+		startAnsiOutput(profiler.terminalFd, mode);
+		clearok(curscr, TRUE);
+		long bytes = profiler.terminalBytes;
+		long writes = profiler.terminalWrites;
+		double presentTime = 0;
+		for (int frame = 0; frame < frames; frame++) {
+			double camera[6] = {16, 30, 16, -40, frame, 0};
+			convertScreen(mesh, screenCoords, camera, &camera[3], chunkVisible);
+			arenaReset(&frameArena);
+			int numDraw = cullBack(mesh, screenCoords, drawOrder, chunkVisible, &culled);
+			orderPoly(mesh, screenCoords, drawOrder, numDraw);
+			buildDrawCommands(mesh, screenCoords, drawOrder, numDraw, commands);
+			erase();
+			double start = getTime();
+			drawAll(commands, numDraw);
+			mvprintw(0, 0, "Triangles: %d", numDraw);
+			presentScreen();
+			presentTime += getTime() - start;
+		}
+		printf("%-10s %12ld %12.2f %12.4f\n", outputNames[mode], (profiler.terminalBytes - bytes) / frames, (double)(profiler.terminalWrites - writes) / frames, presentTime / frames * 1000);
+	}
+	startAnsiOutput(profiler.terminalFd, OUTPUT_CURSES);
+	endwin();
+}
+
+// Runs 10000 mobs and items for 600 ticks, timing each part of a tick, and checks the spatial hash finds the same overlaps as testing every pair
+void benchEntities() {
+	static int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE];
+	static EntityStore entities;
+	static int found[MAX_ENTITIES];
+	int ticks = 600;
+	double playerPos[3] = {-100, -100, -100};
+	double times[5] = {0};
+	const char* partNames[5] = {"steer", "hash", "separate", "move", "collect"};
+	
+	generateTerrain(blockPositions, 0);
+	spawnMobs(&entities, blockPositions, 0, 9000);
+	for (int i = 0; i < 1000; i++) {
+		int x = entityRandom(&entities) % WORLD_SIZE;
+		int z = entityRandom(&entities) % WORLD_SIZE;
+		dropItem(&entities, 0, x, WORLD_SIZE - 1, z);
+	}
+	printf("entities: seed 0, %d mobs and items, %d ticks\n", entities.count, ticks);
+	
+	for (int tick = 0; tick < ticks; tick++) {
+		// the calls of updateEntities, timed one at a time
+		double start = getTime();
+		steerEntities(&entities, 1);
+		double steered = getTime();
+		buildEntityHash(&entities);
+		double hashed = getTime();
+		separateMobs(&entities);
+		double separated = getTime();
+		moveEntities(&entities, blockPositions, 1);
+		double moved = getTime();
+		buildEntityHash(&entities);
+		collectItems(&entities, playerPos);
+		double collected = getTime();
+		times[0] += steered - start;
+		times[1] += hashed - steered;
+		times[2] += separated - hashed;
+		times[3] += moved - separated;
+		times[4] += collected - moved;
+	}
+	double total = 0;
+	for (int i = 0; i < 5; i++) {
+		printf("%-10s %8.4f ms per tick\n", partNames[i], times[i] / ticks * 1000);
+		total += times[i];
+	}
+	printf("%-10s %8.4f ms per tick (%.1f ns per entity)\n", "total", total / ticks * 1000, total / ticks / entities.count * 1e9);
+	
+	// every overlap between two mobs found through the hash and by checking all pairs
+	buildEntityHash(&entities);
+	entities.pairsChecked = 0;
+	long hashOverlaps = 0;
+	double start = getTime();
+	for (int i = 0; i < entities.count; i++) {
+		int count = queryEntities(&entities, entities.x[i], entities.y[i] + entities.height[i] / 2, entities.z[i], entities.halfWidth[i], found, MAX_ENTITIES);
+		for (int k = 0; k < count; k++) {
+			int j = found[k];
+			if (j <= i) continue;
+			float dx = entities.x[j] - entities.x[i];
+			float dz = entities.z[j] - entities.z[i];
+			float reach = entities.halfWidth[i] + entities.halfWidth[j];
+			if (fabsf(dx) < reach && fabsf(dz) < reach && fabsf(entities.y[j] - entities.y[i]) < 0.9) hashOverlaps++;
+		}
+	}
+	double hashTime = getTime() - start;
+	long bruteOverlaps = 0;
+	start = getTime();
+	for (int i = 0; i < entities.count; i++) {
+		for (int j = i + 1; j < entities.count; j++) {
+			float dx = entities.x[j] - entities.x[i];
+			float dz = entities.z[j] - entities.z[i];
+			float reach = entities.halfWidth[i] + entities.halfWidth[j];
+			if (fabsf(dx) < reach && fabsf(dz) < reach && fabsf(entities.y[j] - entities.y[i]) < 0.9) bruteOverlaps++;
+		}
+	}
+	double bruteTime = getTime() - start;
+	printf("overlaps: %ld with the hash in %.3f ms (%ld candidates), %ld checking every pair in %.3f ms\n", hashOverlaps, hashTime * 1000, entities.pairsChecked, bruteOverlaps, bruteTime * 1000);
+}
+
+// Runs whole frames like the game loop with the camera moving and checks that once the frame arena has grown, frames never call malloc.
+// ncurses sometimes allocates inside refresh(), so the heap calls made while presenting are counted on their own
+void benchArena() {
+	static int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE];
+	static ChunkMesh mesh[NUM_CHUNKS];
+	static LightMap light;
+	int chunkVisible[CHUNKS][CHUNKS][CHUNKS];
+	int chunkConnections[CHUNKS][CHUNKS][CHUNKS][6];
+	int frames = 1000;
+	int warmup = 100;
+	int occluded;
+	const char* outputNames[2] = {"ncurses", "truecolor"};
+	
+	generateTerrain(blockPositions, 0);
+	computeLight(&light, blockPositions);
+	generatePolygons(blockPositions, mesh, blockColors, &light);
+	computeChunkConnections(blockPositions, chunkConnections);
+	openHeadlessScreen(50, 200);
+	printf("arena: seed 0, 200x50 screen, %d frames with the camera moving, heap calls counted after %d frames\n", frames, warmup);
+	printf("%-10s %14s %16s %8s\n", "output", "frame mallocs", "present mallocs", "result");
+	
+	for (int run = 0; run < 2; run++) {
+		startAnsiOutput(profiler.terminalFd, run == 0 ? OUTPUT_CURSES : OUTPUT_TRUECOLOR);
+		long frameMallocs = 0;
+		long presentMallocs = 0;
+		for (int frame = 0; frame < frames; frame++) {
+			long mallocs = heapCalls;
+			// walks in a circle around the middle of the world looking around, so the number of triangles keeps changing
+			double playerPos[3] = {16 + cos(frame / 50.0) * 10, 26, 16 + sin(frame / 50.0) * 10};
+			double playerRot[3] = {-30, frame * 1.5, 0};
+			arenaReset(&frameArena);
+			cullOcclusion(playerPos, chunkConnections, chunkVisible);
+			float (*screenCoords)[CHUNK_VERTICIES][3] = arenaAlloc(&frameArena, NUM_CHUNKS * sizeof(*screenCoords));
+			convertScreen(mesh, screenCoords, playerPos, playerRot, chunkVisible);
+			int* drawOrder = arenaAlloc(&frameArena, countTriangles(mesh, chunkVisible) * sizeof(int));
+			int numDraw = cullBack(mesh, screenCoords, drawOrder, chunkVisible, &occluded);
+			orderPoly(mesh, screenCoords, drawOrder, numDraw);
+			DrawCommand* commands = arenaAlloc(&frameArena, numDraw * sizeof(DrawCommand));
+			buildDrawCommands(mesh, screenCoords, drawOrder, numDraw, commands);
+			erase();
+			drawAll(commands, numDraw);
+			mvprintw(0, 0, "Triangles: %d", numDraw);
+			long presenting = heapCalls;
+			presentScreen();
+			if (frame < warmup) continue;
+			frameMallocs += presenting - mallocs;
+			presentMallocs += heapCalls - presenting;
+		}
+		int passed = frameMallocs == 0 && presentMallocs == 0;
+		printf("%-10s %14ld %16ld %8s\n", outputNames[run], frameMallocs, presentMallocs, passed ? "ok" : "FAILED");
+	}
+	startAnsiOutput(profiler.terminalFd, OUTPUT_CURSES);
+	endwin();
+	printf("frame arena: high water %zu bytes, %zu bytes allocated, grown %ld times\n", frameArena.highWater, frameArena.capacity, frameArena.grows);
+}
+
+// Fills the whole world 256 times (1048576 blocks) as region edits, undoes and redoes all of them, then compares delta and full saves
+void benchEdits() {
+	static int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE];
+	static int original[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE];
+	static int filled[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE];
+	static ChunkMesh mesh[NUM_CHUNKS];
+	static UpdateQueue updates;
+	static LightMap light;
+	static EditLog edits;
+	int fills = 256;
+	int from[3] = {0, 0, 0};
+	int to[3] = {WORLD_SIZE - 1, WORLD_SIZE - 1, WORLD_SIZE - 1};
+	
+	printf("edits: seed 0, %d fills of the whole %d block world\n", fills, NUM_CELLS);
+	printf("%-8s %10s %12s %12s %12s %12s %8s\n", "light", "blocks", "fill ms", "ns/block", "remesh ms", "undo ms", "undo ok");
+	for (int run = 0; run < 2; run++) {
+		generateTerrain(blockPositions, 0);
+		memcpy(original, blockPositions, sizeof(original));
+		initBlockUpdates(&updates, blockPositions);
+		if (run == 1) {
+			computeLight(&light, blockPositions);
+			updates.light = &light;
+		}
+		generatePolygons(blockPositions, mesh, blockColors, updates.light);
+		free(edits.changes);
+		free(edits.operations);
+		memset(&edits, 0, sizeof(edits));
+		
+		long blocks = 0;
+		double fillTime = 0, remeshTime = 0;
+		for (int i = 0; i < fills; i++) {
+			double start = getTime();
+			blocks += fillRegion(&edits, &updates, blockPositions, from, to, i % 2 ? 1 : 2, ANY_BLOCK);
+			double middle = getTime();
+			// one remesh of the touched chunks for the whole fill
+			remeshDirty(&updates, blockPositions, mesh);
+			fillTime += middle - start;
+			remeshTime += getTime() - middle;
+		}
+		memcpy(filled, blockPositions, sizeof(filled));
+		
+		double start = getTime();
+		while (undoEdit(&edits, &updates, blockPositions));
+		double undoTime = getTime() - start;
+		int undone = memcmp(blockPositions, original, sizeof(original)) == 0;
+		while (redoEdit(&edits, &updates, blockPositions));
+		int redone = memcmp(blockPositions, filled, sizeof(filled)) == 0;
+		remeshDirty(&updates, blockPositions, mesh);
+		printf("%-8s %10ld %12.3f %12.1f %12.3f %12.3f %8s\n", run ? "on" : "off", blocks, fillTime * 1000, fillTime / blocks * 1e9, remeshTime * 1000, undoTime * 1000, undone && redone ? "yes" : "NO");
+	}
+	
+	// saves go into a scratch directory so world.txt isn't touched
+	char directory[] = "/tmp/blockgame-edits-XXXXXX";
+	char previous[4096];
+	if (!mkdtemp(directory) || !getcwd(previous, sizeof(previous)) || chdir(directory) == -1) return;
+	long fullBytes = saveEdits(&edits, blockPositions, 1);
+	int corner[3] = {4, 4, 4};
+	int other[3] = {7, 7, 7};
+	fillRegion(&edits, &updates, blockPositions, corner, other, 3, ANY_BLOCK);
+	long deltaBytes = saveEdits(&edits, blockPositions, 0);
+	memcpy(filled, blockPositions, sizeof(filled));
+	FILE* level = fopen("world.txt", "r");
+	loadTerrain(blockPositions, level);
+	fclose(level);
+	int applied = loadEdits(&edits, blockPositions);
+	int matches = memcmp(blockPositions, filled, sizeof(filled)) == 0;
+	unlink(EDITS_FILE);
+	unlink("world.txt");
+	if (chdir(previous) == -1) return;
+	rmdir(directory);
+	printf("saving a 4x4x4 fill: full save %ld bytes, delta save %ld bytes (%d deltas, world after loading %s)\n", fullBytes, deltaBytes, applied, matches ? "matches" : "DIFFERS");
+}
+
+// Starts new worlds with the load on the main thread and on a loader thread behind loading frames, and times how long until something is on screen
+void benchStartup() {
+	static int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE];
+	static ChunkMesh mesh[NUM_CHUNKS];
+	static float screenCoords[NUM_CHUNKS][CHUNK_VERTICIES][3];
+	static int drawOrder[MAX_TRIANGLES];
+	static DrawCommand commands[MAX_TRIANGLES];
+	static LightMap light;
+	static UpdateQueue updates;
+	static EntityStore entities;
+	static EditLog edits;
+	int chunkConnections[CHUNKS][CHUNKS][CHUNKS][6];
+	int chunkVisible[CHUNKS][CHUNKS][CHUNKS];
+	int starts = 20;
+	int culled;
+	const char* loadNames[2] = {"blocking", "thread"};
+	double camera[6] = {16, 32, 16, 0, 0, 0};
+	
+	openHeadlessScreen(50, 200);
+	printf("startup: %d new worlds from seeds 0 to %d, 200x50 screen\n", starts, starts - 1);
+	printf("%-10s %16s %16s %18s %15s\n", "load", "first frame ms", "world ready ms", "first world ms", "loading frames");
+	for (int threaded = 0; threaded < 2; threaded++) {
+		double firstFrame = 0, worldReady = 0, firstWorld = 0;
+		long loadingFrames = 0;
+		for (int seed = 0; seed < starts; seed++) {
+			WorldLoad load = {.seed = seed, .levelName = "", .blockPositions = blockPositions, .mesh = mesh, .light = &light, .updates = &updates, .entities = &entities, .edits = &edits, .chunkConnections = chunkConnections};
+			pthread_t loader;
+			entities.count = 0;
+			double start = getTime();
+			double shown = 0;
+			if (threaded && pthread_create(&loader, NULL, loadWorldThread, &load) == 0) {
+				// loading frames every millisecond until the world is there
+				while (!__atomic_load_n(&load.done, __ATOMIC_ACQUIRE)) {
+					drawLoading(loadingFrames++, getTime() - start);
+					presentScreen();
+					if (shown == 0) shown = getTime();
+					usleep(1000);
+				}
+				pthread_join(loader, NULL);
+			} else {
+				loadWorld(&load);
+			}
+			
+			cullOcclusion(camera, chunkConnections, chunkVisible);
+			convertScreen(mesh, screenCoords, camera, &camera[3], chunkVisible);
+			arenaReset(&frameArena);
+			int numDraw = cullBack(mesh, screenCoords, drawOrder, chunkVisible, &culled);
+			orderPoly(mesh, screenCoords, drawOrder, numDraw);
+			buildDrawCommands(mesh, screenCoords, drawOrder, numDraw, commands);
+			erase();
+			drawAll(commands, numDraw);
+			presentScreen();
+			double end = getTime();
+			if (shown == 0) shown = end;
+			firstFrame += shown - start;
+			worldReady += load.finishTime - start;
+			firstWorld += end - start;
+		}
+		printf("%-10s %16.3f %16.3f %18.3f %15.1f\n", loadNames[threaded], firstFrame / starts * 1000, worldReady / starts * 1000, firstWorld / starts * 1000, (double)loadingFrames / starts);
+	}
+	endwin();
+}
+
+// Draws the same frames with the float and the fixed point rasterizers, timing the sort and the raster of each and
+// comparing every cell of the fixed point frames against the float ones
+void benchFixed() {
+	static int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE];
+	static ChunkMesh mesh[NUM_CHUNKS];
+	static float screenCoords[NUM_CHUNKS][CHUNK_VERTICIES][3];
+	static int drawOrder[MAX_TRIANGLES];
+	static DrawCommand commands[MAX_TRIANGLES];
+	static FixedCommand fixedCommands[MAX_TRIANGLES];
+	static chtype golden[200 * 50];
+	static LightMap light;
+	int chunkVisible[CHUNKS][CHUNKS][CHUNKS];
+	int frames = 120;
+	int culled;
+	const char* pathNames[2] = {"float", "fixed"};
+	// the last camera stands right against the ground so some triangles cross the near plane
+	double cameras[4][6] = {
+		{16, 30, 16, -60, 0, 0},
+		{4, 24, 4, -20, -135, 0},
+		{16, 20, 40, -10, 180, 0},
+		{8, 0, 8, 10, 0, 0}
+	};
+	
+	generateTerrain(blockPositions, 0);
+	computeLight(&light, blockPositions);
+	generatePolygons(blockPositions, mesh, blockColors, &light);
+	showAllChunks(chunkVisible);
+	for (int y = WORLD_SIZE - 1; y >= 0; y--) {
+		if (blockPositions[4][y][4] != -1) {
+			cameras[3][1] = y * 2 + 2.05;
+			break;
+		}
+	}
+	
+	openHeadlessScreen(50, 200);
+	printf("fixed: seed 0, 200x50 screen, %d frames per camera turning 3 degrees a frame\n", frames);
+	printf("%-7s %-6s %10s %10s %10s %12s %12s %12s\n", "camera", "path", "triangles", "sort ms", "raster ms", "float tris", "cells diff", "same frames");
+	for (int c = 0; c < 4; c++) {
+		double sortTime[2] = {0}, rasterTime[2] = {0};
+		long triangles = 0, near = 0, different = 0;
+		int sameFrames = 0;
+		for (int frame = 0; frame < frames; frame++) {
+			double camera[6];
+			memcpy(camera, cameras[c], sizeof(camera));
+			camera[4] += frame * 3;
+			convertScreen(mesh, screenCoords, camera, &camera[3], chunkVisible);
+			for (int path = 0; path < 2; path++) {
+				arenaReset(&frameArena);
+				int numDraw = cullBack(mesh, screenCoords, drawOrder, chunkVisible, &culled);
+				erase();
+				double start = getTime();
+				if (path == 0) {
+					orderPoly(mesh, screenCoords, drawOrder, numDraw);
+					buildDrawCommands(mesh, screenCoords, drawOrder, numDraw, commands);
+				} else {
+					orderPolyFixed(mesh, screenCoords, drawOrder, numDraw);
+					buildFixedCommands(mesh, screenCoords, drawOrder, numDraw, fixedCommands);
+				}
+				double middle = getTime();
+				if (path == 0) drawAll(commands, numDraw);
+				else drawAllFixed(fixedCommands, numDraw);
+				sortTime[path] += middle - start;
+				rasterTime[path] += getTime() - middle;
+				
+				// the float frame is the golden one the fixed point frame is checked against
+				int size = viewport.width * viewport.height;
+				if (path == 0) {
+					memcpy(golden, viewport.frame, size * sizeof(chtype));
+					triangles += numDraw;
+				} else {
+					int cells = 0;
+					for (int i = 0; i < size; i++) cells += viewport.frame[i] != golden[i];
+					for (int i = 0; i < numDraw; i++) near += fixedCommands[i].shift < 0;
+					different += cells;
+					sameFrames += cells == 0;
+				}
+			}
+		}
+		for (int path = 0; path < 2; path++) {
+			printf("%-7d %-6s %10ld %10.4f %10.4f", c, pathNames[path], triangles / frames, sortTime[path] / frames * 1000, rasterTime[path] / frames * 1000);
+			if (path == 0) printf("\n");
+			else printf(" %12ld %11.3f%% %12d\n", near / frames, 100.0 * different / frames / (viewport.width * viewport.height), sameFrames);
+		}
+	}
+	endwin();
+}
+
+// Fills the triangles of a few views with each fill variant and with the generic loop, timing each per cell tested
+// and checking both leave the same framebuffer
+void benchVariants() {
+	static int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE];
+	static ChunkMesh mesh[NUM_CHUNKS];
+	static float screenCoords[NUM_CHUNKS][CHUNK_VERTICIES][3];
+	static int drawOrder[MAX_TRIANGLES];
+	static DrawCommand commands[MAX_TRIANGLES];
+	static FillJob jobs[MAX_TRIANGLES];
+	static chtype golden[200 * 50];
+	static float goldenDepth[200 * 50];
+	static unsigned char goldenLight[200 * 50];
+	static LightMap light;
+	int chunkVisible[CHUNKS][CHUNKS][CHUNKS];
+	int repeats = 200;
+	int culled;
+	const char* variantNames[2][2] = {{"flat", "flat lit"}, {"depth", "depth lit"}};
+	// the last view looks down through the ground, so faces reaching behind the camera fill most of the screen without a depth test
+	double cameras[4][6] = {
+		{16, 30, 16, -60, 0, 0},
+		{4, 24, 4, -20, -135, 0},
+		{16, 20, 40, -10, 180, 0},
+		{13, 16, 30, -58, 154, 0}
+	};
+	long triangles[2] = {0}, tested[2] = {0}, cells[2][2] = {{0}};
+	double genericTime[2][2] = {{0}}, variantTime[2][2] = {{0}};
+	int same[2][2] = {{1, 1}, {1, 1}};
+	
+	generateTerrain(blockPositions, 0);
+	computeLight(&light, blockPositions);
+	generatePolygons(blockPositions, mesh, blockColors, &light);
+	showAllChunks(chunkVisible);
+	
+	openHeadlessScreen(50, 200);
+	int size = viewport.width * viewport.height;
+	for (int c = 0; c < 4; c++) {
+		convertScreen(mesh, screenCoords, cameras[c], &cameras[c][3], chunkVisible);
+		arenaReset(&frameArena);
+		int numDraw = cullBack(mesh, screenCoords, drawOrder, chunkVisible, &culled);
+		orderPoly(mesh, screenCoords, drawOrder, numDraw);
+		buildDrawCommands(mesh, screenCoords, drawOrder, numDraw, commands);
+		
+		// the triangles of the view split by whether they get a depth test, in draw order
+		for (int depthTest = 0; depthTest < 2; depthTest++) {
+			int numJobs = 0;
+			for (int i = 0; i < numDraw; i++) {
+				if (setupFill(commands[i].points, commands[i].color, commands[i].glyph, commands[i].light, &jobs[numJobs]) && jobs[numJobs].depthTest == depthTest) numJobs++;
+			}
+			triangles[depthTest] += numJobs;
+			for (int i = 0; i < numJobs; i++) {
+				if (jobs[i].right >= jobs[i].left && jobs[i].top >= jobs[i].bottom) tested[depthTest] += (long)(jobs[i].right - jobs[i].left + 1) * (jobs[i].top - jobs[i].bottom + 1);
+			}
+			
+			for (int keepLight = 0; keepLight < 2; keepLight++) {
+				for (int i = 0; i < numJobs; i++) jobs[i].keepLight = keepLight;
+				for (int generic = 1; generic >= 0; generic--) {
+					long filled = 0;
+					double time = 0;
+					for (int repeat = 0; repeat < repeats; repeat++) {
+						clearViewport();
+						double start = getTime();
+						for (int i = 0; i < numJobs; i++) filled += generic ? fillGeneric(&jobs[i]) : fillVariants[depthTest][keepLight](&jobs[i]);
+						time += getTime() - start;
+					}
+					if (generic) {
+						genericTime[depthTest][keepLight] += time;
+						cells[depthTest][keepLight] += filled;
+						memcpy(golden, viewport.frame, size * sizeof(chtype));
+						memcpy(goldenDepth, viewport.depth, size * sizeof(float));
+						memcpy(goldenLight, viewport.light, size);
+					} else {
+						variantTime[depthTest][keepLight] += time;
+						if (memcmp(golden, viewport.frame, size * sizeof(chtype)) != 0 || memcmp(goldenDepth, viewport.depth, size * sizeof(float)) != 0 || memcmp(goldenLight, viewport.light, size) != 0) same[depthTest][keepLight] = 0;
+					}
+				}
+			}
+		}
+	}
+	endwin();
+	
+	printf("variants: seed 0, 200x50 screen, the triangles of 4 views filled %d times\n", repeats);
+	printf("%-10s %10s %12s %12s %16s %16s %8s %6s\n", "variant", "triangles", "cells tested", "cells filled", "generic ns/cell", "variant ns/cell", "speedup", "same");
+	for (int depthTest = 0; depthTest < 2; depthTest++) {
+		for (int keepLight = 0; keepLight < 2; keepLight++) {
+			double perCell = tested[depthTest] > 0 ? 1e9 / tested[depthTest] / repeats : 0;
+			printf("%-10s %10ld %12ld %12ld %16.2f %16.2f %7.2fx %6s\n", variantNames[depthTest][keepLight], triangles[depthTest], tested[depthTest], cells[depthTest][keepLight] / repeats,
+				genericTime[depthTest][keepLight] * perCell, variantTime[depthTest][keepLight] * perCell,
+				genericTime[depthTest][keepLight] / variantTime[depthTest][keepLight], same[depthTest][keepLight] ? "yes" : "NO");
+		}
+	}
+}
+
+// Draws the same camera path with the triangle pipeline and the raymarch renderer on the surface and dense cave worlds,
+// with the rays split between 1, 2 and 4 threads, and compares the cells each fills and what an edit costs each of them
+void benchRaymarch() {
+	static int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE];
+	static ChunkMesh mesh[NUM_CHUNKS];
+	static float screenCoords[NUM_CHUNKS][CHUNK_VERTICIES][3];
+	static int drawOrder[MAX_TRIANGLES];
+	static DrawCommand commands[MAX_TRIANGLES];
+	static int chunkConnections[CHUNKS][CHUNKS][CHUNKS][6];
+	static chtype golden[200 * 50];
+	static LightMap light;
+	static UpdateQueue updates;
+	int chunkVisible[CHUNKS][CHUNKS][CHUNKS];
+	int frames = 100;
+	int edits = 50;
+	int culled;
+	const char* worldNames[2] = {"surface", "caves"};
+	int threadCounts[3] = {1, 2, 4};
+	
+	openHeadlessScreen(50, 200);
+	int size = viewport.width * viewport.height;
+	printf("raymarch: 200x50 screen, %d frames per world circling the middle, %d block edits\n", frames, edits);
+	printf("%-8s %-10s %8s %10s %10s %12s %10s\n", "world", "renderer", "threads", "frame ms", "cells", "same cells", "edit ms");
+	for (int world = 0; world < 2; world++) {
+		if (world == 1) makeCaveWorld(blockPositions, 7);
+		else generateTerrain(blockPositions, 7);
+		computeLight(&light, blockPositions);
+		generatePolygons(blockPositions, mesh, blockColors, &light);
+		computeChunkConnections(blockPositions, chunkConnections);
+		initBlockUpdates(&updates, blockPositions);
+		updates.light = &light;
+		
+		// digs and builds at random in the top half the way the game does. blockChanged relights around the block and updates the brickmap,
+		// which is all the raymarcher needs, and the triangles also have to remesh the chunks it marked and connect them again
+		srand(world);
+		double changeTime = 0;
+		double remeshTime = 0;
+		for (int i = 0; i < edits; i++) {
+			int x = rand() % WORLD_SIZE;
+			int y = WORLD_SIZE / 2 + rand() % (WORLD_SIZE / 2);
+			int z = rand() % WORLD_SIZE;
+			blockPositions[x][y][z] = rand() % 2 == 0 ? -1 : 1;
+			double start = getTime();
+			blockChanged(&updates, blockPositions, x, y, z);
+			double changed = getTime();
+			remeshDirty(&updates, blockPositions, mesh);
+			computeChunkConnections(blockPositions, chunkConnections);
+			changeTime += changed - start;
+			remeshTime += getTime() - changed;
+		}
+		
+		long triangleCells = 0;
+		double triangleTime = 0;
+		long rayCells[3] = {0}, same[3] = {0};
+		double rayTime[3] = {0};
+		for (int frame = 0; frame < frames; frame++) {
+			double angle = frame * 3.6 / 180 * M_PI;
+			double camera[6] = {16 + 10 * sin(angle), 30, 16 - 10 * cos(angle), -35, frame * 3.6, 0};
+			
+			double start = getTime();
+			arenaReset(&frameArena);
+			cullOcclusion(camera, chunkConnections, chunkVisible);
+			convertScreen(mesh, screenCoords, camera, &camera[3], chunkVisible);
+			int numDraw = cullBack(mesh, screenCoords, drawOrder, chunkVisible, &culled);
+			orderPoly(mesh, screenCoords, drawOrder, numDraw);
+			buildDrawCommands(mesh, screenCoords, drawOrder, numDraw, commands);
+			erase();
+			triangleCells += drawAll(commands, numDraw);
+			triangleTime += getTime() - start;
+			memcpy(golden, viewport.frame, size * sizeof(chtype));
+			
+			for (int t = 0; t < 3; t++) {
+				if (raymarcher.threads != threadCounts[t]) startRaymarch(threadCounts[t]);
+				erase();
+				start = getTime();
+				rayCells[t] += drawRaymarch(blockPositions, &light, camera, &camera[3]);
+				rayTime[t] += getTime() - start;
+				for (int i = 0; i < size; i++) same[t] += viewport.frame[i] == golden[i];
+			}
+		}
+		printf("%-8s %-10s %8s %10.3f %10ld %12s %10.4f\n", worldNames[world], "triangles", "1", triangleTime / frames * 1000, triangleCells / frames, "", (changeTime + remeshTime) / edits * 1000);
+		for (int t = 0; t < 3; t++) {
+			printf("%-8s %-10s %8d %10.3f %10ld %11.2f%% %10.4f\n", worldNames[world], "raymarch", threadCounts[t], rayTime[t] / frames * 1000, rayCells[t] / frames, 100.0 * same[t] / frames / size, changeTime / edits * 1000);
+		}
+	}
+	stopRaymarch();
+	raymarcher.threads = 0;
+	endwin();
+}
+
+// Long rays through the whole world with and without empty brick skipping, plus picking, collision probes, meshing and brickmap edits, in a sparse, a surface and a cave world
+void benchBrickmap() {
+	static int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE];
+	static ChunkMesh mesh[NUM_CHUNKS];
+	static LightMap light;
+	const char* worldNames[3] = {"sparse", "surface", "caves"};
+	int rays = 200000;
+	int picks = 200000;
+	int edits = 1000000;
+	
+	printf("brickmap: %d rays from random points in random directions, %d picks and collision checks, %d edits\n", rays, picks, edits);
+	printf("%-8s %7s %8s %9s %9s %8s %10s %8s %9s %8s %10s %8s %8s %10s\n", "world", "bricks", "ray hits", "grid ns", "brick ns", "speedup", "same hits", "picked", "pick ns", "blocked", "collide ns", "mesh ms", "edit ns", "rebuild us");
+	for (int world = 0; world < 3; world++) {
+		if (world == 2) makeCaveWorld(blockPositions, 7);
+		else generateTerrain(blockPositions, 7);
+		if (world == 0) {
+			// a few floating blocks in an otherwise empty world
+			memset(blockPositions, -1, sizeof(blockPositions));
+			srand(7);
+			for (int i = 0; i < 12; i++) blockPositions[rand() % WORLD_SIZE][rand() % WORLD_SIZE][rand() % WORLD_SIZE] = 1;
+		}
+		computeLight(&light, blockPositions);
+		buildBrickMap(blockPositions);
+		int occupied = __builtin_popcountll(brickmap.occupied);
+		
+		// the same rays are cast stepping through every block and skipping empty bricks
+		double (*origins)[3] = malloc(rays * sizeof(*origins));
+		double (*directions)[3] = malloc(rays * sizeof(*directions));
+		srand(11);
+		for (int i = 0; i < rays; i++) {
+			double yaw = (double)rand() / RAND_MAX * 2 * M_PI;
+			double pitch = asin((double)rand() / RAND_MAX * 2 - 1);
+			for (int a = 0; a < 3; a++) origins[i][a] = (double)rand() / RAND_MAX * WORLD_SIZE;
+			directions[i][0] = cos(pitch) * cos(yaw);
+			directions[i][1] = sin(pitch);
+			directions[i][2] = cos(pitch) * sin(yaw);
+		}
+		chtype* cells = malloc(rays * 2 * sizeof(chtype));
+		float* depths = malloc(rays * 2 * sizeof(float));
+		int* hit = malloc(rays * 2 * sizeof(int));
+		int lit;
+		double times[2];
+		for (int pass = 0; pass < 2; pass++) {
+			double start = getTime();
+			for (int i = 0; i < rays; i++) {
+				int j = pass * rays + i;
+				hit[j] = castRay(origins[i], directions[i], blockPositions, pass ? &brickmap : NULL, &light, &cells[j], &lit, &depths[j]);
+			}
+			times[pass] = getTime() - start;
+		}
+		long hits = 0, same = 0;
+		for (int i = 0; i < rays; i++) {
+			int j = rays + i;
+			hits += hit[i];
+			same += hit[i] == hit[j] && (!hit[i] || (cells[i] == cells[j] && fabs(depths[i] - depths[j]) < 1e-4));
+		}
+		double gridTime = times[0], brickTime = times[1];
+		free(cells);
+		free(depths);
+		free(hit);
+		free(origins);
+		free(directions);
+		
+		// picking and the collision probes of a player standing anywhere
+		int blocksTouching[2][3];
+		double collisionPoints[12][3];
+		long picked = 0, blocked = 0;
+		srand(13);
+		double (*positions)[3] = malloc(picks * sizeof(*positions));
+		double (*rotations)[2] = malloc(picks * sizeof(*rotations));
+		for (int i = 0; i < picks; i++) {
+			for (int a = 0; a < 3; a++) positions[i][a] = (double)rand() / RAND_MAX * WORLD_SIZE * 2;
+			rotations[i][0] = (double)rand() / RAND_MAX * 180 - 90;
+			rotations[i][1] = (double)rand() / RAND_MAX * 360;
+		}
+		double start = getTime();
+		for (int i = 0; i < picks; i++) {
+			playerTouching(positions[i], rotations[i], blockPositions, blocksTouching);
+			picked += blocksTouching[1][0] != -1;
+		}
+		double pickTime = getTime() - start;
+		start = getTime();
+		for (int i = 0; i < picks; i++) {
+			for (int j = 0; j < 12; j++) {
+				collisionPoints[j][0] = positions[i][0] / 2 + (j % 2 ? -0.299 : 0.299);
+				collisionPoints[j][1] = positions[i][1] / 2 + (j < 4 ? -1.599 : (j < 8 ? -0.7 : 0.199));
+				collisionPoints[j][2] = positions[i][2] / 2 + (j % 4 < 2 ? 0.299 : -0.299);
+			}
+			blocked += pointsCollide(collisionPoints, 12, i % 3, 0.1, blockPositions);
+		}
+		double collideTime = getTime() - start;
+		free(positions);
+		free(rotations);
+		
+		start = getTime();
+		for (int i = 0; i < 20; i++) generatePolygons(blockPositions, mesh, blockColors, &light);
+		double meshTime = (getTime() - start) / 20;
+		
+		// flipping random blocks and putting them back, against building the whole brickmap again
+		srand(17);
+		start = getTime();
+		for (int i = 0; i < edits; i++) {
+			int* block = &blockPositions[rand() % WORLD_SIZE][rand() % WORLD_SIZE][rand() % WORLD_SIZE];
+			*block = -1 - *block;
+			updateBrickMap(blockPositions, (block - &blockPositions[0][0][0]) / (WORLD_SIZE * WORLD_SIZE), (block - &blockPositions[0][0][0]) / WORLD_SIZE % WORLD_SIZE, (block - &blockPositions[0][0][0]) % WORLD_SIZE);
+		}
+		double editTime = (getTime() - start) / edits;
+		start = getTime();
+		for (int i = 0; i < 1000; i++) buildBrickMap(blockPositions);
+		double rebuildTime = (getTime() - start) / 1000;
+		
+		// picked is how many picks found a block and blocked how many probe moves would hit one
+		printf("%-8s %4d/%-2d %7.1f%% %9.1f %9.1f %7.2fx %9.2f%% %7.1f%% %9.1f %7.1f%% %10.1f %8.3f %8.1f %10.2f\n", worldNames[world], occupied, NUM_BRICKS, 100.0 * hits / rays,
+			gridTime / rays * 1e9, brickTime / rays * 1e9, gridTime / brickTime, 100.0 * same / rays, 100.0 * picked / picks, pickTime / picks * 1e9, 100.0 * blocked / picks, collideTime / picks * 1e9, meshTime * 1000, editTime * 1e9, rebuildTime * 1e6);
+	}
+}
+
+// Flies in a straight line across a 1024x16x1024 block world streamed through the chunk cache, with chunks generated or read from a file,
+// at three memory budgets, with and without the prefetch thread. every frame uses each chunk within 4 chunks of the player like meshing them would
+void benchStream() {
+	int size[3] = {256, 4, 256};
+	int radius = 4;
+	int frames = 480;
+	long budgets[3] = {48 * 1024, 96 * 1024, 384 * 1024};
+	const char* sourceNames[2] = {"generate", "file"};
+	
+	// the file is the generated world written out chunk by chunk
+	FILE* records = tmpfile();
+	signed char blocks[CHUNK_CELLS];
+	for (int x = 0; x < size[0]; x++) {
+		for (int y = 0; y < size[1]; y++) {
+			for (int z = 0; z < size[2]; z++) {
+				generateStreamChunk(7, x, y, z, blocks);
+				fwrite(blocks, 1, CHUNK_CELLS, records);
+			}
+		}
+	}
+	fflush(records);
+	long chunks = (long)size[0] * size[1] * size[2];
+	
+	printf("stream: %dx%dx%d block world (%ld MB as a whole int array, %ld KB of chunk records), %d frames flying along x at half a chunk per frame, chunks within %d used every frame\n",
+		size[0] * CHUNK_SIZE, size[1] * CHUNK_SIZE, size[2] * CHUNK_SIZE, chunks * CHUNK_CELLS * (long)sizeof(int) >> 20, chunks * CHUNK_CELLS >> 10, frames, radius);
+	printf("%-9s %9s %7s %9s %9s %8s %9s %10s %11s %9s %9s %7s\n", "source", "budget KB", "chunks", "prefetch", "hit rate", "stalls", "stall ms", "evictions", "prefetched", "frame ms", "worst ms", "blocks");
+	long reference = 0;
+	for (int source = 0; source < 2; source++) {
+		for (int b = 0; b < 3; b++) {
+			for (int prefetch = 0; prefetch < 2; prefetch++) {
+				ChunkCache cache;
+				openChunkCache(&cache, budgets[b], size, 7, source == 1 ? fileno(records) : -1, prefetch);
+				double pos[3] = {8, 20, size[2] * CHUNK_SIZE};
+				double move[3] = {CHUNK_SIZE, 0, 0};
+				long checksum = 0;
+				double total = 0, worst = 0;
+				for (int frame = 0; frame < frames; frame++) {
+					double start = getTime();
+					int middle[3];
+					for (int i = 0; i < 3; i++) middle[i] = (int)(pos[i] / 2 / CHUNK_SIZE);
+					for (int x = middle[0] - radius; x <= middle[0] + radius; x++) {
+						for (int y = middle[1] - radius; y <= middle[1] + radius; y++) {
+							for (int z = middle[2] - radius; z <= middle[2] + radius; z++) {
+								StreamChunk* chunk = useChunk(&cache, x, y, z);
+								if (chunk == NULL) continue;
+								for (int i = 0; i < CHUNK_CELLS; i++) checksum += chunk->blocks[i] * (i + 1);
+								releaseChunk(&cache, chunk);
+							}
+						}
+					}
+					prefetchAhead(&cache, pos, move, radius);
+					double elapsed = getTime() - start;
+					total += elapsed;
+					if (elapsed > worst) worst = elapsed;
+					for (int i = 0; i < 3; i++) pos[i] += move[i];
+					
+					// the rest of the frame, which the prefetcher gets to use
+					usleep(1000);
+				}
+				closeChunkCache(&cache);
+				if (reference == 0) reference = checksum;
+				printf("%-9s %9ld %7d %9s %8.2f%% %8ld %9.1f %10ld %11ld %9.3f %9.3f %7s\n", sourceNames[source], budgets[b] / 1024, cache.capacity, prefetch ? "on" : "off",
+					100.0 * cache.hits / cache.lookups, cache.stalls, cache.stallTime * 1000, cache.evictions, cache.prefetched, total / frames * 1000, worst * 1000, checksum == reference ? "same" : "DIFFER");
+			}
+		}
+	}
+	fclose(records);
+}
+
+// Checks the heightmap against scanning every column after each step of random edit sequences (blocks, region fills, undo, redo and block ticks),
+// then times its queries and updates against scanning the world for the same answers
+void benchHeightmap() {
+	static int blockPositions[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE];
+	static UpdateQueue updates;
+	static EditLog edits;
+	int sequences = 20;
+	int steps = 1000;
+	int queries = 1000000;
+	long wrongColumns = 0, wrongHighest = 0;
+	
+	printf("heightmap: %d random edit sequences of %d steps, checked against scanning every column after each step\n", sequences, steps);
+	for (int sequence = 0; sequence < sequences; sequence++) {
+		generateTerrain(blockPositions, sequence);
+		initBlockUpdates(&updates, blockPositions);
+		free(edits.changes);
+		free(edits.operations);
+		memset(&edits, 0, sizeof(edits));
+		srand(sequence + 1);
+		for (int step = 0; step < steps; step++) {
+			int kind = rand() % 8;
+			int a[3], b[3];
+			for (int i = 0; i < 3; i++) {
+				a[i] = rand() % WORLD_SIZE;
+				b[i] = a[i] + rand() % 4;
+				if (b[i] >= WORLD_SIZE) b[i] = WORLD_SIZE - 1;
+			}
+			int block = rand() % 3 == 0 ? -1 : rand() % NUM_BLOCKS;
+			if (kind < 4) {
+				beginEdit(&edits);
+				setBlock(&edits, &updates, blockPositions, a[0], a[1], a[2], block);
+				endEdit(&edits);
+			} else if (kind == 4) {
+				fillRegion(&edits, &updates, blockPositions, a, b, block, ANY_BLOCK);
+			} else if (kind == 5) {
+				undoEdit(&edits, &updates, blockPositions);
+			} else if (kind == 6) {
+				redoEdit(&edits, &updates, blockPositions);
+			} else {
+				for (int tick = 0; tick < 5; tick++) runBlockUpdates(&updates, blockPositions, TICK_BUDGET);
+			}
+			
+			int highest = -1;
+			for (int x = 0; x < WORLD_SIZE; x++) {
+				for (int z = 0; z < WORLD_SIZE; z++) {
+					int y = WORLD_SIZE - 1;
+					while (y >= 0 && blockPositions[x][y][z] == -1) y--;
+					if (y > highest) highest = y;
+					wrongColumns += columnHeight(&heightmap, x, z) != y || surfaceBlock(&heightmap, x, z) != (y >= 0 ? blockPositions[x][y][z] : -1);
+				}
+			}
+			wrongHighest += highestBlock(&heightmap) != highest;
+		}
+	}
+	printf("%ld steps checked, %ld columns and %ld tallest columns differed\n", (long)sequences * steps, wrongColumns, wrongHighest);
+	
+	// the same random columns are asked for their top block both ways
+	generateTerrain(blockPositions, 0);
+	int* columns = malloc(queries * sizeof(int));
+	for (int i = 0; i < queries; i++) columns[i] = rand() % (WORLD_SIZE * WORLD_SIZE);
+	long mapSum = 0, scanSum = 0;
+	double start = getTime();
+	for (int i = 0; i < queries; i++) mapSum += columnHeight(&heightmap, columns[i] / WORLD_SIZE, columns[i] % WORLD_SIZE);
+	double queryTime = getTime() - start;
+	start = getTime();
+	for (int i = 0; i < queries; i++) {
+		int y = WORLD_SIZE - 1;
+		while (y >= 0 && blockPositions[columns[i] / WORLD_SIZE][y][columns[i] % WORLD_SIZE] == -1) y--;
+		scanSum += y;
+	}
+	double scanTime = getTime() - start;
+	start = getTime();
+	for (int i = 0; i < queries / 100; i++) mapSum += highestBlock(&heightmap);
+	double highestTime = getTime() - start;
+	start = getTime();
+	for (int i = 0; i < queries / 100; i++) {
+		int highest = -1;
+		for (int x = 0; x < WORLD_SIZE; x++) {
+			for (int z = 0; z < WORLD_SIZE; z++) {
+				int y = WORLD_SIZE - 1;
+				while (y > highest && blockPositions[x][y][z] == -1) y--;
+				if (y > highest) highest = y;
+			}
+		}
+		scanSum += highest;
+	}
+	double highestScanTime = getTime() - start;
+	
+	// breaking and putting back the top block of random columns, which is when a column has to be looked down
+	start = getTime();
+	for (int i = 0; i < queries; i++) {
+		int x = columns[i] / WORLD_SIZE;
+		int z = columns[i] % WORLD_SIZE;
+		int y = columnHeight(&heightmap, x, z);
+		if (y < 0) continue;
+		int block = blockPositions[x][y][z];
+		blockPositions[x][y][z] = -1;
+		updateHeightMap(blockPositions, x, y, z);
+		blockPositions[x][y][z] = block;
+		updateHeightMap(blockPositions, x, y, z);
+	}
+	double updateTime = getTime() - start;
+	free(columns);
+	
+	printf("%-16s %12s %10s\n", "query", "heightmap ns", "scan ns");
+	printf("%-16s %12.2f %10.2f\n", "column height", queryTime / queries * 1e9, scanTime / queries * 1e9);
+	printf("%-16s %12.2f %10.2f\n", "tallest column", highestTime / (queries / 100) * 1e9, highestScanTime / (queries / 100) * 1e9);
+	printf("%-16s %12.2f\n", "break and place", updateTime / queries / 2 * 1e9);
+	printf("both give the same answers: %s\n", mapSum == scanSum ? "yes" : "no");
+}